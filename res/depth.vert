@@ -1,9 +1,16 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 mvp;
+// Per instance attributes, see GPUGeometryBuffer::bind_instances
+layout (location = 5) in mat4 aModel;
+
+uniform mat4 matViewProj;
+
+// Also used by the depth pre-pass, must compute gl_Position exactly like pbr.vert for the GL_EQUAL test to pass.
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = mvp * vec4(aPos, 1.0);
-}  
\ No newline at end of file
+    vec4 worldPosition = aModel * vec4(aPos, 1.0);
+    gl_Position = matViewProj * worldPosition;
+}
\ No newline at end of file
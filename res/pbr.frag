@@ -1,18 +1,32 @@
 #version 330
 
-#define MAX_LIGHTS              4
-#define MAX_SHADOW_MAPS         24
+#define MAX_SHADOWS             16
 #define LIGHT_POINT             0
 #define LIGHT_DIRECTIONAL       1
+#define POINT_SHADOW_NEAR       0.05
 #define PI 3.14159265358979323846
 
-struct Light {
-    int enabled;
-    int type; // 0 = POINT | 1 = DIRECTIONAL
-    vec3 position;
-    vec3 direction;
-    vec3 color;
-    float intensity;
+// Per frame data, shared by every material. Matches GPUFrameData.
+layout (std140) uniform FrameData {
+    mat4 matView;
+    mat4 matProj;
+    vec4 viewPos;
+    vec4 ambient; // w: intensity
+    ivec4 lightCount; // x: directional lights, y: all lights, z: cascades per directional light
+    ivec4 clusterGrid; // xyz: cells per axis
+    vec4 clusterParams; // x: depth slice scale, y: depth slice bias
+    vec4 cascadeSplits; // far view depth of every cascade
+    mat4 matLight[MAX_SHADOWS];
+    vec4 shadowTiles[MAX_SHADOWS]; // xy: atlas offset, z: atlas size, w: layer
+};
+
+// Per material data. Matches GPUPbrMaterialData.
+layout (std140) uniform MaterialData {
+    vec4  albedoColor;
+    vec4  emissiveColor;
+    float metallicValue;
+    float roughnessValue;
+    float aoValue;
 };
 
 // Input vertex attributes (from vertex shader)
@@ -20,14 +34,12 @@ in vec3 fragPosition;
 in vec2 fragTexCoord;
 in vec3 fragColor;
 in vec3 fragNormal;
-in vec4 fragLightSpace[MAX_SHADOW_MAPS];
 in mat3 TBN;
 
 // Output fragment color
 out vec4 finalColor;
 
 // Input uniform values
-uniform int numOfLights;
 uniform sampler2D albedoMap;
 uniform sampler2D mraMap;
 uniform sampler2D normalMap;
@@ -42,19 +54,11 @@ uniform int useTexNormal;
 uniform int useTexMRA;
 uniform int useTexEmissive;
 
-uniform vec4  albedoColor = vec4(1.0);
-uniform vec4  emissiveColor;
-uniform float metallicValue = 0.9;
-uniform float roughnessValue = 0.8;
-uniform float aoValue = 1;
-
 // Input lighting values
 uniform sampler2DArray shadowMaps;
-uniform Light lights[MAX_LIGHTS];
-uniform vec3 viewPos;
-
-uniform vec3 ambientColor;
-uniform float ambient;
+uniform samplerBuffer lightData;       // 3 texels per light, matches GPULightData
+uniform usamplerBuffer clusterCells;   // x: first index, y: light count
+uniform usamplerBuffer clusterIndices; // point light indices, relative to the first point light
 
 // Reflectivity in range 0.0 to 1.0
 // NOTE: Reflectivity is increased when surface view at larger angle
@@ -81,19 +85,129 @@ float GeomSmith(float nDotV,float nDotL,float roughness)
     return ggx1*ggx2;
 }
 
-float Shadows(vec4 fragPosLightSpace, int lightIndex, vec3 normal, vec3 lightDir) 
+// Depth stored in the atlas tile of a shadow view, uv in [0, 1] over the tile. Returns 1 (never shadowed) outside.
+float ShadowDepth(int view, vec2 uv)
+{
+    vec4 tile = shadowTiles[view];
+    if (tile.z == 0.0 || any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return 1.0;
+
+    // Keep filtering from reaching the neighbour tiles.
+    float halfTexel = 0.5 / (tile.z * float(textureSize(shadowMaps, 0).x));
+    uv = clamp(uv, vec2(halfTexel), vec2(1.0 - halfTexel));
+    return texture(shadowMaps, vec3(tile.xy + uv * tile.z, tile.w)).r;
+}
+
+float Shadows(int view, vec3 normal, vec3 lightDir) 
 {
+    // Only the view picked for this fragment is transformed, instead of every view for every vertex.
+    vec4 fragPosLightSpace = matLight[view] * vec4(fragPosition, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
     if (projCoords.z > 1.0) return 0.0;
 
-    float closestDepth = texture(shadowMaps, vec3(projCoords.xy, lightIndex)).r; 
+    float closestDepth = ShadowDepth(view, projCoords.xy);
     float currentDepth = projCoords.z;
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);  
     float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
     return shadow;
 }
 
+// Point lights own one view per cube face, in +X -X +Y -Y +Z -Z order.
+int CubeFace(vec3 v)
+{
+    vec3 a = abs(v);
+    if (a.x >= a.y && a.x >= a.z) return v.x > 0.0 ? 0 : 1;
+    if (a.y >= a.z) return v.y > 0.0 ? 2 : 3;
+    return v.z > 0.0 ? 4 : 5;
+}
+
+float PointShadows(int firstView, vec3 lightPos, float range, vec3 normal, vec3 lightDir)
+{
+    vec3 toFrag = fragPosition - lightPos;
+    int view = firstView + CubeFace(toFrag);
+    vec4 lightSpace = matLight[view] * vec4(fragPosition, 1.0);
+    vec3 projCoords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+
+    // Compare distances along the face axis, perspective depth is too uneven for a constant bias.
+    float closestDepth = ShadowDepth(view, projCoords.xy) * 2.0 - 1.0;
+    float closestDist = 2.0 * POINT_SHADOW_NEAR * range / (range + POINT_SHADOW_NEAR - closestDepth * (range - POINT_SHADOW_NEAR));
+    float dist = max(abs(toFrag.x), max(abs(toFrag.y), abs(toFrag.z)));
+    float bias = max(0.1 * (1.0 - dot(normal, lightDir)), 0.02);
+    return dist - bias > closestDist ? 1.0 : 0.0;
+}
+
+// Directional lights own one view per cascade, picks the one covering the fragment or -1 past the last.
+int CascadeView(int firstView, float viewDepth)
+{
+    for (int i = 0; i < lightCount.z; i++) {
+        if (viewDepth <= cascadeSplits[i]) return firstView + i;
+    }
+    return -1;
+}
+
+uint ClusterIndex(vec4 viewSpace)
+{
+    vec4 clip = matProj * viewSpace;
+    vec2 ndc = clip.xy / clip.w;
+    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(clusterGrid.xy)), ivec2(0), clusterGrid.xy - 1);
+    int slice = clamp(int(floor(log(-viewSpace.z) * clusterParams.x + clusterParams.y)), 0, clusterGrid.z - 1);
+    return uint((slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x);
+}
+
+vec3 ComputeLight(int index, vec3 N, vec3 V, vec3 albedo, vec3 baseRefl, float metallic, float roughness, float viewDepth)
+{
+    vec4 position = texelFetch(lightData, index * 3);      // w: type 0 = POINT | 1 = DIRECTIONAL
+    vec4 direction = texelFetch(lightData, index * 3 + 1); // w: shadowmap layer, -1 if none
+    vec4 color = texelFetch(lightData, index * 3 + 2);     // rgb: color * intensity, w: range
+
+    vec3 L, H, radiance;
+    float dist;
+    int type = int(position.w);
+    if (type == LIGHT_POINT) { // POINT
+        L = normalize(position.xyz - fragPosition);      // Compute light vector
+        H = normalize(V + L);                             // Compute halfway bisecting vector
+        dist = length(position.xyz - fragPosition);       // Compute distance to light
+        float attenuation = 1.0 / (dist * dist * 0.23);   // Compute attenuation
+        float window = clamp(1.0 - pow(dist / color.w, 4.0), 0.0, 1.0); // Fade to zero at the range used for clustering
+        radiance = color.rgb * attenuation * window * window; // Compute input radiance, light energy comming in
+    }
+    else { // DIRECTIONAL
+        L = -direction.xyz;
+        H = normalize(V + L);                             // Compute halfway bisecting vector
+        radiance = color.rgb;                             // Compute input radiance, light energy comming in
+    }
+
+    // Cook-Torrance BRDF distribution function
+    float nDotV = max(dot(N,V), 0.0000001);
+    float nDotL = max(dot(N,L), 0.0000001);
+    float hDotV = max(dot(H,V), 0.0);
+    float nDotH = max(dot(N,H), 0.0);
+    float D = GgxDistribution(nDotH, roughness);    // Larger the more micro-facets aligned to H
+    float G = GeomSmith(nDotV, nDotL, roughness);   // Smaller the more micro-facets shadow
+    vec3 F = SchlickFresnel(hDotV, baseRefl);       // Fresnel proportion of specular reflectance
+
+    vec3 spec = (D*G*F)/(4.0*nDotV*nDotL);
+    
+    // Difuse and spec light can't be above 1.0
+    // kD = 1.0 - kS  diffuse component is equal 1.0 - spec comonent
+    vec3 kD = vec3(1.0) - F;
+    
+    // Mult kD by the inverse of metallnes, only non-metals should have diffuse light
+    kD *= 1.0 - metallic;
+
+    int view = int(direction.w);
+    float shadow = 0.0;
+    if (type == LIGHT_POINT) {
+        if (view >= 0) shadow = PointShadows(view, position.xyz, color.w, N, L);
+    }
+    else {
+        if (view >= 0 && lightCount.z > 0) view = CascadeView(view, viewDepth);
+        if (view >= 0) shadow = Shadows(view, N, L);
+    }
+    radiance = radiance + (1.0 - shadow);
+    return (kD*albedo.rgb/PI + spec)*radiance*nDotL; // Angle of light has impact on result
+}
+
 vec3 ComputePBR()
 {
     vec3 albedo = texture(albedoMap,vec2(fragTexCoord.x*tiling.x + offset.x, fragTexCoord.y*tiling.y + offset.y)).rgb;
@@ -119,7 +233,7 @@ vec3 ComputePBR()
         N = normalize(N*TBN);
     }
 
-    vec3 V = normalize(viewPos - fragPosition);
+    vec3 V = normalize(viewPos.xyz - fragPosition);
 
     vec3 emissive = vec3(0);
     emissive = (texture(emissiveMap, vec2(fragTexCoord.x*tiling.x+offset.x, fragTexCoord.y*tiling.y+offset.y)).rgb).g * emissiveColor.rgb*emissiveColor.a * useTexEmissive;
@@ -132,47 +246,24 @@ vec3 ComputePBR()
     vec3 lightAccum = vec3(0.0);  // Acumulate lighting lum
     albedo = mix(albedo.rgb, skybox.rgb, metallic);
 
-    for (int i = 0; i < numOfLights; i++)
+    vec4 viewSpace = matView * vec4(fragPosition, 1.0);
+    float viewDepth = -viewSpace.z;
+
+    // Directional lights reach every fragment, point lights come from the cluster the fragment falls in.
+    for (int i = 0; i < lightCount.x; i++)
+    {
+        lightAccum += ComputeLight(i, N, V, albedo, baseRefl, metallic, roughness, viewDepth);
+    }
+
+    uint cell = ClusterIndex(viewSpace);
+    uvec2 cluster = texelFetch(clusterCells, int(cell)).xy;
+    for (uint i = 0u; i < cluster.y; i++)
     {
-        vec3 L, H, radiance;
-        float dist;
-        if (lights[i].type == LIGHT_POINT) { // POINT
-			L = normalize(lights[i].position - fragPosition);      // Compute light vector
-			H = normalize(V + L);                                  // Compute halfway bisecting vector
-			dist = length(lights[i].position - fragPosition);     // Compute distance to light
-			float attenuation = 1.0 / (dist * dist * 0.23);                   // Compute attenuation
-			radiance = lights[i].color * lights[i].intensity * attenuation; // Compute input radiance, light energy comming in
-        }
-        else if (lights[i].type == LIGHT_DIRECTIONAL) { // DIRECTIONAL
-            L = -lights[i].direction;
-			H = normalize(V + L);                                  // Compute halfway bisecting vector
-			radiance = lights[i].color * lights[i].intensity; // Compute input radiance, light energy comming in
-        }
-
-        // Cook-Torrance BRDF distribution function
-        float nDotV = max(dot(N,V), 0.0000001);
-        float nDotL = max(dot(N,L), 0.0000001);
-        float hDotV = max(dot(H,V), 0.0);
-        float nDotH = max(dot(N,H), 0.0);
-        float D = GgxDistribution(nDotH, roughness);    // Larger the more micro-facets aligned to H
-        float G = GeomSmith(nDotV, nDotL, roughness);   // Smaller the more micro-facets shadow
-        vec3 F = SchlickFresnel(hDotV, baseRefl);       // Fresnel proportion of specular reflectance
-
-        vec3 spec = (D*G*F)/(4.0*nDotV*nDotL);
-        
-        // Difuse and spec light can't be above 1.0
-        // kD = 1.0 - kS  diffuse component is equal 1.0 - spec comonent
-        vec3 kD = vec3(1.0) - F;
-        
-        // Mult kD by the inverse of metallnes, only non-metals should have diffuse light
-        kD *= 1.0 - metallic;
-
-        float shadow = Shadows(fragLightSpace[i], i, N, L);
-        radiance = radiance + (1.0 - shadow);
-        lightAccum += ((kD*albedo.rgb/PI + spec)*radiance*nDotL)*lights[i].enabled; // Angle of light has impact on result
+        int light = lightCount.x + int(texelFetch(clusterIndices, int(cluster.x + i)).r);
+        lightAccum += ComputeLight(light, N, V, albedo, baseRefl, metallic, roughness, viewDepth);
     }
     
-    vec3 ambientFinal = (ambientColor + albedo) * ambient * 0.5;
+    vec3 ambientFinal = (ambient.rgb + albedo) * ambient.w * 0.5;
     
     return ambientFinal + lightAccum * ao + emissive;
 }
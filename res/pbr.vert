@@ -1,44 +1,75 @@
 #version 330
 
-#define MAX_SHADOW_MAPS 24
+#define MAX_SHADOWS 16
 
-// Input vertex attributes
+// Per frame data, shared by every material. Matches GPUFrameData.
+layout (std140) uniform FrameData {
+    mat4 matView;
+    mat4 matProj;
+    vec4 viewPos;
+    vec4 ambient;
+    ivec4 lightCount;
+    ivec4 clusterGrid;
+    vec4 clusterParams;
+    vec4 cascadeSplits;
+    mat4 matLight[MAX_SHADOWS];
+    vec4 shadowTiles[MAX_SHADOWS];
+};
+
+// Input vertex attributes, see VertexLayout
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aTangent;
+layout (location = 1) in vec3 aNormal;  // xy only when octahedral encoded
+layout (location = 2) in vec3 aTangent; // xy only when octahedral encoded
 layout (location = 3) in vec3 aColor;
 layout (location = 4) in vec2 aCoords;
 
+// Per instance attributes, see GPUGeometryBuffer::bind_instances
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in mat3 aNormalMatrix;
+
 // Input uniform values
-uniform mat4 mvp;
-uniform mat4 matModel;
-uniform mat4 matNormal;
-uniform mat4 matLight[MAX_SHADOW_MAPS];
+uniform mat4 matViewProj;
+uniform bool octNormals;
+uniform bool octTangents;
 
 // Output vertex attributes (to fragment shader)
 out vec3 fragPosition;
 out vec2 fragTexCoord;
 out vec3 fragColor;
 out vec3 fragNormal;
-out vec4 fragLightSpace[MAX_SHADOW_MAPS];
 out mat3 TBN;
 
+// Must match depth.vert, the depth pre-pass relies on both producing the same depths.
+invariant gl_Position;
+
 const float normalOffset = 0.1;
 
+vec3 OctDecode(vec2 oct)
+{
+    vec3 dir = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (dir.z < 0.0) dir.xy = (1.0 - abs(dir.yx)) * vec2(dir.x >= 0.0 ? 1.0 : -1.0, dir.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(dir);
+}
+
 void main()
 {
+    vec3 normal = octNormals ? OctDecode(aNormal.xy) : aNormal;
+    vec3 tangent = octTangents ? OctDecode(aTangent.xy) : aTangent;
+
     // Compute binormal from vertex normal and tangent
-    vec3 vertexBinormal = cross(aNormal, aTangent);
+    vec3 vertexBinormal = cross(normal, tangent);
+    mat4 matModel = aModel;
     
-    // Compute fragment normal based on normal transformations
-    mat3 normalMatrix = transpose(inverse(mat3(matModel)));
+    // Inverse transpose of the model basis, computed on the CPU
+    mat3 normalMatrix = aNormalMatrix;
     
     // Compute fragment position based on model transformations
-    fragPosition = vec3(matModel*vec4(aPos, 1.0f));
+    vec4 worldPosition = matModel*vec4(aPos, 1.0);
+    fragPosition = worldPosition.xyz;
 
     fragTexCoord = aCoords;
-    fragNormal = normalize(normalMatrix*aNormal);
-    vec3 fragTangent = normalize(normalMatrix*aTangent);
+    fragNormal = normalize(normalMatrix*normal);
+    vec3 fragTangent = normalize(normalMatrix*tangent);
     fragTangent = normalize(fragTangent - dot(fragTangent, fragNormal)*fragNormal);
     vec3 fragBinormal = normalize(normalMatrix*vertexBinormal);
     fragBinormal = cross(fragNormal, fragTangent);
@@ -47,10 +78,6 @@ void main()
 
     fragColor = aColor;
 
-    for (int i = 0; i < MAX_SHADOW_MAPS; i++) {
-       fragLightSpace[i] = matLight[i] * vec4(fragPosition, 1.0);
-    }
-
     // Calculate final vertex position
-    gl_Position = mvp*vec4(aPos, 1.0);
+    gl_Position = matViewProj*worldPosition;
 }
\ No newline at end of file
@@ -1,13 +1,27 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#define MAX_SHADOWS 16
+
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per frame data, shared by every material. Matches GPUFrameData.
+layout (std140) uniform FrameData {
+    mat4 matView;
+    mat4 matProj;
+    vec4 viewPos;
+    vec4 ambient;
+    ivec4 lightCount;
+    ivec4 clusterGrid;
+    vec4 clusterParams;
+    vec4 cascadeSplits;
+    mat4 matLight[MAX_SHADOWS];
+    vec4 shadowTiles[MAX_SHADOWS];
+};
 
 void main()
 {
     TexCoords = aPos;
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    // Drop the translation so the skybox stays centered on the camera.
+    gl_Position = matProj * mat4(mat3(matView)) * vec4(aPos, 1.0);
 }  
\ No newline at end of file
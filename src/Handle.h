@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+/// @brief Typed 32 bit reference to an object owned by a MemPool. Packs the slot index and the generation the slot
+/// had when the object was created, so lookups after the object is destroyed are detected instead of dereferencing
+/// freed memory. A default constructed handle is null and never valid.
+template <typename T>
+class Handle {
+	uint32_t raw = 0;
+
+public:
+	static constexpr uint32_t INDEX_BITS = 20;
+	static constexpr uint32_t GENERATION_BITS = 32 - INDEX_BITS;
+	static constexpr uint32_t MAX_INDEX = (1u << INDEX_BITS) - 1;
+	static constexpr uint32_t MAX_GENERATION = (1u << GENERATION_BITS) - 1;
+
+	Handle() = default;
+	/// @brief The index must fit in INDEX_BITS, MemPool aborts before handing out a bigger one.
+	Handle(uint32_t index, uint32_t generation) : raw((generation << INDEX_BITS) | (index & MAX_INDEX)) {}
+	static Handle from_raw(uint32_t raw) { Handle h; h.raw = raw; return h; }
+
+	uint32_t get_index() const { return raw & MAX_INDEX; }
+	uint32_t get_generation() const { return raw >> INDEX_BITS; }
+	uint32_t get_raw() const { return raw; }
+
+	/// @brief Generation 0 is never handed out by a pool, so it marks the null handle.
+	bool is_null() const { return get_generation() == 0; }
+
+	bool operator ==(const Handle& other) const { return raw == other.raw; }
+	bool operator !=(const Handle& other) const { return raw != other.raw; }
+};
+
+template <typename T>
+struct std::hash<Handle<T>> {
+	size_t operator()(const Handle<T>& h) const { return std::hash<uint32_t>()(h.get_raw()); }
+};
@@ -1,41 +1,371 @@
 #pragma once
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <type_traits>
+#include <iterator>
+#include <bit>
+#include <cstdlib>
+#include "Handle.h"
+#include "logging.h"
 
-
+/// @brief Opts T into MemPool::compact(). Only specialize it for types that stay correct when moved to another
+/// address and that nothing outside the pool points to by raw pointer across frames.
 template <typename T>
+struct is_pool_relocatable : std::false_type {};
+
+/// @brief Chunked slab allocator. Objects live in fixed size slots grouped in chunks, free slots are linked through
+/// an intrusive free list and each chunk keeps a bitmask of its live slots, which iteration walks in address order
+/// without touching dead slots or an extra pointer array.
+/// Objects can be referenced either by pointer or by a generational Handle<T>. Handles index an id table that points
+/// at the slot, so they survive compact() moving objects around while raw pointers do not. Addresses only change
+/// in compact(), which relocatable types have to opt into.
+/// @tparam T Base type handed out by the pool.
+/// @tparam SlotSize Bytes reserved per slot, 0 means sizeof(T). Must be big enough for every type created with create<G>().
+/// @tparam ChunkSlots Number of slots allocated at once when the pool runs out of free slots, at most 64.
+template <typename T, size_t SlotSize = 0, size_t ChunkSlots = 64>
 class MemPool {
-	std::vector<T*> items = std::vector<T*>();
+	static_assert(ChunkSlots > 0 && ChunkSlots <= 64, "ChunkSlots must fit in the chunk live mask");
 
-public:
-	T* create() {
-		T* item = new T();
-		items.push_back(item);
-		return item;
+	static constexpr uint32_t NO_SLOT = UINT32_MAX;
+	static constexpr bool RELOCATABLE = is_pool_relocatable<T>::value;
+
+	// Evaluated lazily so pools can be declared while T is still incomplete.
+	static constexpr size_t slot_size() {
+		size_t size = SlotSize > sizeof(T) ? SlotSize : sizeof(T);
+		return size > sizeof(uint32_t) ? size : sizeof(uint32_t);
+	}
+
+	struct Slot {
+		// Holds the object while alive and the index of the next free slot while dead.
+		alignas(std::max_align_t) std::byte storage[slot_size()];
+		uint32_t index;
+	};
+
+	struct Chunk {
+		std::unique_ptr<Slot[]> slots;
+		uint64_t live = 0;
+	};
+
+	// Handles index this table, it only grows so stale handles stay invalid after trim().
+	struct Id {
+		uint32_t generation = 1;
+		uint32_t slot = NO_SLOT;
+	};
+
+	std::vector<Chunk> chunks;
+	uint32_t free_head = NO_SLOT;
+	size_t count = 0;
+
+	std::vector<Id> ids;
+	std::vector<uint32_t> free_ids;
+
+	// Per slot data, indexed by slot index.
+	std::vector<uint32_t> slot_ids;
+	std::vector<void (*)(void*)> destructors;
+	std::vector<void (*)(void*, void*)> relocators;
+
+	Slot& slot_at(uint32_t index) const { return chunks[index / ChunkSlots].slots[index % ChunkSlots]; }
+
+	static uint64_t bit_of(uint32_t index) { return uint64_t(1) << (index % ChunkSlots); }
+
+	bool is_live(uint32_t index) const {
+		return index < capacity() && (chunks[index / ChunkSlots].live & bit_of(index)) != 0;
+	}
+
+	T* item_at(uint32_t index) const { return std::launder(reinterpret_cast<T*>(slot_at(index).storage)); }
+
+	uint32_t next_free(uint32_t index) {
+		uint32_t next;
+		std::memcpy(&next, slot_at(index).storage, sizeof(uint32_t));
+		return next;
+	}
+
+	void set_next_free(uint32_t index, uint32_t next) {
+		std::memcpy(slot_at(index).storage, &next, sizeof(uint32_t));
+	}
+
+	void grow() {
+		uint32_t first = (uint32_t)(chunks.size() * ChunkSlots);
+
+		chunks.push_back(Chunk{ std::make_unique<Slot[]>(ChunkSlots) });
+		slot_ids.resize(first + ChunkSlots, NO_SLOT);
+		destructors.resize(first + ChunkSlots, nullptr);
+		if constexpr (RELOCATABLE) relocators.resize(first + ChunkSlots, nullptr);
+
+		// Only runs once the free list is empty, so linking the new slots is enough and filling the pool stays linear.
+		for (uint32_t i = first + ChunkSlots; i > first; i--) {
+			slot_at(i - 1).index = i - 1;
+			set_next_free(i - 1, free_head);
+			free_head = i - 1;
+		}
+	}
+
+	/// Links every dead slot, lowest address first, so new objects fill the front of the pool. Only trim() and
+	/// compact() need it, they leave holes anywhere in the pool.
+	void rebuild_free_list() {
+		free_head = NO_SLOT;
+		for (uint32_t i = (uint32_t)capacity(); i > 0; i--) {
+			if (is_live(i - 1)) continue;
+			set_next_free(i - 1, free_head);
+			free_head = i - 1;
+		}
+	}
+
+	uint32_t acquire_id(uint32_t slot) {
+		uint32_t id;
+		if (!free_ids.empty()) {
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		else {
+			id = (uint32_t)ids.size();
+			// Handles only hold INDEX_BITS of the id, a wrapped id would resolve to another live object.
+			if (id > Handle<T>::MAX_INDEX) {
+				Console::log_critical("MemPool exceeded the handle index range of {} objects", Handle<T>::MAX_INDEX + 1);
+				std::cout.flush();
+				std::abort();
+			}
+			ids.push_back(Id());
+		}
+		ids[id].slot = slot;
+		slot_ids[slot] = id;
+		return id;
+	}
+
+	uint32_t acquire() {
+		if (free_head == NO_SLOT) grow();
+		uint32_t index = free_head;
+		free_head = next_free(index);
+		return index;
+	}
+
+	void release(uint32_t index) {
+		destructors[index] = nullptr;
+		if constexpr (RELOCATABLE) relocators[index] = nullptr;
+		chunks[index / ChunkSlots].live &= ~bit_of(index);
+		count--;
+
+		auto& id = ids[slot_ids[index]];
+		id.slot = NO_SLOT;
+		id.generation = id.generation + 1 > Handle<T>::MAX_GENERATION ? 1 : id.generation + 1;
+		free_ids.push_back(slot_ids[index]);
+		slot_ids[index] = NO_SLOT;
+
+		set_next_free(index, free_head);
+		free_head = index;
+	}
+
+	/// Moves the object in slot from into the free slot to, its id follows it so handles keep resolving.
+	void relocate(uint32_t from, uint32_t to) {
+		relocators[from](slot_at(to).storage, slot_at(from).storage);
+		destructors[to] = destructors[from];
+		relocators[to] = relocators[from];
+		destructors[from] = nullptr;
+		relocators[from] = nullptr;
+
+		slot_ids[to] = slot_ids[from];
+		slot_ids[from] = NO_SLOT;
+		ids[slot_ids[to]].slot = to;
+
+		chunks[to / ChunkSlots].live |= bit_of(to);
+		chunks[from / ChunkSlots].live &= ~bit_of(from);
 	}
 
 	template <typename G>
-	G* create() {
-		G* item = new G();
-		items.push_back((T*)item);
+	G* construct() {
+		static_assert(std::is_base_of<T, G>() || std::is_same<T, G>(), "G must derive from the pool type");
+		static_assert(sizeof(G) <= slot_size(), "G does not fit in a pool slot, increase the pool SlotSize");
+		static_assert(alignof(G) <= alignof(std::max_align_t), "G is over aligned for a pool slot");
+
+		uint32_t index = acquire();
+		G* item = nullptr;
+		try {
+			item = new (slot_at(index).storage) G();
+		}
+		catch (...) {
+			set_next_free(index, free_head);
+			free_head = index;
+			throw;
+		}
+		// destroy() and iteration recover the base pointer from the slot, so both must share the address.
+		assert((void*)static_cast<T*>(item) == (void*)item);
+		destructors[index] = [](void* p) { static_cast<G*>(p)->~G(); };
+		if constexpr (RELOCATABLE) {
+			static_assert(std::is_move_constructible<G>(), "Relocatable pool types must be move constructible");
+			relocators[index] = [](void* to, void* from) {
+				auto item = static_cast<G*>(from);
+				new (to) G(std::move(*item));
+				item->~G();
+			};
+		}
+		chunks[index / ChunkSlots].live |= bit_of(index);
+		acquire_id(index);
+		count++;
 		return item;
 	}
 
+	void destroy_at(uint32_t index) {
+		destructors[index](slot_at(index).storage);
+		release(index);
+	}
+
+	static uint32_t slot_of(const T* item) {
+		auto slot = reinterpret_cast<const Slot*>(reinterpret_cast<const std::byte*>(item) - offsetof(Slot, storage));
+		return slot->index;
+	}
+
+public:
+	/// @brief Walks the live slots chunk by chunk. Each chunk's mask is copied when the iterator enters it, so the
+	/// current item can be destroyed while iterating. Items created during iteration may or may not be visited.
+	class Iterator {
+		const MemPool* pool;
+		size_t chunk;
+		uint64_t remaining;
+		Slot* slots;
+
+		void settle() {
+			while (remaining == 0 && chunk < pool->chunks.size()) {
+				chunk++;
+				remaining = chunk < pool->chunks.size() ? pool->chunks[chunk].live : 0;
+			}
+			slots = remaining != 0 ? pool->chunks[chunk].slots.get() : nullptr;
+		}
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T*;
+		using difference_type = std::ptrdiff_t;
+		using pointer = T**;
+		using reference = T*;
+
+		Iterator() : pool(nullptr), chunk(0), remaining(0), slots(nullptr) {}
+		Iterator(const MemPool* pool, size_t chunk) : pool(pool), chunk(chunk) {
+			remaining = chunk < pool->chunks.size() ? pool->chunks[chunk].live : 0;
+			settle();
+		}
+
+		T* operator*() const {
+			return std::launder(reinterpret_cast<T*>(slots[std::countr_zero(remaining)].storage));
+		}
+
+		Iterator& operator++() {
+			remaining &= remaining - 1;
+			if (remaining == 0) settle();
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator prev = *this;
+			++*this;
+			return prev;
+		}
+
+		bool operator==(const Iterator& other) const { return chunk == other.chunk && remaining == other.remaining; }
+	};
+
+	MemPool() = default;
+	MemPool(const MemPool&) = delete;
+	MemPool& operator=(const MemPool&) = delete;
+	~MemPool() { clear(); }
+
+	T* create() { return construct<T>(); }
+
+	template <typename G>
+	G* create() { return construct<G>(); }
+
+	/// @brief Destroys the item and returns its slot to the free list. The item must have been created by this pool,
+	/// destroying it twice is ignored.
 	void destroy(T* item) {
-		auto it = std::remove(items.begin(), items.end(), item);
-		if (it != items.end()) {
-			delete item;
-			items.erase(it, items.end());
+		if (item == nullptr) return;
+		uint32_t index = slot_of(item);
+		if (!is_live(index) || item_at(index) != item) return;
+		destroy_at(index);
+	}
+
+	void destroy(Handle<T> handle) {
+		if (!is_valid(handle)) return;
+		destroy_at(ids[handle.get_index()].slot);
+	}
+
+	void clear() {
+		for (uint32_t c = 0; c < chunks.size(); c++) {
+			uint64_t live = chunks[c].live;
+			for (; live != 0; live &= live - 1) destroy_at((uint32_t)(c * ChunkSlots + std::countr_zero(live)));
 		}
 	}
 
-	size_t size() const { return items.size(); }
-	inline T* operator[](int idx) { return items[idx]; }
+	/// @brief Frees trailing chunks that have no live objects.
+	void trim() {
+		size_t keep = chunks.size();
+		while (keep > 0 && chunks[keep - 1].live == 0) keep--;
+		if (keep == chunks.size()) return;
+
+		uint32_t limit = (uint32_t)(keep * ChunkSlots);
+		chunks.resize(keep);
+		slot_ids.resize(limit);
+		destructors.resize(limit);
+		if constexpr (RELOCATABLE) relocators.resize(limit);
+		rebuild_free_list();
+	}
+
+	/// @brief Moves the objects in the highest slots into the lowest free ones and frees the chunks left empty, so
+	/// iteration touches as few chunks as possible. Handles stay valid, raw pointers to moved objects do not.
+	/// @return Number of objects moved.
+	size_t compact() requires RELOCATABLE {
+		size_t moved = 0;
+		uint32_t low = 0;
+		uint32_t high = (uint32_t)capacity();
+		while (true) {
+			while (low < high && is_live(low)) low++;
+			while (high > low && !is_live(high - 1)) high--;
+			if (low >= high) break;
+			relocate(high - 1, low);
+			moved++;
+		}
+		if (moved > 0) rebuild_free_list();
+		trim();
+		return moved;
+	}
+
+	/// @brief Fraction of the allocated slots holding a live object.
+	float get_occupancy() const { return capacity() == 0 ? 1.0f : (float)count / capacity(); }
+
+	Handle<T> get_handle(const T* item) const {
+		if (item == nullptr) return Handle<T>();
+		uint32_t index = slot_of(item);
+		if (!is_live(index)) return Handle<T>();
+		uint32_t id = slot_ids[index];
+		return Handle<T>(id, ids[id].generation);
+	}
+
+	bool is_valid(Handle<T> handle) const {
+		uint32_t id = handle.get_index();
+		return !handle.is_null()
+			&& id < ids.size()
+			&& ids[id].slot != NO_SLOT
+			&& ids[id].generation == handle.get_generation();
+	}
+
+	/// @brief O(1) lookup. Returns nullptr if the handle is null or its object was destroyed.
+	T* get(Handle<T> handle) const {
+		if (!is_valid(handle)) return nullptr;
+		return item_at(ids[handle.get_index()].slot);
+	}
+
+	template <typename G>
+	G* get(Handle<T> handle) const { return static_cast<G*>(get(handle)); }
+
+	size_t size() const { return count; }
+	size_t capacity() const { return chunks.size() * ChunkSlots; }
 
-	typedef typename std::vector<T*>::iterator iter;
-	typedef typename std::vector<T*>::const_iterator citer;
-	iter begin() { return items.begin(); }
-	citer begin() const { return items.begin(); }
-	iter end() { return items.end(); }
-	citer end() const { return items.end(); }
+	typedef Iterator iter;
+	typedef Iterator citer;
+	iter begin() const { return Iterator(this, 0); }
+	iter end() const { return Iterator(this, chunks.size()); }
 };
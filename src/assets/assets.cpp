@@ -1,6 +1,9 @@
 #include "assets.h"
+#include <chrono>
+#include <thread>
 
 #include "../core.h"
+#include "../logging.h"
 
 AssetId::AssetId(std::string id) {
 	this->id = id;
@@ -8,7 +11,215 @@ AssetId::AssetId(std::string id) {
 	hashed_id = hasher(id);
 }
 
+void* acquire_asset_ref(std::type_index type, RefType ref_type, const AssetId& id) {
+	auto assets = App::get_asset_backend();
+	if (ref_type == RefType::Id) return assets->retain(type, id);
+
+	auto asset = assets->acquire(type, id.get_id().c_str());
+	if (!asset) {
+		Console::log_error("Failed resolving asset reference {}: {}", id.get_id(), asset.error().error);
+		return nullptr;
+	}
+	return asset.value();
+}
+
+void release_asset_ref(std::type_index type, const AssetId& id) {
+	App::get_asset_backend()->release(type, id);
+}
+
 void AssetBackend::set_asset_folder(std::string path) {
 	asset_path = path;
 }
 
+BaseFileImport* AssetBackend::get_importer(std::type_index type, const char* path) {
+	auto it = importers.find(type);
+	if (it == importers.end()) {
+		fprintf(stderr, "ERROR: No importer registered for file: %s\n", path);
+		return nullptr;
+	}
+	return it->second;
+}
+
+AssetEntry* AssetBackend::find_entry(std::type_index type, const AssetId& id) {
+	auto it = assets.find(AssetKey{ type, id.get_hash() });
+	return it != assets.end() ? &it->second : nullptr;
+}
+
+void AssetBackend::add_ref(AssetEntry& entry) {
+	if (entry.refs == 0 && entry.asset) unused.erase(entry.unused);
+	entry.refs++;
+}
+
+void* AssetBackend::retain(std::type_index type, const AssetId& id) {
+	auto entry = find_entry(type, id);
+	if (!entry || !entry->asset) return nullptr;
+	add_ref(*entry);
+	return entry->asset;
+}
+
+void AssetBackend::release(std::type_index type, const AssetId& id) {
+	AssetKey key = { type, id.get_hash() };
+	auto it = assets.find(key);
+	if (it == assets.end() || it->second.refs == 0) return;
+
+	auto& entry = it->second;
+	entry.refs--;
+	if (entry.refs > 0 || !entry.asset) return;
+	entry.unused = unused.insert(unused.end(), key);
+	trim();
+}
+
+void AssetBackend::trim() {
+	while (memory_usage.exceeds(memory_budget) && !unused.empty()) {
+		auto it = assets.find(unused.front());
+		unused.pop_front();
+
+		auto& entry = it->second;
+		Console::log_verbose("Evicting asset {} ({} GPU bytes)", entry.id.get_id(), entry.memory.gpu);
+		entry.importer->raw_unload(entry.asset);
+		memory_usage -= entry.memory;
+		assets.erase(it);
+	}
+}
+
+Result<void*, ImportError> AssetBackend::acquire(std::type_index type, const char* path) {
+	auto importer = get_importer(type, path);
+	if (!importer) return Error(ImportError{ std::format("No importer registered for file: {}", path) });
+
+	AssetId id = AssetId(path);
+	if (auto entry = find_entry(type, id)) {
+		// Loading in the background, finish it now instead of loading the file a second time.
+		if (!entry->asset) {
+			auto load = entry->load;
+			finish_load_now(load);
+			if (load->status.load(std::memory_order_acquire) == LoadStatus::Failed) return Error(load->error);
+			entry = find_entry(type, id);
+		}
+		add_ref(*entry);
+		return entry->asset;
+	}
+
+	auto asset = importer->raw_load_file((asset_path + path).c_str());
+	if (!asset) return Error(asset.error());
+
+	auto& entry = assets[AssetKey{ type, id.get_hash() }];
+	entry.id = id;
+	entry.importer = importer;
+	entry.asset = asset.value();
+	entry.refs = 1;
+	entry.memory = importer->raw_get_memory(entry.asset);
+	memory_usage += entry.memory;
+	trim();
+	return entry.asset;
+}
+
+std::shared_ptr<AssetLoad> AssetBackend::acquire_async(std::type_index type, const char* path) {
+	auto importer = get_importer(type, path);
+	if (!importer) return nullptr;
+
+	AssetId id = AssetId(path);
+	if (auto entry = find_entry(type, id)) {
+		add_ref(*entry);
+		if (entry->load) return entry->load;
+
+		auto load = std::make_shared<AssetLoad>();
+		load->key = AssetKey{ type, id.get_hash() };
+		load->path = asset_path + path;
+		load->importer = importer;
+		load->asset = entry->asset;
+		load->status.store(LoadStatus::Loaded, std::memory_order_release);
+		return load;
+	}
+
+	AssetKey key = { type, id.get_hash() };
+	auto& entry = assets[key];
+	entry.id = id;
+	entry.importer = importer;
+	entry.refs = 1;
+	entry.load = start_load(key, importer, path);
+	return entry.load;
+}
+
+std::shared_ptr<AssetLoad> AssetBackend::start_load(AssetKey key, BaseFileImport* importer, const char* path) {
+	auto load = std::make_shared<AssetLoad>();
+	load->key = key;
+	load->path = asset_path + path;
+	load->importer = importer;
+	pending_loads++;
+
+	workers.submit([this, load] {
+		auto payload = load->importer->decode_file(load->path.c_str());
+		if (payload) load->payload = std::move(payload.value());
+		else load->error = payload.error();
+
+		// Failures also go through the queue so the registry is only touched on the main thread. The status changes
+		// under the lock so finish_load_now never sees a decoded load that is not queued yet.
+		std::lock_guard lock(uploads_mutex);
+		load->status.store(LoadStatus::Uploading, std::memory_order_release);
+		uploads.push_back(load);
+	});
+	return load;
+}
+
+void AssetBackend::finish_load(std::shared_ptr<AssetLoad> load) {
+	pending_loads--;
+	void* asset = nullptr;
+	if (load->payload) {
+		auto result = load->importer->raw_upload(load->payload.get());
+		load->payload.reset();
+		if (result) asset = result.value();
+		else load->error = result.error();
+	}
+
+	// Entries are never evicted while loading, only a failure removes them.
+	auto it = assets.find(load->key);
+	if (!asset) {
+		Console::log_error("Failed loading asset at {}: {}", load->path, load->error.error);
+		assets.erase(it);
+		load->status.store(LoadStatus::Failed, std::memory_order_release);
+		return;
+	}
+
+	auto& entry = it->second;
+	entry.asset = asset;
+	entry.load.reset();
+	entry.memory = load->importer->raw_get_memory(asset);
+	memory_usage += entry.memory;
+	if (entry.refs == 0) entry.unused = unused.insert(unused.end(), load->key);
+
+	load->asset = asset;
+	load->status.store(LoadStatus::Loaded, std::memory_order_release);
+}
+
+void AssetBackend::finish_load_now(std::shared_ptr<AssetLoad> load) {
+	while (true) {
+		{
+			std::lock_guard lock(uploads_mutex);
+			if (load->status.load(std::memory_order_acquire) != LoadStatus::Decoding) {
+				uploads.erase(std::find(uploads.begin(), uploads.end(), load));
+				break;
+			}
+		}
+		std::this_thread::yield();
+	}
+	finish_load(load);
+	trim();
+}
+
+void AssetBackend::process_uploads() {
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		std::shared_ptr<AssetLoad> load;
+		{
+			std::lock_guard lock(uploads_mutex);
+			if (uploads.empty()) break;
+			load = uploads.front();
+			uploads.pop_front();
+		}
+		finish_load(load);
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= upload_budget_ms) break;
+	}
+	trim();
+}
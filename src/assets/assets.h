@@ -3,80 +3,221 @@
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <list>
 #include "../rendering/renderer.h"
 #include <typeindex>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <atomic>
 #include "../core.h"
+#include "../thread_pool.h"
 #include "import.h"
 
 class App;
 
 class AssetId {
 	std::string id;
-	size_t hashed_id;
+	size_t hashed_id = 0;
 public:
+	AssetId() = default;
 	AssetId(std::string id);
-	const std::string get_id() { return id; }
-	const size_t get_hash() { return hashed_id; }
+	const std::string& get_id() const { return id; }
+	size_t get_hash() const { return hashed_id; }
 
-	bool operator ==(AssetId* id) const { return id->hashed_id == hashed_id; }
+	bool operator ==(const AssetId& other) const { return other.hashed_id == hashed_id && other.id == id; }
 };
 
-class Asset {
-	AssetId id;
-	std::string path;
+/// @brief Identifies an asset in the registry. The same file imported as two types is two assets.
+struct AssetKey {
+	std::type_index type;
+	size_t hash;
 
-public:
-	void serialize();
-	void deserialize();
+	bool operator ==(const AssetKey&) const = default;
+};
 
-	AssetId get_id() { return id; }
+struct AssetKeyHash {
+	size_t operator()(const AssetKey& key) const { return key.hash ^ (key.type.hash_code() * 0x9E3779B97F4A7C15ull); }
 };
 
 enum RefType {
 	Id,
 	Path,
 };
+
+// Out of line so AssetRef does not need the App definition.
+void* acquire_asset_ref(std::type_index type, RefType ref_type, const AssetId& id);
+void release_asset_ref(std::type_index type, const AssetId& id);
+
+/// @brief Resolves the asset on first access and keeps a reference to it until destroyed. Path references load the
+/// file if needed, id references only find assets something else already loaded.
 template<typename T>
 class AssetRef {
 	AssetId id;
-	std::string path;
 	RefType type;
+	mutable T* asset = nullptr;
+
 public:
 	AssetRef(RefType type, std::string asset);
-	const T* get() const {
-		switch (type) {
-		case Id:
-			return nullptr;
-		case Path:
-			return App::get_asset_backend()->load_file(path);
-		}
+	AssetRef(const AssetRef& other) : id(other.id), type(other.type) {}
+	AssetRef& operator=(const AssetRef& other) {
+		if (this == &other) return *this;
+		reset();
+		id = other.id;
+		type = other.type;
+		return *this;
 	}
+	~AssetRef() { reset(); }
+
+	const T* get() const { return get_mut(); }
 
 	T* get_mut() const {
-		switch (type) {
-		case Id:
-			return nullptr;
-		case Path:
-			return App::get_asset_backend()->load_file(path);
-		}
+		if (!asset) asset = static_cast<T*>(acquire_asset_ref(typeid(T), type, id));
+		return asset;
+	}
+
+	/// @brief Drops the reference, the next access resolves the asset again.
+	void reset() {
+		if (asset) release_asset_ref(typeid(T), id);
+		asset = nullptr;
+	}
+};
+
+enum class LoadStatus {
+	Decoding,
+	Uploading,
+	Loaded,
+	Failed,
+};
+
+/// @brief State of one asynchronous load, shared between the worker decoding it, the upload queue and the futures.
+struct AssetLoad {
+	AssetKey key = AssetKey{ typeid(void), 0 };
+	std::string path;
+	BaseFileImport* importer;
+	// Uploading once decoded, even if decoding failed, the main thread reports the failure.
+	std::atomic<LoadStatus> status = LoadStatus::Decoding;
+	std::unique_ptr<ImportPayload> payload;
+	// Written before the status changes to Loaded or Failed.
+	void* asset = nullptr;
+	ImportError error;
+};
+
+/// @brief Handle to an asset being loaded in the background. Polled by the main thread, uploads happen there anyway.
+template<typename T>
+class AssetFuture {
+	std::shared_ptr<AssetLoad> load;
+
+public:
+	AssetFuture() = default;
+	AssetFuture(std::shared_ptr<AssetLoad> load) : load(load) {}
+
+	bool is_valid() const { return load != nullptr; }
+	LoadStatus get_status() const { return load->status.load(std::memory_order_acquire); }
+	/// @brief True once the asset is loaded or failed to load.
+	bool is_done() const { return get_status() == LoadStatus::Loaded || get_status() == LoadStatus::Failed; }
+	/// @brief Only valid once done.
+	Result<T*, ImportError> get() const {
+		if (get_status() == LoadStatus::Failed) return Error(load->error);
+		return static_cast<T*>(load->asset);
 	}
 };
 
+/// @brief Loaded or loading asset in the registry.
+struct AssetEntry {
+	AssetId id;
+	BaseFileImport* importer;
+	// Null until the load finishes.
+	void* asset = nullptr;
+	std::shared_ptr<AssetLoad> load;
+	uint refs = 0;
+	AssetMemory memory;
+	// Position in the unused list, only valid while refs is zero and the asset is loaded.
+	std::list<AssetKey>::iterator unused;
+};
+
+/// @brief Loads assets once and shares them. Every load adds a reference that release drops, assets without references
+/// stay cached and are evicted least recently released first once the memory budgets are exceeded. Only used from
+/// the main thread, the workers never touch the registry.
 class AssetBackend {
 	std::string asset_path;
 	std::map<std::type_index, BaseFileImport*> importers;
-	std::map<size_t, Asset> assets;
+	std::unordered_map<AssetKey, AssetEntry, AssetKeyHash> assets;
+	std::list<AssetKey> unused;
+	AssetMemory memory_usage;
+
+	std::mutex uploads_mutex;
+	std::deque<std::shared_ptr<AssetLoad>> uploads;
+	uint pending_loads = 0;
+	// Declared last so the workers stop before the queue they push to is destroyed.
+	ThreadPool workers;
+
+	BaseFileImport* get_importer(std::type_index type, const char* path);
+	AssetEntry* find_entry(std::type_index type, const AssetId& id);
+	void add_ref(AssetEntry& entry);
+	std::shared_ptr<AssetLoad> start_load(AssetKey key, BaseFileImport* importer, const char* path);
+	/// @brief Uploads a decoded load and stores the result in its registry entry.
+	void finish_load(std::shared_ptr<AssetLoad> load);
+	/// @brief Waits for the workers to decode the load and uploads it right away.
+	void finish_load_now(std::shared_ptr<AssetLoad> load);
+
+	Result<void*, ImportError> acquire(std::type_index type, const char* path);
+	std::shared_ptr<AssetLoad> acquire_async(std::type_index type, const char* path);
+	friend void* acquire_asset_ref(std::type_index type, RefType ref_type, const AssetId& id);
 
 public:
+	/// @brief Time the main thread may spend creating GPU objects for decoded assets each frame, in milliseconds. At
+	/// least one asset is uploaded every frame so loading always progresses.
+	double upload_budget_ms = 2.0;
+	/// @brief Memory unreferenced assets are evicted to stay under, in bytes.
+	AssetMemory memory_budget = AssetMemory{ .gpu = 1024ull << 20, .cpu = 256ull << 20 };
+
 	void set_asset_folder(std::string path);
 
 	template<typename T>
 	void register_importer();
 
+	/// @brief Returns the asset already loaded from the path if there is one. Adds a reference either way.
 	template<typename T>
-	Result<T*, ImportError> load_file(const char* path);
+	Result<T*, ImportError> load_file(const char* path) {
+		auto asset = acquire(typeid(T), path);
+		if (!asset) return Error(asset.error());
+		return static_cast<T*>(asset.value());
+	}
 	template<typename T>
 	Result<T*, ImportError> load_file(std::string path) { return load_file<T>(path.c_str()); }
+
+	/// @brief Decodes the file on a worker thread, its GPU objects are created by a later process_uploads call. Shares
+	/// loads already done or in flight and adds a reference like load_file.
+	template<typename T>
+	AssetFuture<T> load_file_async(const char* path) { return AssetFuture<T>(acquire_async(typeid(T), path)); }
+	template<typename T>
+	AssetFuture<T> load_file_async(std::string path) { return load_file_async<T>(path.c_str()); }
+
+	/// @brief Loaded asset with the id, without adding a reference. Null if it is not loaded.
+	template<typename T>
+	T* find(const AssetId& id) {
+		auto entry = find_entry(typeid(T), id);
+		return entry ? static_cast<T*>(entry->asset) : nullptr;
+	}
+
+	/// @brief Drops a reference added by a load. The asset stays cached until the budget needs its memory.
+	template<typename T>
+	void release(const AssetId& id) { release(typeid(T), id); }
+	void release(std::type_index type, const AssetId& id);
+	/// @brief Adds a reference to a loaded asset and returns it, null if it is not loaded.
+	void* retain(std::type_index type, const AssetId& id);
+
+	/// @brief Evicts unreferenced assets, least recently released first, until the usage fits the budget.
+	void trim();
+	const AssetMemory& get_memory_usage() const { return memory_usage; }
+
+	/// @brief Uploads decoded assets until the budget runs out. Must be called from the main thread once per frame.
+	void process_uploads();
+	/// @brief Asynchronous loads not finished yet.
+	uint get_pending_loads() const { return pending_loads; }
+	/// @brief Threads decoding assets, importers can split their own decoding across them.
+	ThreadPool& get_workers() { return workers; }
 };
 
 template<typename T>
@@ -86,34 +227,8 @@ inline void AssetBackend::register_importer() {
 	importers[importer->file_type()] = static_cast<BaseFileImport*>(importer);
 }
 
-template<typename T>
-inline Result<T*, ImportError> AssetBackend::load_file(const char* path) {
-	auto it = importers.find(typeid(T));
-	if (it == importers.end()) {
-		fprintf(stderr, "ERROR: No importer registered for file: %s\n", path);
-		return nullptr;
-	}
-	auto importer = importers[typeid(T)];
-	std::string abs_path = asset_path + path;
-	auto file = importer->raw_load_file(abs_path.c_str());
-	if (!file) {
-		return Error(file.error());
-	}
-
-	return static_cast<T*>(file.value());
-}
-
 template<typename T>
 inline AssetRef<T>::AssetRef(RefType type, std::string asset) {
 	this->type = type;
-	switch (type) {
-	case Id:
-		id = AssetId(asset);
-		fprintf(stderr, "ERROR: Asset references using ID are not supported yet.");
-		break;
-	case Path:
-		path = asset;
-		break;
-	}
+	id = AssetId(asset);
 }
-
@@ -0,0 +1,199 @@
+#include "cooked_model.h"
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <cstring>
+#include <thread>
+
+// File layout, every section aligned to COOKED_ALIGNMENT:
+// header | lod screen sizes | level mesh slots | mesh entries | vertex and index streams
+const char COOKED_MAGIC[4] = { 'S', 'W', 'M', 'C' };
+
+struct CookedHeader {
+	char magic[4];
+	uint32_t version;
+	CookedSource source;
+	uint64_t file_size;
+	uint32_t mesh_count;
+	uint32_t level_count;
+	uint32_t meshes_per_level;
+	uint32_t padding;
+};
+static_assert(sizeof(CookedHeader) == 56, "Cooked header layout changed, bump COOKED_MODEL_VERSION");
+
+struct CookedMeshEntry {
+	uint8_t formats[VERTEX_ATTRIBUTE_COUNT];
+	uint8_t index_format;
+	uint8_t padding[2];
+	uint32_t material;
+	uint32_t padding2;
+	uint64_t vertex_offset;
+	uint64_t vertex_size;
+	uint64_t index_offset;
+	uint64_t index_size;
+	glm::vec3 bounds_min;
+	glm::vec3 bounds_max;
+	glm::vec3 sphere_center;
+	float sphere_radius;
+};
+static_assert(sizeof(CookedMeshEntry) == 88, "Cooked mesh entry layout changed, bump COOKED_MODEL_VERSION");
+
+static uint64_t align_up(uint64_t offset) {
+	return (offset + COOKED_ALIGNMENT - 1) / COOKED_ALIGNMENT * COOKED_ALIGNMENT;
+}
+
+uint CookedModel::add_mesh(const VertexLayout& layout, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, uint material) {
+	CookedMesh mesh;
+	mesh.layout = layout;
+	mesh.material = material;
+	for (auto& vertex : vertices) mesh.bounds.expand(vertex.position);
+	mesh.sphere = BoundingSphere{ .center = mesh.bounds.get_center(), .radius = 0.0f };
+	for (auto& vertex : vertices) mesh.sphere.radius = glm::max(mesh.sphere.radius, glm::length(vertex.position - mesh.sphere.center));
+
+	// A deque never moves its elements, the spans stay valid as more meshes are added.
+	layout.encode(vertices, storage.emplace_back());
+	mesh.vertices = storage.back();
+	layout.encode_indices(indices, storage.emplace_back());
+	mesh.indices = storage.back();
+
+	meshes.push_back(mesh);
+	return (uint)meshes.size() - 1;
+}
+
+Result<CookedSource, CookError> get_cooked_source(const char* source_path, uint64_t settings_hash) {
+	std::error_code error;
+	auto size = std::filesystem::file_size(source_path, error);
+	if (error) return Error(CookError{ std::format("Cannot read source {}: {}", source_path, error.message()) });
+	auto time = std::filesystem::last_write_time(source_path, error);
+	if (error) return Error(CookError{ std::format("Cannot read source {}: {}", source_path, error.message()) });
+
+	return CookedSource{
+		.size = size,
+		.write_time = (int64_t)time.time_since_epoch().count(),
+		.settings_hash = settings_hash,
+	};
+}
+
+Result<void, CookError> write_cooked_model(const char* path, const CookedModel& model, const CookedSource& source) {
+	uint level_count = model.get_level_count();
+	uint64_t screen_sizes_offset = align_up(sizeof(CookedHeader));
+	uint64_t levels_offset = align_up(screen_sizes_offset + sizeof(float) * model.lod_screen_sizes.size());
+	uint64_t entries_offset = align_up(levels_offset + sizeof(uint32_t) * model.levels.size());
+	uint64_t offset = align_up(entries_offset + sizeof(CookedMeshEntry) * model.meshes.size());
+
+	std::vector<CookedMeshEntry> entries;
+	for (auto& mesh : model.meshes) {
+		CookedMeshEntry entry = {};
+		for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) entry.formats[i] = (uint8_t)mesh.layout.formats[i];
+		entry.index_format = (uint8_t)mesh.layout.index_format;
+		entry.material = mesh.material;
+		entry.vertex_offset = offset;
+		entry.vertex_size = mesh.vertices.size();
+		entry.index_offset = align_up(entry.vertex_offset + entry.vertex_size);
+		entry.index_size = mesh.indices.size();
+		offset = align_up(entry.index_offset + entry.index_size);
+		entry.bounds_min = mesh.bounds.min;
+		entry.bounds_max = mesh.bounds.max;
+		entry.sphere_center = mesh.sphere.center;
+		entry.sphere_radius = mesh.sphere.radius;
+		entries.push_back(entry);
+	}
+
+	CookedHeader header = {};
+	std::memcpy(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	header.version = COOKED_MODEL_VERSION;
+	header.source = source;
+	header.file_size = offset;
+	header.mesh_count = (uint32_t)model.meshes.size();
+	header.level_count = level_count;
+	header.meshes_per_level = model.meshes_per_level;
+
+	// Per thread, two workers may cook the same source at once.
+	auto temp_path = std::format("{}.{}.tmp", path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file) return Error(CookError{ std::format("Cannot create {}", temp_path) });
+
+		const char zeros[COOKED_ALIGNMENT] = {};
+		auto write_at = [&file, &zeros](uint64_t at, const void* data, size_t size) {
+			auto position = (uint64_t)file.tellp();
+			file.write(zeros, at - position);
+			file.write(static_cast<const char*>(data), size);
+		};
+		write_at(0, &header, sizeof(header));
+		write_at(screen_sizes_offset, model.lod_screen_sizes.data(), sizeof(float) * model.lod_screen_sizes.size());
+		write_at(levels_offset, model.levels.data(), sizeof(uint32_t) * model.levels.size());
+		write_at(entries_offset, entries.data(), sizeof(CookedMeshEntry) * entries.size());
+		for (size_t i = 0; i < entries.size(); i++) {
+			write_at(entries[i].vertex_offset, model.meshes[i].vertices.data(), model.meshes[i].vertices.size());
+			write_at(entries[i].index_offset, model.meshes[i].indices.data(), model.meshes[i].indices.size());
+		}
+		write_at(offset, nullptr, 0);
+		if (!file) return Error(CookError{ std::format("Failed writing {}", temp_path) });
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_path, path, error);
+	if (error) return Error(CookError{ std::format("Cannot replace {}: {}", path, error.message()) });
+	return {};
+}
+
+Result<CookedModel, CookError> read_cooked_model(const utils::MappedFile& file, const CookedSource& source) {
+	auto data = file.get_data();
+	auto size = file.get_size();
+	if (size < sizeof(CookedHeader)) return Error(CookError{ "Truncated header" });
+
+	CookedHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0) return Error(CookError{ "Not a cooked model" });
+	if (header.version != COOKED_MODEL_VERSION) return Error(CookError{ std::format("Version {} is outdated", header.version) });
+	if (header.source != source) return Error(CookError{ "Source or import settings changed" });
+	if (header.file_size != size) return Error(CookError{ "Truncated file" });
+	if (header.level_count == 0) return Error(CookError{ "No levels" });
+
+	// Every offset is checked against the file size before anything is read through it.
+	uint64_t screen_sizes_offset = align_up(sizeof(CookedHeader));
+	uint64_t levels_offset = align_up(screen_sizes_offset + sizeof(float) * (header.level_count - 1));
+	uint64_t level_slots = (uint64_t)header.level_count * header.meshes_per_level;
+	uint64_t entries_offset = align_up(levels_offset + sizeof(uint32_t) * level_slots);
+	if (entries_offset + sizeof(CookedMeshEntry) * (uint64_t)header.mesh_count > size) return Error(CookError{ "Truncated tables" });
+
+	CookedModel model;
+	model.meshes_per_level = header.meshes_per_level;
+	model.lod_screen_sizes.resize(header.level_count - 1);
+	std::memcpy(model.lod_screen_sizes.data(), data + screen_sizes_offset, sizeof(float) * model.lod_screen_sizes.size());
+	model.levels.resize(level_slots);
+	std::memcpy(model.levels.data(), data + levels_offset, sizeof(uint32_t) * level_slots);
+	for (auto mesh : model.levels) {
+		if (mesh >= header.mesh_count) return Error(CookError{ "Level uses a missing mesh" });
+	}
+
+	auto entries = reinterpret_cast<const CookedMeshEntry*>(data + entries_offset);
+	for (uint i = 0; i < header.mesh_count; i++) {
+		auto& entry = entries[i];
+		CookedMesh mesh;
+		for (int a = 0; a < VERTEX_ATTRIBUTE_COUNT; a++) {
+			if (entry.formats[a] > (uint8_t)VertexFormat::Unorm8x4) return Error(CookError{ "Unknown vertex format" });
+			mesh.layout.formats[a] = (VertexFormat)entry.formats[a];
+		}
+		if (entry.index_format > (uint8_t)IndexFormat::U32) return Error(CookError{ "Unknown index format" });
+		mesh.layout.index_format = (IndexFormat)entry.index_format;
+
+		if (entry.vertex_offset > size || entry.vertex_size > size - entry.vertex_offset
+			|| entry.index_offset > size || entry.index_size > size - entry.index_offset) {
+			return Error(CookError{ "Stream outside the file" });
+		}
+		uint stride = mesh.layout.get_stride();
+		if (stride == 0 || entry.vertex_size % stride != 0 || entry.index_size % mesh.layout.get_index_size() != 0) {
+			return Error(CookError{ "Stream size does not match its layout" });
+		}
+
+		mesh.vertices = std::span(data + entry.vertex_offset, entry.vertex_size);
+		mesh.indices = std::span(data + entry.index_offset, entry.index_size);
+		mesh.bounds = AABB{ .min = entry.bounds_min, .max = entry.bounds_max };
+		mesh.sphere = BoundingSphere{ .center = entry.sphere_center, .radius = entry.sphere_radius };
+		mesh.material = entry.material;
+		model.meshes.push_back(mesh);
+	}
+	return model;
+}
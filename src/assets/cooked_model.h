@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <span>
+#include <string>
+#include <cstdint>
+#include "../rendering/vertex_layout.h"
+#include "../rendering/bounds.h"
+#include "../utils.h"
+#include "../venum.h"
+
+/// @brief Bumped whenever the layout of cooked files or what the importer bakes into them changes.
+const uint32_t COOKED_MODEL_VERSION = 1;
+/// @brief Every stream in a cooked file starts at a multiple of this, so mapped data can be read and uploaded in place.
+const uint32_t COOKED_ALIGNMENT = 16;
+
+/// @brief What a cooked file was built from. Any difference with the current source makes the file stale.
+struct CookedSource {
+	uint64_t size = 0;
+	int64_t write_time = 0;
+	/// @brief Hash of the importer options that change the cooked data.
+	uint64_t settings_hash = 0;
+
+	bool operator==(const CookedSource&) const = default;
+};
+
+struct CookedMesh {
+	VertexLayout layout;
+	/// @brief Packed with the layout, ready to upload.
+	std::span<const std::byte> vertices;
+	/// @brief Stored in the index format of the layout.
+	std::span<const std::byte> indices;
+	AABB bounds;
+	BoundingSphere sphere;
+	/// @brief Index of the material in the source scene.
+	uint material = 0;
+};
+
+/// @brief Meshes of a model and the levels of detail using them. Streams either point into a mapped cooked file or
+/// into the storage of the model itself when it was just cooked.
+struct CookedModel {
+	std::vector<CookedMesh> meshes;
+	/// @brief Screen size of each level after the full detail one.
+	std::vector<float> lod_screen_sizes;
+	/// @brief Mesh used by each mesh slot of each level, level by level. Levels can share meshes.
+	std::vector<uint> levels;
+	uint meshes_per_level = 0;
+	std::deque<std::vector<std::byte>> storage;
+
+	uint get_level_count() const { return (uint)lod_screen_sizes.size() + 1; }
+	/// @brief Packs the streams into storage and adds a mesh using them.
+	uint add_mesh(const VertexLayout& layout, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, uint material);
+};
+
+struct CookError {
+	std::string error;
+};
+
+/// @brief Size and modification time of the source with the importer settings hash, fails if the source is missing.
+Result<CookedSource, CookError> get_cooked_source(const char* source_path, uint64_t settings_hash);
+/// @brief Writes the model to a temporary file first and renames it, so readers never map a half written file.
+Result<void, CookError> write_cooked_model(const char* path, const CookedModel& model, const CookedSource& source);
+/// @brief Validates the mapped file against the source and returns a model whose streams point into the mapping, so
+/// the file must stay mapped while they are used.
+Result<CookedModel, CookError> read_cooked_model(const utils::MappedFile& file, const CookedSource& source);
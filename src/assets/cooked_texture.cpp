@@ -0,0 +1,220 @@
+#include "cooked_texture.h"
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <cstring>
+#include <thread>
+
+// DDS layout: magic | header | DX10 header (only for DX10 files) | every mip from the largest, tightly packed
+struct DDSPixelFormat {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t four_cc;
+	uint32_t rgb_bit_count;
+	uint32_t masks[4];
+};
+
+struct DDSHeader {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitch_or_linear_size;
+	uint32_t depth;
+	uint32_t mip_count;
+	// Unused by the format, cooked files keep their stamp here.
+	uint32_t reserved[11];
+	DDSPixelFormat format;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+static_assert(sizeof(DDSHeader) == 124, "DDS header must match the file format");
+
+struct DDSHeaderDX10 {
+	uint32_t dxgi_format;
+	uint32_t dimension;
+	uint32_t misc_flag;
+	uint32_t array_size;
+	uint32_t misc_flags2;
+};
+
+struct CookedStamp {
+	uint32_t magic;
+	uint32_t version;
+	CookedSource source;
+};
+static_assert(sizeof(CookedStamp) <= sizeof(DDSHeader::reserved), "Cooked stamp must fit the reserved DDS fields");
+
+constexpr uint32_t four_cc(const char (&code)[5]) {
+	return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+const uint32_t DDS_MAGIC = four_cc("DDS ");
+const uint32_t COOKED_STAMP_MAGIC = four_cc("SWMT");
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+const uint32_t DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_VOLUME = 0x200000;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+const uint32_t DDS_MAX_SIZE = 16384;
+
+enum DXGIFormat : uint32_t {
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC7_UNORM = 98,
+};
+
+static uint32_t to_dxgi(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::RGBA8:
+		return DXGI_FORMAT_R8G8B8A8_UNORM;
+	case PixelFormat::BC1:
+		return DXGI_FORMAT_BC1_UNORM;
+	case PixelFormat::BC3:
+		return DXGI_FORMAT_BC3_UNORM;
+	case PixelFormat::BC5:
+		return DXGI_FORMAT_BC5_UNORM;
+	case PixelFormat::BC7:
+		return DXGI_FORMAT_BC7_UNORM;
+	}
+	return 0;
+}
+
+static Option<PixelFormat> from_dxgi(uint32_t format) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		return PixelFormat::RGBA8;
+	case DXGI_FORMAT_BC1_UNORM:
+		return PixelFormat::BC1;
+	case DXGI_FORMAT_BC3_UNORM:
+		return PixelFormat::BC3;
+	case DXGI_FORMAT_BC5_UNORM:
+		return PixelFormat::BC5;
+	case DXGI_FORMAT_BC7_UNORM:
+		return PixelFormat::BC7;
+	}
+	return None;
+}
+
+// Formats of files written by older tools, without the DX10 header.
+static Option<PixelFormat> from_legacy(const DDSPixelFormat& format) {
+	if (format.flags & DDPF_FOURCC) {
+		if (format.four_cc == four_cc("DXT1")) return PixelFormat::BC1;
+		if (format.four_cc == four_cc("DXT5")) return PixelFormat::BC3;
+		if (format.four_cc == four_cc("ATI2") || format.four_cc == four_cc("BC5U")) return PixelFormat::BC5;
+		return None;
+	}
+	bool rgba = format.masks[0] == 0x000000FF && format.masks[1] == 0x0000FF00 && format.masks[2] == 0x00FF0000 && format.masks[3] == 0xFF000000;
+	if ((format.flags & DDPF_RGB) && format.rgb_bit_count == 32 && rgba) return PixelFormat::RGBA8;
+	return None;
+}
+
+size_t CookedTexture::get_bytes() const {
+	size_t bytes = 0;
+	for (auto& mip : mips) bytes += mip.data.size();
+	return bytes;
+}
+
+void CookedTexture::add_mip(glm::uvec2 size, std::vector<std::byte> data) {
+	// A deque never moves its elements, the spans stay valid as more mips are added.
+	storage.push_back(std::move(data));
+	mips.push_back(TextureMip{ .size = size, .data = storage.back() });
+}
+
+Result<void, CookError> write_dds_texture(const char* path, const CookedTexture& texture, const CookedSource& source) {
+	auto size = texture.get_size();
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = size.y;
+	header.width = size.x;
+	header.pitch_or_linear_size = (uint32_t)texture.mips[0].data.size();
+	header.depth = 1;
+	header.mip_count = (uint32_t)texture.mips.size();
+	header.format.size = sizeof(DDSPixelFormat);
+	header.format.flags = DDPF_FOURCC;
+	header.format.four_cc = four_cc("DX10");
+	header.caps = DDSCAPS_TEXTURE | (texture.mips.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	CookedStamp stamp = { .magic = COOKED_STAMP_MAGIC, .version = COOKED_TEXTURE_VERSION, .source = source };
+	std::memcpy(header.reserved, &stamp, sizeof(stamp));
+
+	DDSHeaderDX10 dx10 = {};
+	dx10.dxgi_format = to_dxgi(texture.format);
+	dx10.dimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.array_size = 1;
+
+	// Per thread, two workers may cook the same source at once.
+	auto temp_path = std::format("{}.{}.tmp", path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file) return Error(CookError{ std::format("Cannot create {}", temp_path) });
+		file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+		for (auto& mip : texture.mips) file.write(reinterpret_cast<const char*>(mip.data.data()), mip.data.size());
+		if (!file) return Error(CookError{ std::format("Failed writing {}", temp_path) });
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_path, path, error);
+	if (error) return Error(CookError{ std::format("Cannot replace {}: {}", path, error.message()) });
+	return {};
+}
+
+Result<CookedTexture, CookError> read_dds_texture(const utils::MappedFile& file, const CookedSource* source) {
+	auto data = file.get_data();
+	auto size = file.get_size();
+	uint64_t offset = sizeof(uint32_t) + sizeof(DDSHeader);
+	if (size < offset) return Error(CookError{ "Truncated header" });
+
+	uint32_t magic;
+	std::memcpy(&magic, data, sizeof(magic));
+	DDSHeader header;
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader)) return Error(CookError{ "Not a DDS file" });
+
+	if (source) {
+		CookedStamp stamp;
+		std::memcpy(&stamp, header.reserved, sizeof(stamp));
+		if (stamp.magic != COOKED_STAMP_MAGIC) return Error(CookError{ "Not a cooked texture" });
+		if (stamp.version != COOKED_TEXTURE_VERSION) return Error(CookError{ std::format("Version {} is outdated", stamp.version) });
+		if (stamp.source != *source) return Error(CookError{ "Source or import settings changed" });
+	}
+
+	Option<PixelFormat> format = None;
+	if ((header.format.flags & DDPF_FOURCC) && header.format.four_cc == four_cc("DX10")) {
+		if (size < offset + sizeof(DDSHeaderDX10)) return Error(CookError{ "Truncated header" });
+		DDSHeaderDX10 dx10;
+		std::memcpy(&dx10, data + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+		if (dx10.dimension != DDS_DIMENSION_TEXTURE2D || dx10.array_size > 1) return Error(CookError{ "Only single 2D textures are supported" });
+		format = from_dxgi(dx10.dxgi_format);
+	}
+	else {
+		format = from_legacy(header.format);
+	}
+	if (!format) return Error(CookError{ "Unsupported pixel format" });
+	if (header.caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) return Error(CookError{ "Only single 2D textures are supported" });
+
+	glm::uvec2 mip_size = glm::uvec2(header.width, header.height);
+	if (mip_size.x == 0 || mip_size.y == 0 || mip_size.x > DDS_MAX_SIZE || mip_size.y > DDS_MAX_SIZE) return Error(CookError{ "Invalid size" });
+	uint mip_count = (header.flags & DDSD_MIPMAPCOUNT) && header.mip_count > 0 ? header.mip_count : 1;
+	if (mip_count > get_mip_count(mip_size)) return Error(CookError{ "More mips than the size allows" });
+
+	CookedTexture texture;
+	texture.format = format.value();
+	for (uint i = 0; i < mip_count; i++) {
+		size_t bytes = get_image_bytes(texture.format, mip_size);
+		if (bytes > size - offset) return Error(CookError{ "Truncated mips" });
+		texture.mips.push_back(TextureMip{ .size = mip_size, .data = std::span(data + offset, bytes) });
+		offset += bytes;
+		mip_size = glm::max(mip_size / 2u, glm::uvec2(1));
+	}
+	return texture;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include "../rendering/pixel_format.h"
+#include "cooked_model.h"
+
+/// @brief Bumped whenever what the importer bakes into cooked textures changes.
+const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+/// @brief Full mip chain of a texture, ready to upload. Mips either point into a mapped DDS file or into the storage of
+/// the texture itself when it was just cooked. Rows go bottom to top like every texture GL samples.
+struct CookedTexture {
+	PixelFormat format = PixelFormat::RGBA8;
+	std::vector<TextureMip> mips;
+	std::deque<std::vector<std::byte>> storage;
+
+	glm::uvec2 get_size() const { return mips.empty() ? glm::uvec2(0) : mips[0].size; }
+	size_t get_bytes() const;
+	/// @brief Moves the data into storage and adds the next mip using it.
+	void add_mip(glm::uvec2 size, std::vector<std::byte> data);
+};
+
+/// @brief Writes the texture as a DDS file, with the source stamped into the reserved header fields. Written to a
+/// temporary file first and renamed like cooked models.
+Result<void, CookError> write_dds_texture(const char* path, const CookedTexture& texture, const CookedSource& source);
+/// @brief Validates the mapped DDS file and returns a texture whose mips point into the mapping. With a source, only
+/// files cooked from it with the current version are accepted. Without one any 2D DDS file in a supported format
+/// loads, note those are usually stored top to bottom and show flipped.
+Result<CookedTexture, CookError> read_dds_texture(const utils::MappedFile& file, const CookedSource* source);
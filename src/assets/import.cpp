@@ -1,45 +1,171 @@
 #include "import.h"
 #include "../core.h"
 #include "../logging.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "cooked_model.h"
+#include "texture_compressor.h"
+#include <filesystem>
+#include <chrono>
 
-Result<GPUShader*, ImportError> GPUShaderImport::load_file(const char* path) {
+struct ShaderPayload : ImportPayload {
+	std::string vert;
+	std::string frag;
+};
+
+Result<std::unique_ptr<ImportPayload>, ImportError> GPUShaderImport::decode_file(const char* path) {
 	Console::log_verbose("Loading gpu shader at path: {}", path);
-	auto vert = utils::load_text(std::string(path).append(".vert").c_str());
-	auto frag = utils::load_text(std::string(path).append(".frag").c_str());
+	auto payload = std::make_unique<ShaderPayload>();
+	payload->vert = utils::load_text(std::string(path).append(".vert").c_str());
+	payload->frag = utils::load_text(std::string(path).append(".frag").c_str());
+	return payload;
+}
 
+Result<GPUShader*, ImportError> GPUShaderImport::upload(ImportPayload* payload) {
+	auto sources = static_cast<ShaderPayload*>(payload);
 	auto render_bd = App::get_render_backend();
 	GPUShader* shader = render_bd->shaders.create();
-	shader->compile_shader(vert.c_str(), frag.c_str());
+	shader->compile_shader(sources->vert.c_str(), sources->frag.c_str());
 	return shader;
 }
 
-Result<GPUModel*, ImportError> GPUModelImport::load_file(const char* path) {
+void GPUShaderImport::unload(GPUShader* shader) {
+	App::get_render_backend()->shaders.destroy(shader);
+}
+
+struct ModelPayload : ImportPayload {
+	// Keeps the streams of a cooked model mapped until they are uploaded.
+	utils::MappedFile file;
+	CookedModel model;
+};
+
+Result<std::unique_ptr<ImportPayload>, ImportError> GPUModelImport::decode_file(const char* path) {
 	Console::log_verbose("Loading gpu model at path: {}", path);
+	auto source = get_cooked_source(path, get_settings_hash());
+	if (!source) return Error(ImportError{ std::format("Loading gpu model failed: {}", source.error().error) });
+
+	auto payload = std::make_unique<ModelPayload>();
+	auto cooked_path = std::string(path).append(".cooked");
+	if (cook_models && payload->file.open(cooked_path.c_str())) {
+		auto cooked = read_cooked_model(payload->file, source.value());
+		if (cooked) {
+			Console::log_verbose("Using cooked model at path: {}", cooked_path);
+			payload->model = std::move(cooked.value());
+			return payload;
+		}
+		Console::log_verbose("Cooked model at {} is stale: {}", cooked_path, cooked.error().error);
+		payload->file.close();
+	}
+
+	auto cooked = cook_model(path);
+	if (!cooked) return Error(cooked.error());
+	if (cook_models) {
+		auto written = write_cooked_model(cooked_path.c_str(), cooked.value(), source.value());
+		if (!written) Console::log_warning("Could not cook model {}: {}", path, written.error().error);
+	}
+	payload->model = std::move(cooked.value());
+	return payload;
+}
+
+Result<GPUModel*, ImportError> GPUModelImport::upload(ImportPayload* payload) {
+	return create_model(static_cast<ModelPayload*>(payload)->model);
+}
+
+// Levels share the meshes the simplifier could not reduce, each one is counted and destroyed once.
+static std::vector<GPUMesh*> get_unique_meshes(GPUModel* model) {
+	std::vector<GPUMesh*> meshes;
+	for (uint lod = 0; lod < model->get_lod_count(); lod++) {
+		for (auto mesh : model->get_lod_meshes(lod)) {
+			if (std::find(meshes.begin(), meshes.end(), mesh) == meshes.end()) meshes.push_back(mesh);
+		}
+	}
+	return meshes;
+}
+
+AssetMemory GPUModelImport::get_memory(GPUModel* model) {
+	auto meshes = get_unique_meshes(model);
+	AssetMemory memory = { .cpu = sizeof(GPUModel) + sizeof(GPUMesh) * meshes.size() };
+	for (auto mesh : meshes) memory.gpu += mesh->get_gpu_bytes();
+	return memory;
+}
+
+void GPUModelImport::unload(GPUModel* model) {
+	auto render_bd = App::get_render_backend();
+	for (auto mesh : get_unique_meshes(model)) render_bd->meshes.destroy(mesh);
+	render_bd->models.destroy(model);
+}
+
+Result<CookedModel, ImportError> GPUModelImport::cook_model(const char* path) {
 	Assimp::Importer importer;
 	auto scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		return Error(ImportError{ std::format("Loading gpu model failed: {}", importer.GetErrorString()) });
 	}
 
-	GPUModel* model = App::get_render_backend()->models.create();
-	process_ai_node(model, scene->mRootNode, scene);
+	CookedModel cooked;
+	std::vector<std::vector<uint>> chains;
+	process_ai_node(cooked, chains, scene->mRootNode, scene);
+	uint lod_count = (uint)std::min(lod_ratios.size(), lod_screen_sizes.size());
+	cooked.lod_screen_sizes.assign(lod_screen_sizes.begin(), lod_screen_sizes.begin() + lod_count);
+
+	// Levels where no mesh got any simpler would only cost a switch.
+	for (uint lod = lod_count; lod > 0; lod--) {
+		bool simpler = false;
+		for (auto& chain : chains) simpler |= chain[lod] != chain[lod - 1];
+		if (simpler) continue;
+		for (auto& chain : chains) chain.erase(chain.begin() + lod);
+		cooked.lod_screen_sizes.erase(cooked.lod_screen_sizes.begin() + lod - 1);
+	}
+
+	cooked.meshes_per_level = (uint)chains.size();
+	for (uint level = 0; level < cooked.get_level_count(); level++) {
+		for (auto& chain : chains) cooked.levels.push_back(chain[level]);
+	}
+	return cooked;
+}
+
+GPUModel* GPUModelImport::create_model(const CookedModel& cooked) {
+	auto render_bd = App::get_render_backend();
+	std::vector<GPUMesh*> meshes;
+	for (auto& cooked_mesh : cooked.meshes) {
+		GPUMesh* mesh = render_bd->meshes.create();
+		mesh->set_layout(cooked_mesh.layout);
+		mesh->set_encoded(cooked_mesh.vertices, cooked_mesh.indices, cooked_mesh.bounds, cooked_mesh.sphere);
+		meshes.push_back(mesh);
+	}
+
+	GPUModel* model = render_bd->models.create();
+	for (uint level = 0; level < cooked.get_level_count(); level++) {
+		auto& level_meshes = level == 0 ? model->meshes : model->lods.emplace_back(ModelLOD{ .screen_size = cooked.lod_screen_sizes[level - 1] }).meshes;
+		for (uint slot = 0; slot < cooked.meshes_per_level; slot++) {
+			level_meshes.push_back(meshes[cooked.levels[level * cooked.meshes_per_level + slot]]);
+		}
+	}
+	model->update_bounds();
 	return model;
 }
 
-void GPUModelImport::process_ai_node(GPUModel* model, aiNode* node, const aiScene* scene) {
+uint64_t GPUModelImport::get_settings_hash() const {
+	uint64_t hash = utils::hash_bytes(&quantize_vertices, sizeof(quantize_vertices));
+	hash = utils::hash_bytes(lod_ratios.data(), sizeof(float) * lod_ratios.size(), hash);
+	hash = utils::hash_bytes(lod_screen_sizes.data(), sizeof(float) * lod_screen_sizes.size(), hash);
+	return utils::hash_bytes(&lod_max_error, sizeof(lod_max_error), hash);
+}
+
+void GPUModelImport::process_ai_node(CookedModel& cooked, std::vector<std::vector<uint>>& chains, aiNode* node, const aiScene* scene) {
 	// process all the node's meshes (if any)
 	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		model->meshes.push_back(process_ai_mesh(mesh, scene));
+		chains.push_back(process_ai_mesh(cooked, mesh, scene));
 	}
 	// then do the same for each of its children
 	for (unsigned int i = 0; i < node->mNumChildren; i++) {
-		process_ai_node(model, node->mChildren[i], scene);
+		process_ai_node(cooked, chains, node->mChildren[i], scene);
 	}
 }
 
 struct Vertex;
-GPUMesh* GPUModelImport::process_ai_mesh(aiMesh* mesh, const aiScene* scene) {
+std::vector<uint> GPUModelImport::process_ai_mesh(CookedModel& cooked, aiMesh* mesh, const aiScene* scene) {
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	//vector<Texture> textures;
@@ -60,6 +186,12 @@ GPUMesh* GPUModelImport::process_ai_mesh(aiMesh* mesh, const aiScene* scene) {
 			vertex.tangent.z = mesh->mTangents[i].z;
 		}
 
+		if (mesh->mColors[0]) {
+			vertex.color.r = mesh->mColors[0][i].r;
+			vertex.color.g = mesh->mColors[0][i].g;
+			vertex.color.b = mesh->mColors[0][i].b;
+		}
+
 		if (mesh->mTextureCoords[0]) {
 			vertex.coords.x = mesh->mTextureCoords[0][i].x;
 			vertex.coords.y = mesh->mTextureCoords[0][i].y;
@@ -88,49 +220,244 @@ GPUMesh* GPUModelImport::process_ai_mesh(aiMesh* mesh, const aiScene* scene) {
 		//textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	}
 
-	GPUMesh* gpu_mesh = App::get_render_backend()->meshes.create();
-	gpu_mesh->set_vertices(vertices);
-	gpu_mesh->set_triangles(indices);
-	return gpu_mesh;
+	auto stats = optimize_mesh(vertices, indices);
+	Console::log_verbose("Optimized mesh {}: {} -> {} vertices, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+		mesh->mName.C_Str(), stats.vertices_before, stats.vertices_after, stats.cache_before.acmr, stats.cache_after.acmr, stats.cache_before.atvr, stats.cache_after.atvr);
+
+	auto layout = choose_layout(mesh, vertices);
+	std::vector<uint> chain = { cooked.add_mesh(layout, vertices, indices, mesh->mMaterialIndex) };
+
+	// Every level simplifies the previous one, so the error accumulates as smoothly as the triangle count drops.
+	float max_error = lod_max_error * cooked.meshes[chain[0]].sphere.radius;
+	std::vector<unsigned int> lod_indices = indices;
+	for (size_t i = 0; i < std::min(lod_ratios.size(), lod_screen_sizes.size()); i++) {
+		size_t target = (size_t)(indices.size() / 3 * lod_ratios[i]) * 3;
+		float error = 0.0f;
+		auto simplified = simplify_mesh(vertices, lod_indices, target, max_error, &error);
+		if (simplified.size() == lod_indices.size() || simplified.empty()) {
+			chain.push_back(chain.back());
+			continue;
+		}
+		Console::log_verbose("Simplified mesh {} level {}: {} -> {} triangles, error {:.4f}",
+			mesh->mName.C_Str(), i + 1, indices.size() / 3, simplified.size() / 3, error);
+
+		// Each level only keeps the vertices it still uses, reordered for the cache like the full mesh.
+		lod_indices = simplified;
+		std::vector<Vertex> lod_vertices = vertices;
+		optimize_vertex_cache(simplified, (uint)lod_vertices.size());
+		optimize_vertex_fetch(lod_vertices, simplified);
+		chain.push_back(cooked.add_mesh(layout, lod_vertices, simplified, mesh->mMaterialIndex));
+	}
+	return chain;
 }
 
-Result<GPUTexture2D*, ImportError> GPUTexture2DImport::load_file(const char* path) {
+// Half floats keep 11 bits of precision, past this distance from the origin their error goes above a millimeter.
+const float HALF_POSITION_LIMIT = 4.0f;
+
+VertexLayout GPUModelImport::choose_layout(aiMesh* mesh, const std::vector<Vertex>& vertices) {
+	VertexLayout layout;
+	if (!mesh->mColors[0]) layout.set_format(VertexColor, VertexFormat::None);
+	if (vertices.size() <= 65536) layout.index_format = IndexFormat::U16;
+	if (!quantize_vertices) return layout;
+
+	float max_position = 0.0f;
+	glm::vec2 min_coords = glm::vec2(0.0f);
+	glm::vec2 max_coords = glm::vec2(0.0f);
+	for (auto& vertex : vertices) {
+		max_position = std::max(max_position, glm::max(glm::abs(vertex.position.x), glm::max(glm::abs(vertex.position.y), glm::abs(vertex.position.z))));
+		min_coords = glm::min(min_coords, vertex.coords);
+		max_coords = glm::max(max_coords, vertex.coords);
+	}
+
+	if (max_position <= HALF_POSITION_LIMIT) layout.set_format(VertexPosition, VertexFormat::Half4);
+	layout.set_format(VertexNormal, VertexFormat::Snorm16x2);
+	layout.set_format(VertexTangent, mesh->mTangents ? VertexFormat::Snorm16x2 : VertexFormat::None);
+	if (mesh->mColors[0]) layout.set_format(VertexColor, VertexFormat::Unorm8x4);
+	// Tiled coordinates keep full floats, halves are too coarse for large textures.
+	if (!mesh->mTextureCoords[0]) layout.set_format(VertexCoords, VertexFormat::None);
+	else if (min_coords.x >= 0.0f && min_coords.y >= 0.0f && max_coords.x <= 1.0f && max_coords.y <= 1.0f) layout.set_format(VertexCoords, VertexFormat::Unorm16x2);
+	return layout;
+}
+
+struct TexturePayload : ImportPayload {
+	// Keeps the mips of a cooked texture mapped until they are uploaded.
+	utils::MappedFile file;
+	CookedTexture texture;
+};
+
+Result<std::unique_ptr<ImportPayload>, ImportError> GPUTexture2DImport::decode_file(const char* path) {
 	Console::log_verbose("Loading gpu texture at path: {}", path);
-	int width, heigth, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(path, &width, &heigth, &nrChannels, 0);
-	if (!data) {
-		return Error(ImportError{ std::format("Failed to load texture at: %s\n %s\n", path, stbi_failure_reason())});
+	auto payload = std::make_unique<TexturePayload>();
+	if (std::filesystem::path(path).extension() == ".dds") {
+		if (!payload->file.open(path)) return Error(ImportError{ std::format("Failed to open texture at: {}", path) });
+		auto texture = read_dds_texture(payload->file, nullptr);
+		if (!texture) return Error(ImportError{ std::format("Failed to load texture at: {}: {}", path, texture.error().error) });
+		payload->texture = std::move(texture.value());
+		return payload;
 	}
 
-	GPUTexture2D* texture = App::get_render_backend()->textures.create();
-	texture->set_as_rgb8(width, heigth, data);
-	stbi_image_free(data);
+	auto source = get_cooked_source(path, get_settings_hash());
+	if (!source) return Error(ImportError{ std::format("Loading gpu texture failed: {}", source.error().error) });
+
+	auto cooked_path = std::string(path).append(".cooked.dds");
+	if (cook_textures && payload->file.open(cooked_path.c_str())) {
+		auto cooked = read_dds_texture(payload->file, &source.value());
+		if (cooked) {
+			Console::log_verbose("Using cooked texture at path: {}", cooked_path);
+			payload->texture = std::move(cooked.value());
+			return payload;
+		}
+		Console::log_verbose("Cooked texture at {} is stale: {}", cooked_path, cooked.error().error);
+		payload->file.close();
+	}
+
+	auto cooked = cook_texture(path);
+	if (!cooked) return Error(cooked.error());
+	if (cook_textures) {
+		auto written = write_dds_texture(cooked_path.c_str(), cooked.value(), source.value());
+		if (!written) Console::log_warning("Could not cook texture {}: {}", path, written.error().error);
+	}
+	payload->texture = std::move(cooked.value());
+	return payload;
+}
+
+Result<GPUTexture2D*, ImportError> GPUTexture2DImport::upload(ImportPayload* payload) {
+	auto image = static_cast<TexturePayload*>(payload);
+	auto render_bd = App::get_render_backend();
+	if (is_block_compressed(image->texture.format) && !render_bd->supports_bc_compression()) {
+		return Error(ImportError{ "Texture is block compressed and the driver cannot sample it" });
+	}
+
+	GPUTexture2D* texture = render_bd->textures.create();
+	if (!stream_textures || !render_bd->texture_streamer.settings.enabled || image->texture.mips.size() == 1) {
+		texture->set_mips(image->texture.format, image->texture.mips);
+		return texture;
+	}
+
+	// Moving keeps the mips valid, the mapping and the storage they point into do not move.
+	auto owner = std::make_shared<TexturePayload>(std::move(*image));
+	auto source = std::make_shared<TextureStreamSource>();
+	source->format = owner->texture.format;
+	source->mips = owner->texture.mips;
+	source->owner = owner;
+	render_bd->texture_streamer.add(texture, source);
 	return texture;
 }
 
-Result<GPUCubemapTexture*, ImportError> GPUCubemapTextureImport::load_file(const char* path) {
+AssetMemory GPUTexture2DImport::get_memory(GPUTexture2D* texture) {
+	// Read once at upload, when a streamed texture only has its tail. Counting the whole chain keeps the mips the
+	// streamer adds later inside the budget, the streamer fits what is actually resident in its own budget.
+	size_t streamed = App::get_render_backend()->texture_streamer.get_full_bytes(texture);
+	return AssetMemory{ .gpu = streamed > 0 ? streamed : texture->get_gpu_bytes(), .cpu = sizeof(GPUTexture2D) };
+}
+
+void GPUTexture2DImport::unload(GPUTexture2D* texture) {
+	App::get_render_backend()->textures.destroy(texture);
+}
+
+Result<CookedTexture, ImportError> GPUTexture2DImport::cook_texture(const char* path) {
+	int width, heigth, channels;
+	// Per thread, several workers decode at once.
+	stbi_set_flip_vertically_on_load_thread(true);
+	// Always expanded to RGBA, the channel count of the file only decides the format.
+	unsigned char* data = stbi_load(path, &width, &heigth, &channels, 4);
+	if (!data) return Error(ImportError{ std::format("Failed to load texture at: {}: {}", path, stbi_failure_reason()) });
+	std::vector<std::byte> pixels((std::byte*)data, (std::byte*)data + (size_t)width * heigth * 4);
+	stbi_image_free(data);
+
+	bool has_alpha = false;
+	if (channels == 2 || channels == 4) {
+		for (size_t i = 3; i < pixels.size() && !has_alpha; i += 4) has_alpha = pixels[i] != (std::byte)255;
+	}
+
+	CookedTexture cooked;
+	cooked.format = choose_format(path, has_alpha);
+	glm::uvec2 size = glm::uvec2(width, heigth);
+	while (true) {
+		std::vector<std::byte> level;
+		compress_image(cooked.format, pixels, size, level);
+		cooked.add_mip(size, std::move(level));
+		if (size == glm::uvec2(1)) break;
+		pixels = downsample_rgba8(pixels, size);
+		size = glm::max(size / 2u, glm::uvec2(1));
+	}
+	Console::log_verbose("Cooked texture {}: {}x{}, {} mips, {} bytes", path, width, heigth, cooked.mips.size(), cooked.get_bytes());
+	return cooked;
+}
+
+PixelFormat GPUTexture2DImport::choose_format(const char* path, bool has_alpha) const {
+	if (!compress_textures || !App::get_render_backend()->supports_bc_compression()) return PixelFormat::RGBA8;
+	auto stem = std::filesystem::path(path).stem().string();
+	if (!two_channel_suffix.empty() && stem.ends_with(two_channel_suffix)) return PixelFormat::BC5;
+	if (has_alpha) return use_bc7 ? PixelFormat::BC7 : PixelFormat::BC3;
+	return PixelFormat::BC1;
+}
+
+uint64_t GPUTexture2DImport::get_settings_hash() const {
+	// Support changes with the driver, a cooked file from a machine with different support is cooked again.
+	bool compress = compress_textures && App::get_render_backend()->supports_bc_compression();
+	uint64_t hash = utils::hash_bytes(&compress, sizeof(compress));
+	hash = utils::hash_bytes(&use_bc7, sizeof(use_bc7), hash);
+	return utils::hash_bytes(two_channel_suffix.data(), two_channel_suffix.size(), hash);
+}
+
+Result<std::unique_ptr<ImportPayload>, ImportError> GPUCubemapTextureImport::decode_file(const char* path) {
 	Console::log_verbose("Loading gpu cubemap at path: {}", path);
-	int width, heigth, nrChannels;
-	std::vector<unsigned char*> cubemap_data;
-	for (size_t i = 0; i < 6; i++) {
+	auto start = std::chrono::steady_clock::now();
+	auto payload = decode_faces(path, &App::get_asset_backend()->get_workers());
+	if (!payload) return Error(payload.error());
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	Console::log_verbose("Decoded cubemap {} in {:.2f} ms", path, elapsed.count());
+	return std::unique_ptr<ImportPayload>(std::move(*payload));
+}
+
+Result<std::unique_ptr<ImagePayload>, ImportError> GPUCubemapTextureImport::decode_faces(const char* path, ThreadPool* workers) {
+	struct Face {
+		int width = 0, heigth = 0, channels = 0;
+		std::string error;
+	};
+	Face faces[6];
+	auto payload = std::make_unique<ImagePayload>();
+	payload->images.resize(6, nullptr);
+
+	auto decode = [path, &faces, &payload](uint i) {
 		auto face_path = std::string(path);
 		std::replace(face_path.begin(), face_path.end(), '#', std::to_string(i).c_str()[0]);
-		stbi_set_flip_vertically_on_load(true);
-		unsigned char* data = stbi_load(face_path.c_str(), &width, &heigth, &nrChannels, 0);
-		if (!data) {
-			return Error(ImportError{ std::format("Failed to load cubemap at: %s\n %s\n", path, stbi_failure_reason()) });
+		auto& face = faces[i];
+		stbi_set_flip_vertically_on_load_thread(true);
+		// Uploaded as GL_RGB, files with alpha or a single channel are converted.
+		payload->images[i] = stbi_load(face_path.c_str(), &face.width, &face.heigth, &face.channels, 3);
+		if (!payload->images[i]) face.error = std::format("Failed to load cubemap face at: {}: {}", face_path, stbi_failure_reason());
+	};
+	// Faces are independent, each one decodes on its own worker.
+	if (workers) workers->parallel_for(6, decode);
+	else for (uint i = 0; i < 6; i++) decode(i);
+
+	for (auto& face : faces) {
+		if (!face.error.empty()) return Error(ImportError{ face.error });
+		if (face.width != faces[0].width || face.heigth != faces[0].heigth) {
+			return Error(ImportError{ std::format("Faces of cubemap {} have different sizes", path) });
 		}
-		Console::log_verbose("Loading gpu cubemap face at path: {}", face_path.c_str());
-		cubemap_data.push_back(data);
 	}
+	payload->width = faces[0].width;
+	payload->heigth = faces[0].heigth;
+	payload->nrChannels = 3;
+	return payload;
+}
 
+Result<GPUCubemapTexture*, ImportError> GPUCubemapTextureImport::upload(ImportPayload* payload) {
+	auto faces = static_cast<ImagePayload*>(payload);
 	auto cubemap = App::get_render_backend()->cubemaps.create();
-	cubemap->set_as_rgb8(width, heigth, cubemap_data);
+	cubemap->set_as_rgb8(faces->width, faces->heigth, faces->images);
+	return cubemap;
+}
 
-	for (auto d : cubemap_data) {
-		stbi_image_free(d);
-	}
+AssetMemory GPUCubemapTextureImport::get_memory(GPUCubemapTexture* cubemap) {
+	auto size = cubemap->get_size();
+	return AssetMemory{ .gpu = (size_t)size.x * size.y * 4 * 6, .cpu = sizeof(GPUCubemapTexture) };
+}
 
-	return cubemap;
+void GPUCubemapTextureImport::unload(GPUCubemapTexture* cubemap) {
+	App::get_render_backend()->cubemaps.destroy(cubemap);
 }
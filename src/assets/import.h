@@ -1,47 +1,160 @@
 #pragma once
 #include <typeindex>
+#include <memory>
 #include <stb_image.h>
 #include "../rendering/renderer.h"
+#include "cooked_model.h"
+#include "cooked_texture.h"
 #include "../venum.h"
 
+class ThreadPool;
 
 class ImportError {
 public:
 	std::string error;
 };
 
+/// @brief Bytes held by assets, in GPU objects and in main memory.
+struct AssetMemory {
+	size_t gpu = 0;
+	size_t cpu = 0;
+
+	AssetMemory& operator+=(const AssetMemory& other) { gpu += other.gpu; cpu += other.cpu; return *this; }
+	AssetMemory& operator-=(const AssetMemory& other) { gpu -= other.gpu; cpu -= other.cpu; return *this; }
+	bool exceeds(const AssetMemory& budget) const { return gpu > budget.gpu || cpu > budget.cpu; }
+};
+
+/// @brief File contents decoded by an importer, waiting to become GPU objects.
+class ImportPayload {
+public:
+	virtual ~ImportPayload() = default;
+};
+
+/// @brief Imports run in two steps so the slow part can leave the main thread: decoding reads and parses the file on
+/// any thread, uploading creates the GL objects and must run on the main thread.
 class BaseFileImport {
 public:
 	virtual std::type_index file_type() = 0;
-	virtual Result<void*, ImportError> raw_load_file(const char* path) = 0;
+	/// @brief Must not touch GL nor the pools of the render backend.
+	virtual Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) = 0;
+	virtual Result<void*, ImportError> raw_upload(ImportPayload* payload) = 0;
+	virtual AssetMemory raw_get_memory(void* asset) = 0;
+	virtual void raw_unload(void* asset) = 0;
+	Result<void*, ImportError> raw_load_file(const char* path) {
+		auto payload = decode_file(path);
+		if (!payload) return Error(payload.error());
+		return raw_upload(payload.value().get());
+	}
 };
 
 template <typename T>
 class FileImport : public BaseFileImport {
 public:
 	std::type_index file_type() override { return typeid(T); }
-	virtual Result<void*, ImportError> raw_load_file(const char* path) { return load_file(path); }
-	virtual Result<T*, ImportError> load_file(const char* path) = 0;
+	Result<void*, ImportError> raw_upload(ImportPayload* payload) override {
+		auto asset = upload(payload);
+		if (!asset) return Error(asset.error());
+		return asset.value();
+	}
+	AssetMemory raw_get_memory(void* asset) override { return get_memory(static_cast<T*>(asset)); }
+	void raw_unload(void* asset) override { unload(static_cast<T*>(asset)); }
+	/// @brief Receives the payload returned by decode_file.
+	virtual Result<T*, ImportError> upload(ImportPayload* payload) = 0;
+	/// @brief Memory held by an asset this importer created, used for the asset memory budget.
+	virtual AssetMemory get_memory(T*) { return AssetMemory{ .cpu = sizeof(T) }; }
+	/// @brief Destroys an asset this importer created once nothing references it.
+	virtual void unload(T* asset) = 0;
+	Result<T*, ImportError> load_file(const char* path) {
+		auto payload = decode_file(path);
+		if (!payload) return Error(payload.error());
+		return upload(payload.value().get());
+	}
 };
 
 class GPUShaderImport : public FileImport<GPUShader> {
 public:
-	Result<GPUShader*, ImportError> load_file(const char* path) override;
+	Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) override;
+	Result<GPUShader*, ImportError> upload(ImportPayload* payload) override;
+	void unload(GPUShader* shader) override;
 };
 
 class GPUModelImport : public FileImport<GPUModel> {
 public:
-	Result<GPUModel*, ImportError> load_file(const char* path) override;
-	void process_ai_node(GPUModel* model, aiNode* node, const aiScene* scene);
-	GPUMesh* process_ai_mesh(aiMesh* mesh, const aiScene* scene);
+	/// @brief Store meshes with the smallest vertex layout that keeps them accurate instead of full floats.
+	bool quantize_vertices = true;
+	/// @brief Triangle count of each generated level of detail, relative to the full mesh. Empty disables them.
+	std::vector<float> lod_ratios = { 0.5f, 0.25f, 0.125f };
+	/// @brief Screen size each level starts at, one per ratio.
+	std::vector<float> lod_screen_sizes = { 0.4f, 0.2f, 0.1f };
+	/// @brief Largest surface error allowed while simplifying, relative to the mesh bounding radius.
+	float lod_max_error = 0.05f;
+	/// @brief Saves the processed meshes next to the source as path.cooked and maps that file on later loads instead of
+	/// importing the source again, as long as neither the source nor the options above changed.
+	bool cook_models = true;
+
+	/// @brief Maps the cooked file if it is up to date, otherwise cooks the source and saves the result.
+	Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) override;
+	Result<GPUModel*, ImportError> upload(ImportPayload* payload) override;
+	AssetMemory get_memory(GPUModel* model) override;
+	/// @brief Destroys the model and the meshes of every level.
+	void unload(GPUModel* model) override;
+	/// @brief Imports the source with assimp and processes its meshes.
+	Result<CookedModel, ImportError> cook_model(const char* path);
+	GPUModel* create_model(const CookedModel& cooked);
+	uint64_t get_settings_hash() const;
+	void process_ai_node(CookedModel& cooked, std::vector<std::vector<uint>>& chains, aiNode* node, const aiScene* scene);
+	/// @brief Full detail mesh followed by one mesh per level of detail, as indices into the cooked meshes. Levels the
+	/// simplifier could not reduce further reuse the previous mesh.
+	std::vector<uint> process_ai_mesh(CookedModel& cooked, aiMesh* mesh, const aiScene* scene);
+	VertexLayout choose_layout(aiMesh* mesh, const std::vector<Vertex>& vertices);
 };
 
 class GPUTexture2DImport : public FileImport<GPUTexture2D> {
 public:
-	Result<GPUTexture2D*, ImportError> load_file(const char* path) override;
+	/// @brief Saves the mip chain next to the source as path.cooked.dds and maps that file on later loads instead of
+	/// decoding the source again, as long as neither the source nor the options below changed. DDS sources are loaded
+	/// as they are.
+	bool cook_textures = true;
+	/// @brief Block compress the mips. Stored as RGBA8 otherwise, also when the driver cannot sample BC formats.
+	bool compress_textures = true;
+	/// @brief Textures with alpha use BC7 instead of BC3, same size and better quality but slower to cook.
+	bool use_bc7 = true;
+	/// @brief Sources whose name ends with this, before the extension, hold two channel data like normal maps and are
+	/// stored as BC5.
+	std::string two_channel_suffix = "_normal";
+	/// @brief Uploads only the coarse mips and lets the texture streamer of the renderer add the finer ones while visuals
+	/// need them. The file stays mapped, or the cooked mips in memory, until the texture is unloaded.
+	bool stream_textures = true;
+
+	/// @brief Maps the cooked file if it is up to date, otherwise cooks the source and saves the result.
+	Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) override;
+	Result<GPUTexture2D*, ImportError> upload(ImportPayload* payload) override;
+	AssetMemory get_memory(GPUTexture2D* texture) override;
+	void unload(GPUTexture2D* texture) override;
+	/// @brief Decodes the source with stb and builds its full mip chain in the chosen format.
+	Result<CookedTexture, ImportError> cook_texture(const char* path);
+	PixelFormat choose_format(const char* path, bool has_alpha) const;
+	uint64_t get_settings_hash() const;
+};
+
+/// @brief Decoded images waiting for upload, freed with the payload whether the upload happens or not.
+struct ImagePayload : ImportPayload {
+	int width, heigth, nrChannels;
+	std::vector<unsigned char*> images;
+
+	~ImagePayload() {
+		for (auto image : images) stbi_image_free(image);
+	}
 };
 
 class GPUCubemapTextureImport : public FileImport<GPUCubemapTexture> {
 public:
-	Result<GPUCubemapTexture*, ImportError> load_file(const char* path) override;
+	/// @brief Decodes the faces on the asset workers.
+	Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) override;
+	Result<GPUCubemapTexture*, ImportError> upload(ImportPayload* payload) override;
+	AssetMemory get_memory(GPUCubemapTexture* cubemap) override;
+	void unload(GPUCubemapTexture* cubemap) override;
+	/// @brief Decodes the six faces as RGB, '#' in the path is replaced by the face index. Each face is decoded on its
+	/// own worker, or one after the other on this thread without workers.
+	static Result<std::unique_ptr<ImagePayload>, ImportError> decode_faces(const char* path, ThreadPool* workers);
 };
@@ -0,0 +1,238 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <string_view>
+#include <cmath>
+
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices, uint vertex_count, uint cache_size) {
+	VertexCacheStats stats;
+	if (indices.empty() || vertex_count == 0) return stats;
+
+	// Timestamp of the miss that loaded each vertex, it is still cached while fewer than cache_size misses followed.
+	std::vector<uint> loaded_at(vertex_count, 0);
+	uint misses = 0;
+	for (auto index : indices) {
+		if (loaded_at[index] == 0 || misses - loaded_at[index] >= cache_size) {
+			misses++;
+			loaded_at[index] = misses;
+		}
+	}
+
+	uint used = 0;
+	for (auto time : loaded_at) used += time != 0;
+	stats.acmr = (float)misses / (indices.size() / 3);
+	stats.atvr = (float)misses / used;
+	return stats;
+}
+
+void deduplicate_vertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+	static_assert(sizeof(Vertex) == sizeof(float) * 14, "Vertex must have no padding to be hashed as bytes");
+	auto bytes = [](const Vertex& vertex) { return std::string_view(reinterpret_cast<const char*>(&vertex), sizeof(Vertex)); };
+
+	std::unordered_map<std::string_view, unsigned int> unique;
+	unique.reserve(vertices.size());
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<Vertex> merged;
+	merged.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		auto [it, inserted] = unique.try_emplace(bytes(vertices[i]), (unsigned int)merged.size());
+		if (inserted) merged.push_back(vertices[i]);
+		remap[i] = it->second;
+	}
+
+	for (auto& index : indices) index = remap[index];
+	vertices = std::move(merged);
+}
+
+// Scoring constants from the original description of the algorithm.
+const int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+static float forsyth_score(int cache_position, uint remaining_triangles) {
+	if (remaining_triangles == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		// The last triangle's vertices get a fixed score so the next one does not just reuse its edge.
+		if (cache_position < 3) score = LAST_TRIANGLE_SCORE;
+		else score = std::pow(1.0f - (float)(cache_position - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+	}
+	// Vertices with few triangles left are finished first so they leave the working set.
+	return score + VALENCE_BOOST_SCALE * std::pow((float)remaining_triangles, -VALENCE_BOOST_POWER);
+}
+
+void optimize_vertex_cache(std::vector<unsigned int>& indices, uint vertex_count) {
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) return;
+
+	// Triangles adjacent to each vertex, as offsets into a flat list.
+	std::vector<uint> remaining(vertex_count, 0);
+	for (auto index : indices) remaining[index]++;
+	std::vector<uint> adjacency_offset(vertex_count + 1, 0);
+	for (uint v = 0; v < vertex_count; v++) adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+	std::vector<uint> adjacency(indices.size());
+	std::vector<uint> fill = std::vector<uint>(adjacency_offset.begin(), adjacency_offset.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = (uint)(i / 3);
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (uint v = 0; v < vertex_count; v++) vertex_score[v] = forsyth_score(-1, remaining[v]);
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; t++) {
+		triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> next_cache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t scan = 0;
+	int64_t best = -1;
+	for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+		// Nothing in the cache has triangles left, restart from the first triangle not emitted yet.
+		if (best < 0) {
+			while (emitted[scan]) scan++;
+			best = (int64_t)scan;
+		}
+
+		unsigned int triangle[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[best] = true;
+
+		// The triangle goes to the front of the LRU cache, it is never adjacent again.
+		for (auto v : triangle) {
+			remaining[v]--;
+			auto begin = adjacency.begin() + adjacency_offset[v];
+			auto end = begin + remaining[v] + 1;
+			*std::find(begin, end, (uint)best) = *(end - 1);
+		}
+
+		next_cache.assign(triangle, triangle + 3);
+		for (auto v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) next_cache.push_back(v);
+		}
+		for (size_t i = FORSYTH_CACHE_SIZE; i < next_cache.size(); i++) cache_position[next_cache[i]] = -1;
+		if (next_cache.size() > FORSYTH_CACHE_SIZE) next_cache.resize(FORSYTH_CACHE_SIZE);
+		std::swap(cache, next_cache);
+
+		// Only triangles touching the cache changed score, the best one among them goes next.
+		for (size_t i = 0; i < cache.size(); i++) {
+			cache_position[cache[i]] = (int)i;
+			vertex_score[cache[i]] = forsyth_score((int)i, remaining[cache[i]]);
+		}
+		best = -1;
+		float best_score = 0.0f;
+		for (auto v : cache) {
+			for (uint a = adjacency_offset[v]; a < adjacency_offset[v] + remaining[v]; a++) {
+				uint t = adjacency[a];
+				triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	indices = std::move(result);
+}
+
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices) {
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) return;
+
+	// A cluster starts wherever the FIFO cache would miss all three vertices, moving it costs no extra misses.
+	std::vector<size_t> cluster_starts;
+	std::vector<uint> loaded_at(vertices.size(), 0);
+	uint misses = 0;
+	for (size_t t = 0; t < triangle_count; t++) {
+		uint triangle_misses = 0;
+		for (int k = 0; k < 3; k++) {
+			auto index = indices[t * 3 + k];
+			if (loaded_at[index] == 0 || misses - loaded_at[index] >= VERTEX_CACHE_SIZE) {
+				misses++;
+				loaded_at[index] = misses;
+				triangle_misses++;
+			}
+		}
+		if (triangle_misses == 3) cluster_starts.push_back(t);
+	}
+	if (cluster_starts.empty() || cluster_starts[0] != 0) cluster_starts.insert(cluster_starts.begin(), 0);
+	cluster_starts.push_back(triangle_count);
+
+	glm::vec3 mesh_center = glm::vec3(0.0f);
+	for (auto& vertex : vertices) mesh_center += vertex.position;
+	mesh_center /= (float)std::max<size_t>(vertices.size(), 1);
+
+	// Clusters whose surface faces away from the center are most likely in front of the rest from any viewpoint.
+	size_t cluster_count = cluster_starts.size() - 1;
+	std::vector<float> sort_keys(cluster_count);
+	for (size_t c = 0; c < cluster_count; c++) {
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+			glm::vec3 p0 = vertices[indices[t * 3]].position;
+			glm::vec3 p1 = vertices[indices[t * 3 + 1]].position;
+			glm::vec3 p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(cross);
+			center += (p0 + p1 + p2) * (triangle_area / 3.0f);
+			normal += cross;
+			area += triangle_area;
+		}
+		center = area > 0.0f ? center / area : mesh_center;
+		float normal_length = glm::length(normal);
+		sort_keys[c] = normal_length > 0.0f ? glm::dot(center - mesh_center, normal / normal_length) : 0.0f;
+	}
+
+	std::vector<size_t> order(cluster_count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sort_keys](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (auto c : order) {
+		result.insert(result.end(), indices.begin() + cluster_starts[c] * 3, indices.begin() + cluster_starts[c + 1] * 3);
+	}
+	indices = std::move(result);
+}
+
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+	const unsigned int UNUSED = UINT32_MAX;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = (unsigned int)ordered.size();
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(ordered);
+}
+
+MeshOptimizeStats optimize_mesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+	MeshOptimizeStats stats;
+	stats.vertices_before = (uint)vertices.size();
+	stats.cache_before = analyze_vertex_cache(indices, (uint)vertices.size());
+
+	deduplicate_vertices(vertices, indices);
+	optimize_vertex_cache(indices, (uint)vertices.size());
+	optimize_overdraw(indices, vertices);
+	optimize_vertex_fetch(vertices, indices);
+
+	stats.vertices_after = (uint)vertices.size();
+	stats.cache_after = analyze_vertex_cache(indices, (uint)vertices.size());
+	return stats;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../rendering/vertex_layout.h"
+
+/// @brief Post transform cache efficiency of an index list, simulated with a FIFO cache.
+struct VertexCacheStats {
+	/// @brief Average cache misses per triangle, 0.5 is the best a regular mesh can reach, 3 is no reuse at all.
+	float acmr = 0.0f;
+	/// @brief Average times each vertex is transformed, 1 is optimal.
+	float atvr = 0.0f;
+};
+
+struct MeshOptimizeStats {
+	uint vertices_before = 0;
+	uint vertices_after = 0;
+	VertexCacheStats cache_before;
+	VertexCacheStats cache_after;
+};
+
+const uint VERTEX_CACHE_SIZE = 16;
+
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices, uint vertex_count, uint cache_size = VERTEX_CACHE_SIZE);
+
+/// @brief Merges vertices whose attributes are bit for bit identical and rewrites the indices to match.
+void deduplicate_vertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+/// @brief Reorders triangles for the post transform cache with Tom Forsyth's linear speed algorithm.
+void optimize_vertex_cache(std::vector<unsigned int>& indices, uint vertex_count);
+/// @brief Splits the cache ordered triangles where the cache restarts anyway and draws the clusters facing outwards
+/// first, so the front of the mesh fills the depth buffer before the back is drawn. Keeps the cache order inside each
+/// cluster.
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices);
+/// @brief Reorders vertices by first use so fetching them walks memory forward. Unused vertices are dropped.
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+/// @brief Runs every stage above in order.
+MeshOptimizeStats optimize_mesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
@@ -0,0 +1,167 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+
+// Sum of squared distances to a set of planes, weighted by the area of the triangles they came from.
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	static Quadric from_plane(glm::dvec3 n, double d, double weight) {
+		Quadric q;
+		q.a00 = n.x * n.x * weight; q.a01 = n.x * n.y * weight; q.a02 = n.x * n.z * weight;
+		q.a11 = n.y * n.y * weight; q.a12 = n.y * n.z * weight; q.a22 = n.z * n.z * weight;
+		q.b0 = n.x * d * weight; q.b1 = n.y * d * weight; q.b2 = n.z * d * weight;
+		q.c = d * d * weight;
+		q.weight = weight;
+		return q;
+	}
+
+	Quadric& operator+=(const Quadric& o) {
+		a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+		b0 += o.b0; b1 += o.b1; b2 += o.b2;
+		c += o.c;
+		weight += o.weight;
+		return *this;
+	}
+
+	/// @brief Average squared distance from the point to the planes.
+	double error(glm::dvec3 p) const {
+		double rx = a00 * p.x + a01 * p.y + a02 * p.z;
+		double ry = a01 * p.x + a11 * p.y + a12 * p.z;
+		double rz = a02 * p.x + a12 * p.y + a22 * p.z;
+		double e = rx * p.x + ry * p.y + rz * p.z + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		return weight > 0.0 ? std::abs(e) / weight : 0.0;
+	}
+};
+
+struct Collapse {
+	unsigned int from;
+	unsigned int to;
+	double error;
+};
+
+static uint64_t edge_key(unsigned int a, unsigned int b) {
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+static glm::dvec3 triangle_normal(glm::dvec3 p0, glm::dvec3 p1, glm::dvec3 p2) {
+	return glm::cross(p1 - p0, p2 - p0);
+}
+
+std::vector<unsigned int> simplify_mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& source,
+	size_t target_index_count, float max_error, float* result_error) {
+	std::vector<unsigned int> indices = source;
+	double max_error_sq = (double)max_error * max_error;
+	double worst = 0.0;
+	size_t vertex_count = vertices.size();
+	auto position = [&vertices](unsigned int v) { return glm::dvec3(vertices[v].position); };
+
+	// Open edges are used by a single triangle, their vertices stay where they are.
+	std::vector<bool> locked(vertex_count, false);
+	{
+		std::unordered_map<uint64_t, uint> edge_uses;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int k = 0; k < 3; k++) edge_uses[edge_key(indices[i + k], indices[i + (k + 1) % 3])]++;
+		}
+		for (auto& [key, uses] : edge_uses) {
+			if (uses != 1) continue;
+			locked[key >> 32] = true;
+			locked[key & 0xFFFFFFFF] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		glm::dvec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+		glm::dvec3 normal = triangle_normal(p0, p1, p2);
+		double area = glm::length(normal);
+		if (area == 0.0) continue;
+		normal /= area;
+		auto plane = Quadric::from_plane(normal, -glm::dot(normal, p0), area);
+		for (int k = 0; k < 3; k++) quadrics[indices[i + k]] += plane;
+	}
+
+	std::vector<unsigned int> remap(vertex_count);
+	std::vector<uint> adjacency_offset(vertex_count + 1);
+	std::vector<uint> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertex_count);
+
+	// Every pass collapses the cheapest edges that do not share a neighbourhood, then rebuilds the triangles.
+	while (indices.size() > target_index_count) {
+		std::fill(adjacency_offset.begin(), adjacency_offset.end(), 0);
+		for (auto v : indices) adjacency_offset[v + 1]++;
+		for (size_t v = 0; v < vertex_count; v++) adjacency_offset[v + 1] += adjacency_offset[v];
+		adjacency.resize(indices.size());
+		std::vector<uint> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = (uint)(i / 3);
+
+		collapses.clear();
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+				Quadric merged = quadrics[a];
+				merged += quadrics[b];
+				if (!locked[a]) collapses.push_back(Collapse{ a, b, merged.error(position(b)) });
+				if (!locked[b]) collapses.push_back(Collapse{ b, a, merged.error(position(a)) });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		for (size_t v = 0; v < vertex_count; v++) remap[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), false);
+		size_t triangles = indices.size() / 3;
+		size_t target_triangles = target_index_count / 3;
+		size_t done = 0;
+		for (auto& collapse : collapses) {
+			if (collapse.error > max_error_sq || triangles <= target_triangles) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// Moving the vertex must not flip or fold any triangle around it.
+			bool flips = false;
+			uint removed = 0;
+			glm::dvec3 target = position(collapse.to);
+			for (uint a = adjacency_offset[collapse.from]; a < adjacency_offset[collapse.from + 1] && !flips; a++) {
+				uint t = adjacency[a];
+				unsigned int tri[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) { removed++; continue; }
+
+				glm::dvec3 before = triangle_normal(position(tri[0]), position(tri[1]), position(tri[2]));
+				glm::dvec3 moved[3];
+				for (int k = 0; k < 3; k++) moved[k] = tri[k] == collapse.from ? target : position(tri[k]);
+				glm::dvec3 after = triangle_normal(moved[0], moved[1], moved[2]);
+				flips = glm::dot(before, after) <= 0.0;
+			}
+			if (flips) continue;
+
+			// The whole neighbourhood is frozen for the rest of the pass so the flip test above stays valid.
+			for (uint a = adjacency_offset[collapse.from]; a < adjacency_offset[collapse.from + 1]; a++) {
+				uint t = adjacency[a];
+				for (int k = 0; k < 3; k++) touched[indices[t * 3 + k]] = true;
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			worst = std::max(worst, collapse.error);
+			triangles -= removed;
+			done++;
+		}
+		if (done == 0) break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c) continue;
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+
+	if (result_error) *result_error = (float)std::sqrt(worst);
+	return indices;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "../rendering/vertex_layout.h"
+
+/// @brief Reduces the triangle count with quadric error edge collapses. Vertices only collapse onto one of their
+/// neighbours, so the result indexes the same vertex list and keeps its attributes. Vertices on open edges (mesh borders
+/// and attribute seams) never move, which keeps the silhouette and the UV layout intact.
+/// @param target_index_count Stops once the index count is at or below it.
+/// @param max_error Stops before any collapse that would move the surface further than this, in mesh units.
+/// @param result_error Largest error of the collapses done.
+/// @return Indices of the simplified mesh.
+std::vector<unsigned int> simplify_mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	size_t target_index_count, float max_error, float* result_error = nullptr);
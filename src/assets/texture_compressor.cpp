@@ -0,0 +1,249 @@
+#include "texture_compressor.h"
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+
+std::vector<std::byte> downsample_rgba8(std::span<const std::byte> pixels, glm::uvec2 size) {
+	glm::uvec2 next = glm::max(size / 2u, glm::uvec2(1));
+	std::vector<std::byte> out((size_t)next.x * next.y * 4);
+	auto texel = [&pixels, size](uint x, uint y, uint c) {
+		return (uint)pixels[((size_t)glm::min(y, size.y - 1) * size.x + glm::min(x, size.x - 1)) * 4 + c];
+	};
+
+	for (uint y = 0; y < next.y; y++) {
+		for (uint x = 0; x < next.x; x++) {
+			for (uint c = 0; c < 4; c++) {
+				uint sum = texel(x * 2, y * 2, c) + texel(x * 2 + 1, y * 2, c) + texel(x * 2, y * 2 + 1, c) + texel(x * 2 + 1, y * 2 + 1, c);
+				out[((size_t)y * next.x + x) * 4 + c] = (std::byte)((sum + 2) / 4);
+			}
+		}
+	}
+	return out;
+}
+
+typedef glm::vec4 Block[16];
+
+// Pixels past the edge of the image repeat the last row or column.
+static void load_block(std::span<const std::byte> pixels, glm::uvec2 size, uint bx, uint by, Block block) {
+	for (uint y = 0; y < 4; y++) {
+		for (uint x = 0; x < 4; x++) {
+			size_t offset = ((size_t)glm::min(by * 4 + y, size.y - 1) * size.x + glm::min(bx * 4 + x, size.x - 1)) * 4;
+			for (int c = 0; c < 4; c++) block[y * 4 + x][c] = (float)pixels[offset + c];
+		}
+	}
+}
+
+// Extremes of the pixels along their principal axis, only the channels in the mask are considered.
+static void fit_endpoints(const Block block, glm::vec4 mask, glm::vec4& lo, glm::vec4& hi) {
+	glm::vec4 mean(0.0f), min(FLT_MAX), max(-FLT_MAX);
+	for (int i = 0; i < 16; i++) {
+		mean += block[i] * mask;
+		min = glm::min(min, block[i] * mask);
+		max = glm::max(max, block[i] * mask);
+	}
+	mean /= 16.0f;
+
+	glm::mat4 covariance(0.0f);
+	for (int i = 0; i < 16; i++) {
+		glm::vec4 d = block[i] * mask - mean;
+		covariance += glm::outerProduct(d, d);
+	}
+
+	// Power iteration, starting from the bounding box diagonal which is usually close already.
+	glm::vec4 axis = max - min;
+	if (glm::dot(axis, axis) == 0.0f) {
+		lo = hi = mean;
+		return;
+	}
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 next = covariance * axis;
+		float length = glm::length(next);
+		if (length == 0.0f) break;
+		axis = next / length;
+	}
+	axis = glm::normalize(axis);
+
+	float t_min = FLT_MAX, t_max = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		float t = glm::dot(block[i] * mask - mean, axis);
+		t_min = glm::min(t_min, t);
+		t_max = glm::max(t_max, t);
+	}
+	lo = glm::clamp(mean + axis * t_min, 0.0f, 255.0f);
+	hi = glm::clamp(mean + axis * t_max, 0.0f, 255.0f);
+}
+
+template<size_t N>
+static uint find_nearest(const glm::vec4 (&palette)[N], glm::vec4 color, glm::vec4 mask) {
+	uint best = 0;
+	float best_distance = FLT_MAX;
+	for (uint i = 0; i < N; i++) {
+		glm::vec4 d = (palette[i] - color) * mask;
+		float distance = glm::dot(d, d);
+		if (distance < best_distance) {
+			best_distance = distance;
+			best = i;
+		}
+	}
+	return best;
+}
+
+static void write_le(std::byte* out, uint64_t value, uint bytes) {
+	for (uint i = 0; i < bytes; i++) out[i] = (std::byte)(value >> (i * 8));
+}
+
+static uint16_t to_565(glm::vec4 color) {
+	uint r = (uint)glm::round(color.r * 31.0f / 255.0f);
+	uint g = (uint)glm::round(color.g * 63.0f / 255.0f);
+	uint b = (uint)glm::round(color.b * 31.0f / 255.0f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec4 from_565(uint16_t value) {
+	uint r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+	return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255.0f);
+}
+
+// Always in four color mode, BC3 ignores the endpoint order and reads it that way anyway.
+static void encode_bc1(const Block block, std::byte* out) {
+	const glm::vec4 rgb = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	glm::vec4 lo, hi;
+	fit_endpoints(block, rgb, lo, hi);
+	uint16_t c0 = to_565(hi), c1 = to_565(lo);
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		glm::vec4 p0 = from_565(c0), p1 = from_565(c1);
+		glm::vec4 palette[4] = { p0, p1, (p0 * 2.0f + p1) / 3.0f, (p0 + p1 * 2.0f) / 3.0f };
+		for (uint i = 0; i < 16; i++) indices |= find_nearest(palette, block[i], rgb) << (i * 2);
+	}
+	write_le(out, c0, 2);
+	write_le(out + 2, c1, 2);
+	write_le(out + 4, indices, 4);
+}
+
+// Single channel block, used for BC3 alpha and both BC5 channels.
+static void encode_bc4(const Block block, int channel, std::byte* out) {
+	float lo = 255.0f, hi = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		lo = glm::min(lo, block[i][channel]);
+		hi = glm::max(hi, block[i][channel]);
+	}
+	uint a0 = (uint)glm::round(hi), a1 = (uint)glm::round(lo);
+
+	uint64_t indices = 0;
+	if (a0 > a1) {
+		// Eight value mode: both endpoints and six steps between them.
+		glm::vec4 palette[8] = { glm::vec4((float)a0), glm::vec4((float)a1) };
+		for (uint k = 1; k < 7; k++) palette[k + 1] = glm::vec4(((7 - k) * a0 + k * a1) / 7.0f);
+		for (uint i = 0; i < 16; i++) indices |= (uint64_t)find_nearest(palette, glm::vec4(block[i][channel]), glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)) << (i * 3);
+	}
+	out[0] = (std::byte)a0;
+	out[1] = (std::byte)a1;
+	write_le(out + 2, indices, 6);
+}
+
+const uint BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Mode 6 endpoints are 7 bits per channel plus a bit shared by the four channels, the bit that fits best is kept.
+static void quantize_bc7_endpoint(glm::vec4 color, uint channels[4], uint& pbit) {
+	float best_error = FLT_MAX;
+	for (uint p = 0; p < 2; p++) {
+		uint candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			candidate[c] = (uint)glm::clamp(glm::round((color[c] - p) / 2.0f), 0.0f, 127.0f);
+			float d = (float)(candidate[c] * 2 + p) - color[c];
+			error += d * d;
+		}
+		if (error >= best_error) continue;
+		best_error = error;
+		pbit = p;
+		std::memcpy(channels, candidate, sizeof(candidate));
+	}
+}
+
+struct BitWriter {
+	std::byte* out;
+	uint bit = 0;
+
+	void write(uint value, uint count) {
+		for (uint i = 0; i < count; i++, bit++) {
+			if ((value >> i) & 1) out[bit / 8] |= (std::byte)(1 << (bit % 8));
+		}
+	}
+};
+
+static void encode_bc7(const Block block, std::byte* out) {
+	glm::vec4 lo, hi;
+	fit_endpoints(block, glm::vec4(1.0f), lo, hi);
+	uint endpoints[2][4], pbits[2];
+	quantize_bc7_endpoint(lo, endpoints[0], pbits[0]);
+	quantize_bc7_endpoint(hi, endpoints[1], pbits[1]);
+
+	glm::vec4 palette[16];
+	for (uint i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			uint e0 = endpoints[0][c] * 2 + pbits[0], e1 = endpoints[1][c] * 2 + pbits[1];
+			palette[i][c] = (float)(((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+		}
+	}
+	uint indices[16];
+	for (uint i = 0; i < 16; i++) indices[i] = find_nearest(palette, block[i], glm::vec4(1.0f));
+
+	// The first index is stored without its top bit, swapping the endpoints clears it.
+	if (indices[0] >= 8) {
+		std::swap(endpoints[0], endpoints[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (auto& index : indices) index = 15 - index;
+	}
+
+	std::memset(out, 0, 16);
+	BitWriter writer = { out };
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(endpoints[0][c], 7);
+		writer.write(endpoints[1][c], 7);
+	}
+	writer.write(pbits[0], 1);
+	writer.write(pbits[1], 1);
+	writer.write(indices[0], 3);
+	for (uint i = 1; i < 16; i++) writer.write(indices[i], 4);
+}
+
+void compress_image(PixelFormat format, std::span<const std::byte> pixels, glm::uvec2 size, std::vector<std::byte>& out) {
+	out.resize(get_image_bytes(format, size));
+	if (!is_block_compressed(format)) {
+		std::memcpy(out.data(), pixels.data(), out.size());
+		return;
+	}
+
+	uint block_bytes = get_block_bytes(format);
+	glm::uvec2 blocks = (size + 3u) / 4u;
+	Block block;
+	for (uint by = 0; by < blocks.y; by++) {
+		for (uint bx = 0; bx < blocks.x; bx++) {
+			load_block(pixels, size, bx, by, block);
+			std::byte* dst = out.data() + ((size_t)by * blocks.x + bx) * block_bytes;
+			switch (format) {
+			case PixelFormat::BC1:
+				encode_bc1(block, dst);
+				break;
+			case PixelFormat::BC3:
+				encode_bc4(block, 3, dst);
+				encode_bc1(block, dst + 8);
+				break;
+			case PixelFormat::BC5:
+				encode_bc4(block, 0, dst);
+				encode_bc4(block, 1, dst + 8);
+				break;
+			case PixelFormat::BC7:
+				encode_bc7(block, dst);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstddef>
+#include "../rendering/pixel_format.h"
+
+/// @brief Next level of an RGBA8 mip chain, each side halved down to 1 with a box filter. Odd sides repeat their last
+/// row or column.
+std::vector<std::byte> downsample_rgba8(std::span<const std::byte> pixels, glm::uvec2 size);
+
+/// @brief Encodes an RGBA8 image into the format, out is resized to fit. Endpoints of every block are the extremes of
+/// its pixels along their principal axis, which is fast and close to what slower exhaustive encoders get for BC1,
+/// BC3 and BC5. BC7 only uses mode 6, a single RGBA endpoint pair with 16 levels, so blocks with sharp edges between
+/// several colors band more than with a full BC7 encoder.
+void compress_image(PixelFormat format, std::span<const std::byte> pixels, glm::uvec2 size, std::vector<std::byte>& out);
@@ -66,8 +66,12 @@ void App::app_loop() {
 	shader->set_sampler_id("emissiveMap", SamplerID::Emissive);
 	shader->set_sampler_id("shadowMaps", SamplerID::Shadows);
 	shader->set_sampler_id("skyboxMap", SamplerID::Skybox);
+	shader->set_sampler_id("lightData", SamplerID::LightData);
+	shader->set_sampler_id("clusterCells", SamplerID::ClusterCells);
+	shader->set_sampler_id("clusterIndices", SamplerID::ClusterIndices);
 
-	auto monkey_model = *assets->load_file<GPUModel>("monkey.glb");
+	// Added to the world once it finishes loading in the background.
+	auto monkey_model = assets->load_file_async<GPUModel>("monkey.glb");
 	auto cube_model = *assets->load_file<GPUModel>("primitives/cube.glb");
 
 	auto uv_texture = *assets->load_file<GPUTexture2D>("uv_texture.png");
@@ -82,35 +86,35 @@ void App::app_loop() {
 	skybox_material->set_texture(SamplerID::Skybox, skybox_cube);
 	skybox->set_material(skybox_material);
 	skybox->set_model(cube_model);
-	world->env.value()->skybox = skybox;
+	world->env.value()->skybox = render->visuals.get_handle(skybox);
 
 	auto material = render->materials.create<GPUPbrMaterial>();
 	material->set_shader(shader);
 	material->set_texture(SamplerID::Albedo, uv_texture);
 	material->set_texture(SamplerID::Skybox, skybox_cube);
-	world->materials.push_back(material);
+	world->add_material(material);
 
 	auto monkey_visual = render->visuals.create();
 	auto xform = glm::identity<glm::mat4>();
 	xform = glm::rotate(xform, glm::radians(180.0f), glm::vec3(0, 1, 0));
 	xform = glm::translate(xform, glm::vec3(0, 1, 0));
 	monkey_visual->set_xform(xform);
-	monkey_visual->set_model(monkey_model);
 	monkey_visual->set_material(material);
-	world->visuals.push_back(monkey_visual);
+	// The backend compacts its visual and camera pools, only handles stay valid across frames.
+	auto monkey_handle = render->visuals.get_handle(monkey_visual);
 
 	auto floor_visual = render->visuals.create();
 	floor_visual->set_model(cube_model);
 	floor_visual->set_material(material);
 	floor_visual->set_xform(glm::translate(glm::scale(glm::identity<glm::mat4>(), glm::vec3(25.0f, 0.1f, 25.0f)), glm::vec3(0, -10.0f, 0)));
-	world->visuals.push_back(floor_visual);
+	world->add_visual(floor_visual);
 
 	auto ligth = render->lights.create();
 	ligth->type = LightType::Point;
 	ligth->position = glm::vec3(3.0, 1.0, -1.0);
 	ligth->color = glm::vec3(1.0f, 0.8f, 0.8f);
 	ligth->intensity = 3.0f;
-	world->lights.push_back(ligth);
+	world->add_light(ligth);
 
 	auto ligth2 = render->lights.create();
 	ligth2->set_cast_shadows(true);
@@ -118,7 +122,7 @@ void App::app_loop() {
 	ligth2->position = glm::vec3(-3.0, 1.0, -1.0);
 	ligth2->color = glm::vec3(0.3, 0.4, 0.8);
 	ligth2->intensity = 7.0f;
-	world->lights.push_back(ligth2);
+	world->add_light(ligth2);
 
 	auto sun = render->lights.create();
 	sun->set_cast_shadows(true);
@@ -126,7 +130,7 @@ void App::app_loop() {
 	sun->dir = glm::normalize(glm::vec3(0.3, -0.5, 0.2));
 	sun->color = glm::vec3(1.0, 1.0, 1.0);
 	sun->intensity = 1.0f;
-	world->lights.push_back(sun);
+	world->add_light(sun);
 
 	auto sun2 = render->lights.create();
 	sun2->set_cast_shadows(true);
@@ -134,13 +138,14 @@ void App::app_loop() {
 	sun2->dir = glm::normalize(glm::vec3(-0.3, -0.5, 0.2));
 	sun2->color = glm::vec3(1.0, 1.0, 1.0);
 	sun2->intensity = 1.0f;
-	world->lights.push_back(sun2);
+	world->add_light(sun2);
 
 	auto proj = glm::perspectiveFov(90.0f, 1280.0f, 720.0f, 0.1f, 100.0f);
 	auto camera = render->cameras.create();
 	camera->set_proj(70.0f, glm::vec2(1280.0f, 720.0f), glm::vec2(0.1f, 100.0f));
 	camera->set_view(glm::vec3(0, 3, -10), glm::vec3(0, 2, 0), glm::vec3(0, 1, 0));
-	world->cameras.push_back(camera);
+	world->add_camera(camera);
+	auto camera_handle = render->cameras.get_handle(camera);
 
 	world->env.value()->clear_color = glm::vec3(0.2, 0.1, 0.3);
 
@@ -167,12 +172,22 @@ void App::app_loop() {
 		float start_frame_time = glfwGetTime();
 		float dt = start_frame_time - last_frame_time;
 
+		assets->process_uploads();
+		if (monkey_model.is_valid() && monkey_model.is_done()) {
+			auto monkey_visual = render->visuals.get(monkey_handle);
+			if (auto model = monkey_model.get(); model && monkey_visual) {
+				monkey_visual->set_model(model.value());
+				world->add_visual(monkey_visual);
+			}
+			monkey_model = AssetFuture<GPUModel>();
+		}
+
 		// Logic here
 		for(auto world : worlds) world->process_frame(0);
 
 		float x = glm::cos(app_time / 5.0f) * 10;
 		float z = -glm::sin(app_time / 5.0f) * 10;
-		camera->set_view(glm::vec3(x, 2.0f, z), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		if (auto camera = render->cameras.get(camera_handle)) camera->set_view(glm::vec3(x, 2.0f, z), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		// Render here
 		render->render_worlds();
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <sstream>
 #include <streambuf>
+#include <mutex>
 
 enum LogType {
 	LogVerbose,
@@ -51,6 +52,8 @@ class Console {
 private:
 	std::vector<ConsoleLog> logs;
 	std::ostringstream buffer;
+	// Assets log from worker threads.
+	std::mutex mutex;
 
 	Console() {}
 	static Console& get_instance() {
@@ -71,7 +74,10 @@ public:
 	//static boost::signals2::signal<void()> log_emitted;
 
 	static std::ostringstream* get_ouput_stream() { return &get_instance().buffer; }
-	static std::vector<ConsoleLog> get_logs() { return get_instance().logs; }
+	static std::vector<ConsoleLog> get_logs() {
+		std::lock_guard lock(get_instance().mutex);
+		return get_instance().logs;
+	}
 
 	static void log_verbose(const char* log) { Console::log(ConsoleLog(LogType::LogVerbose, log)); }
 	template <class... _Types>
@@ -89,12 +95,14 @@ public:
 	template <class... _Types>
 	static void log_critical(const std::format_string<_Types...> fmt, _Types&&... args) { Console::log(ConsoleLog(LogType::LogCritical, std::format(fmt, std::forward<_Types>(args)...))); }
 	static void log(ConsoleLog log) {
+		std::lock_guard lock(get_instance().mutex);
 		Console::log("{}", log.to_str());
 		get_instance().logs.push_back(log);
 		//get_instance().log_emitted();
 	}
 
 	static void clear() {
+		std::lock_guard lock(get_instance().mutex);
 		get_instance().logs.clear();
 		get_instance().buffer.clear();
 	}
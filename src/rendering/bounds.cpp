@@ -0,0 +1,139 @@
+#include "bounds.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BOUNDS_SSE
+#include <xmmintrin.h>
+#endif
+
+void AABB::expand(glm::vec3 point) {
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::expand(const AABB& other) {
+	if (other.is_empty()) return;
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+AABB AABB::transformed(const glm::mat4& xform) const {
+	if (is_empty()) return *this;
+
+	glm::vec3 center = glm::vec3(xform * glm::vec4(get_center(), 1.0f));
+	glm::mat3 abs_basis = glm::mat3(glm::abs(glm::vec3(xform[0])), glm::abs(glm::vec3(xform[1])), glm::abs(glm::vec3(xform[2])));
+	glm::vec3 extents = abs_basis * get_extents();
+
+	AABB box;
+	box.min = center - extents;
+	box.max = center + extents;
+	return box;
+}
+
+BoundingSphere BoundingSphere::transformed(const glm::mat4& xform) const {
+	float scale = glm::max(glm::length(glm::vec3(xform[0])), glm::max(glm::length(glm::vec3(xform[1])), glm::length(glm::vec3(xform[2]))));
+	return BoundingSphere{
+		.center = glm::vec3(xform * glm::vec4(center, 1.0f)),
+		.radius = radius * scale,
+	};
+}
+
+Frustum Frustum::from_matrix(const glm::mat4& view_proj) {
+	// Gribb/Hartmann, rows of the matrix combined with the GL clip volume -w <= x,y,z <= w.
+	glm::mat4 m = glm::transpose(view_proj);
+	Frustum frustum;
+	frustum.planes[Left] = m[3] + m[0];
+	frustum.planes[Right] = m[3] - m[0];
+	frustum.planes[Bottom] = m[3] + m[1];
+	frustum.planes[Top] = m[3] - m[1];
+	frustum.planes[Near] = m[3] + m[2];
+	frustum.planes[Far] = m[3] - m[2];
+
+	for (auto& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool Frustum::intersects(const AABB& box) const {
+	glm::vec3 center = box.get_center();
+	glm::vec3 extents = box.get_extents();
+	for (auto& plane : planes) {
+		glm::vec3 normal = glm::vec3(plane);
+		float radius = glm::dot(extents, glm::abs(normal));
+		if (glm::dot(normal, center) + plane.w < -radius) return false;
+	}
+	return true;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+	for (auto& plane : planes) {
+		if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+	}
+	return true;
+}
+
+Containment Frustum::classify(const AABB& box) const {
+	glm::vec3 center = box.get_center();
+	glm::vec3 extents = box.get_extents();
+	auto result = Containment::Inside;
+	for (auto& plane : planes) {
+		float dist = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+		if (dist < -radius) return Containment::Outside;
+		if (dist < radius) result = Containment::Intersecting;
+	}
+	return result;
+}
+
+void BoundsSoA::clear() {
+	center_x.clear(); center_y.clear(); center_z.clear();
+	extent_x.clear(); extent_y.clear(); extent_z.clear();
+}
+
+void BoundsSoA::push(const AABB& box) {
+	glm::vec3 center = box.get_center();
+	// Boxes without bounds are never culled.
+	glm::vec3 extents = box.is_empty() ? glm::vec3(FLT_MAX) : box.get_extents();
+	center_x.push_back(center.x); center_y.push_back(center.y); center_z.push_back(center.z);
+	extent_x.push_back(extents.x); extent_y.push_back(extents.y); extent_z.push_back(extents.z);
+}
+
+void BoundsSoA::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+	size_t count = size();
+	size_t i = 0;
+
+#ifdef BOUNDS_SSE
+	// Four boxes per iteration, a box is rejected as soon as it is fully behind any plane.
+	for (; i + 4 <= count; i += 4) {
+		__m128 cx = _mm_loadu_ps(&center_x[i]), cy = _mm_loadu_ps(&center_y[i]), cz = _mm_loadu_ps(&center_z[i]);
+		__m128 ex = _mm_loadu_ps(&extent_x[i]), ey = _mm_loadu_ps(&extent_y[i]), ez = _mm_loadu_ps(&extent_z[i]);
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+
+		for (auto& plane : frustum.planes) {
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, _mm_sub_ps(_mm_setzero_ps(), radius)));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++) {
+			if (mask & (1 << lane)) visible.push_back((uint32_t)(i + lane));
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		bool inside = true;
+		for (auto& plane : frustum.planes) {
+			float dist = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+			float radius = std::abs(plane.x) * extent_x[i] + std::abs(plane.y) * extent_y[i] + std::abs(plane.z) * extent_z[i];
+			if (dist < -radius) { inside = false; break; }
+		}
+		if (inside) visible.push_back((uint32_t)i);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+
+typedef unsigned int uint;
+
+/// @brief Axis aligned bounding box. Default constructed boxes are empty and grow with expand().
+struct AABB {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	bool is_empty() const { return min.x > max.x; }
+	glm::vec3 get_center() const { return (min + max) * 0.5f; }
+	glm::vec3 get_extents() const { return (max - min) * 0.5f; }
+
+	void expand(glm::vec3 point);
+	void expand(const AABB& other);
+	/// @brief Box enclosing this one after being transformed, computed from the center and the absolute matrix.
+	AABB transformed(const glm::mat4& xform) const;
+};
+
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	BoundingSphere transformed(const glm::mat4& xform) const;
+};
+
+enum Containment {
+	Outside = 0,
+	Intersecting,
+	Inside,
+};
+
+/// @brief Six planes pointing inwards, extracted from a view projection matrix with GL clip space conventions.
+struct Frustum {
+	enum Plane { Left = 0, Right, Bottom, Top, Near, Far };
+	glm::vec4 planes[6];
+
+	static Frustum from_matrix(const glm::mat4& view_proj);
+
+	bool intersects(const AABB& box) const;
+	bool intersects(const BoundingSphere& sphere) const;
+	Containment classify(const AABB& box) const;
+};
+
+/// @brief World space boxes stored as structure of arrays so the frustum test can run on several boxes per instruction.
+class BoundsSoA {
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+
+public:
+	void clear();
+	void push(const AABB& box);
+	size_t size() const { return center_x.size(); }
+
+	/// @brief Appends the index of every box that is at least partially inside the frustum.
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+};
@@ -0,0 +1,305 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cassert>
+
+static AABB merge(const AABB& a, const AABB& b) {
+	AABB box = a;
+	box.expand(b);
+	return box;
+}
+
+static float perimeter(const AABB& box) {
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool contains(const AABB& outer, const AABB& inner) {
+	return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+/// @brief Slab test, returns the entry distance or -1 if the ray misses the box within max_dist.
+static float ray_box(glm::vec3 origin, glm::vec3 inv_dir, float max_dist, const AABB& box) {
+	glm::vec3 t1 = (box.min - origin) * inv_dir;
+	glm::vec3 t2 = (box.max - origin) * inv_dir;
+	glm::vec3 tmin = glm::min(t1, t2);
+	glm::vec3 tmax = glm::max(t1, t2);
+	float enter = glm::max(glm::max(tmin.x, tmin.y), glm::max(tmin.z, 0.0f));
+	float exit = glm::min(glm::min(tmax.x, tmax.y), glm::min(tmax.z, max_dist));
+	return enter <= exit ? enter : -1.0f;
+}
+
+DynamicBVH::DynamicBVH(float margin) : margin(margin) {
+}
+
+int32_t DynamicBVH::allocate_node() {
+	int32_t node;
+	if (free_list != NULL_NODE) {
+		node = free_list;
+		free_list = nodes[node].parent;
+	}
+	else {
+		node = (int32_t)nodes.size();
+		nodes.push_back(Node());
+	}
+
+	nodes[node].parent = NULL_NODE;
+	nodes[node].left = NULL_NODE;
+	nodes[node].right = NULL_NODE;
+	nodes[node].height = 0;
+	nodes[node].user_data = 0;
+	nodes[node].unbounded = false;
+	return node;
+}
+
+void DynamicBVH::free_node(int32_t node) {
+	nodes[node].parent = free_list;
+	nodes[node].height = -1;
+	free_list = node;
+}
+
+int32_t DynamicBVH::insert(const AABB& box, uint32_t user_data) {
+	int32_t leaf = allocate_node();
+	nodes[leaf].user_data = user_data;
+	nodes[leaf].tight = box;
+	leaf_count++;
+
+	if (box.is_empty()) {
+		nodes[leaf].unbounded = true;
+		unbounded.push_back(leaf);
+		return leaf;
+	}
+
+	nodes[leaf].box = AABB{ .min = box.min - margin, .max = box.max + margin };
+	insert_leaf(leaf);
+	return leaf;
+}
+
+void DynamicBVH::remove(int32_t proxy) {
+	if (nodes[proxy].unbounded) std::erase(unbounded, proxy);
+	else remove_leaf(proxy);
+	free_node(proxy);
+	leaf_count--;
+}
+
+bool DynamicBVH::move(int32_t proxy, const AABB& box) {
+	auto& leaf = nodes[proxy];
+	if (!leaf.unbounded && !box.is_empty() && contains(leaf.box, box)) {
+		leaf.tight = box;
+		return false;
+	}
+
+	uint32_t user_data = leaf.user_data;
+	remove(proxy);
+	// The freed node is the head of the free list, so the proxy id stays the same.
+	int32_t reinserted = insert(box, user_data);
+	assert(reinserted == proxy);
+	(void)reinserted;
+	return true;
+}
+
+void DynamicBVH::insert_leaf(int32_t leaf) {
+	if (root == NULL_NODE) {
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// Walk down choosing the child that increases the total surface area the least.
+	AABB leaf_box = nodes[leaf].box;
+	int32_t index = root;
+	while (!nodes[index].is_leaf()) {
+		auto& node = nodes[index];
+		float area = perimeter(node.box);
+		float combined = perimeter(merge(node.box, leaf_box));
+		float cost = 2.0f * combined;
+		float inheritance = 2.0f * (combined - area);
+
+		auto child_cost = [&](int32_t child) {
+			float merged = perimeter(merge(leaf_box, nodes[child].box));
+			if (nodes[child].is_leaf()) return merged + inheritance;
+			return merged - perimeter(nodes[child].box) + inheritance;
+		};
+		float cost_left = child_cost(node.left);
+		float cost_right = child_cost(node.right);
+
+		if (cost < cost_left && cost < cost_right) break;
+		index = cost_left < cost_right ? node.left : node.right;
+	}
+
+	int32_t sibling = index;
+	int32_t old_parent = nodes[sibling].parent;
+	int32_t new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].box = merge(leaf_box, nodes[sibling].box);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].left = sibling;
+	nodes[new_parent].right = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent != NULL_NODE) {
+		if (nodes[old_parent].left == sibling) nodes[old_parent].left = new_parent;
+		else nodes[old_parent].right = new_parent;
+	}
+	else {
+		root = new_parent;
+	}
+
+	refit_upwards(nodes[leaf].parent);
+}
+
+void DynamicBVH::remove_leaf(int32_t leaf) {
+	if (leaf == root) {
+		root = NULL_NODE;
+		return;
+	}
+
+	int32_t parent = nodes[leaf].parent;
+	int32_t grand_parent = nodes[parent].parent;
+	int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	if (grand_parent != NULL_NODE) {
+		if (nodes[grand_parent].left == parent) nodes[grand_parent].left = sibling;
+		else nodes[grand_parent].right = sibling;
+		nodes[sibling].parent = grand_parent;
+		free_node(parent);
+		refit_upwards(grand_parent);
+	}
+	else {
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		free_node(parent);
+	}
+}
+
+void DynamicBVH::refit_upwards(int32_t index) {
+	while (index != NULL_NODE) {
+		index = balance(index);
+		auto& node = nodes[index];
+		node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+		node.box = merge(nodes[node.left].box, nodes[node.right].box);
+		index = node.parent;
+	}
+}
+
+int32_t DynamicBVH::balance(int32_t a) {
+	if (nodes[a].is_leaf() || nodes[a].height < 2) return a;
+
+	int32_t b = nodes[a].left;
+	int32_t c = nodes[a].right;
+	int32_t diff = nodes[c].height - nodes[b].height;
+	if (diff >= -1 && diff <= 1) return a;
+
+	// Rotate the taller child up, it takes the place of a and a keeps the shorter of its two children.
+	int32_t up = diff > 1 ? c : b;
+	int32_t kept = diff > 1 ? b : c;
+	int32_t f = nodes[up].left;
+	int32_t g = nodes[up].right;
+
+	nodes[up].left = a;
+	nodes[up].parent = nodes[a].parent;
+	nodes[a].parent = up;
+
+	int32_t parent = nodes[up].parent;
+	if (parent != NULL_NODE) {
+		if (nodes[parent].left == a) nodes[parent].left = up;
+		else nodes[parent].right = up;
+	}
+	else {
+		root = up;
+	}
+
+	int32_t taller = nodes[f].height > nodes[g].height ? f : g;
+	int32_t shorter = taller == f ? g : f;
+	nodes[up].right = taller;
+	if (diff > 1) nodes[a].right = shorter;
+	else nodes[a].left = shorter;
+	nodes[shorter].parent = a;
+
+	nodes[a].box = merge(nodes[kept].box, nodes[shorter].box);
+	nodes[a].height = 1 + std::max(nodes[kept].height, nodes[shorter].height);
+	nodes[up].box = merge(nodes[a].box, nodes[taller].box);
+	nodes[up].height = 1 + std::max(nodes[a].height, nodes[taller].height);
+	return up;
+}
+
+void DynamicBVH::collect_leaves(int32_t index, std::vector<uint32_t>& out) const {
+	size_t base = stack.size();
+	stack.push_back(index);
+	while (stack.size() > base) {
+		auto& node = nodes[stack.back()];
+		stack.pop_back();
+		if (node.is_leaf()) {
+			out.push_back(node.user_data);
+			continue;
+		}
+		stack.push_back(node.left);
+		stack.push_back(node.right);
+	}
+}
+
+void DynamicBVH::query(const Frustum& frustum, std::vector<uint32_t>& out) const {
+	for (auto leaf : unbounded) out.push_back(nodes[leaf].user_data);
+	if (root == NULL_NODE) return;
+
+	// Fat boxes reject whole subtrees and accept the ones fully inside. Leaves that straddle a plane are tested
+	// against their tight boxes in one batch at the end.
+	candidate_bounds.clear();
+	candidate_data.clear();
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		int32_t index = stack.back();
+		stack.pop_back();
+		auto& node = nodes[index];
+
+		auto containment = frustum.classify(node.box);
+		if (containment == Containment::Outside) continue;
+		if (containment == Containment::Inside) {
+			collect_leaves(index, out);
+			continue;
+		}
+		if (node.is_leaf()) {
+			candidate_bounds.push(node.tight);
+			candidate_data.push_back(node.user_data);
+			continue;
+		}
+		stack.push_back(node.left);
+		stack.push_back(node.right);
+	}
+
+	candidate_visible.clear();
+	candidate_bounds.cull(frustum, candidate_visible);
+	for (auto i : candidate_visible) out.push_back(candidate_data[i]);
+}
+
+bool DynamicBVH::raycast(glm::vec3 origin, glm::vec3 dir, float max_dist, uint32_t& hit_data, float& hit_dist) const {
+	if (root == NULL_NODE) return false;
+
+	glm::vec3 inv_dir = 1.0f / dir;
+	float best = max_dist;
+	bool hit = false;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty()) {
+		auto& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (ray_box(origin, inv_dir, best, node.box) < 0.0f) continue;
+		if (!node.is_leaf()) {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+			continue;
+		}
+
+		float dist = ray_box(origin, inv_dir, best, node.tight);
+		if (dist < 0.0f) continue;
+		best = dist;
+		hit_data = node.user_data;
+		hit = true;
+	}
+
+	if (hit) hit_dist = best;
+	return hit;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "bounds.h"
+
+/// @brief Dynamic AABB tree. Leaves are stored with a fattened box so small movements do not touch the tree, inserts pick
+/// the sibling with the cheapest surface area cost and the tree is kept balanced with AVL style rotations.
+/// Leaves without bounds are kept outside the tree and returned by every frustum query.
+class DynamicBVH {
+	struct Node {
+		AABB box; // Fat box, encloses the children or the tight box for leaves.
+		AABB tight;
+		int32_t parent;
+		int32_t left;
+		int32_t right;
+		int32_t height; // -1 while the node is free, 0 for leaves.
+		uint32_t user_data;
+		bool unbounded;
+
+		bool is_leaf() const { return left == NULL_NODE; }
+	};
+
+	std::vector<Node> nodes;
+	int32_t root = NULL_NODE;
+	int32_t free_list = NULL_NODE;
+	std::vector<int32_t> unbounded;
+	size_t leaf_count = 0;
+	float margin;
+
+	// Query scratch, kept around to avoid allocating every view.
+	mutable std::vector<int32_t> stack;
+	mutable BoundsSoA candidate_bounds;
+	mutable std::vector<uint32_t> candidate_data;
+	mutable std::vector<uint32_t> candidate_visible;
+
+	int32_t allocate_node();
+	void free_node(int32_t node);
+	void insert_leaf(int32_t leaf);
+	void remove_leaf(int32_t leaf);
+	int32_t balance(int32_t node);
+	void refit_upwards(int32_t node);
+	void collect_leaves(int32_t node, std::vector<uint32_t>& out) const;
+
+public:
+	static constexpr int32_t NULL_NODE = -1;
+
+	/// @param margin Distance added on every side of a leaf box before inserting it.
+	DynamicBVH(float margin = 0.1f);
+
+	/// @brief Returns the proxy id used to move or remove the leaf later.
+	int32_t insert(const AABB& box, uint32_t user_data);
+	void remove(int32_t proxy);
+	/// @brief Updates the leaf bounds. Returns true if the leaf left its fat box and was reinserted.
+	bool move(int32_t proxy, const AABB& box);
+
+	uint32_t get_user_data(int32_t proxy) const { return nodes[proxy].user_data; }
+	const AABB& get_bounds(int32_t proxy) const { return nodes[proxy].tight; }
+	size_t size() const { return leaf_count; }
+	int32_t get_height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+	/// @brief Appends the user data of every leaf at least partially inside the frustum.
+	void query(const Frustum& frustum, std::vector<uint32_t>& out) const;
+	/// @brief Closest leaf whose box is hit by the ray. Direction does not need to be normalized, distances are in its units.
+	bool raycast(glm::vec3 origin, glm::vec3 dir, float max_dist, uint32_t& hit_data, float& hit_dist) const;
+};
@@ -0,0 +1,130 @@
+#include "gl_state_cache.h"
+
+void GLStateCache::invalidate() {
+	program = UNKNOWN;
+	vertex_array = UNKNOWN;
+	draw_framebuffer = UNKNOWN;
+	read_framebuffer = UNKNOWN;
+	active_unit = UNKNOWN;
+	texture_targets.fill(UNKNOWN);
+	textures.fill(UNKNOWN);
+	uniform_buffers.fill(UNKNOWN);
+	viewport = glm::ivec4(-1);
+	cull_face = UNKNOWN;
+	depth_func = UNKNOWN;
+	cull_enabled = -1;
+	depth_test_enabled = -1;
+	depth_mask = -1;
+}
+
+bool GLStateCache::changed(bool differs) {
+	if (differs) stats.issued++;
+	else stats.skipped++;
+	return differs;
+}
+
+void GLStateCache::set_capability(uint cap, int& cached, bool state) {
+	if (!changed(cached != (int)state)) return;
+	if (state) glEnable(cap);
+	else glDisable(cap);
+	cached = state;
+}
+
+void GLStateCache::forget_texture(GL_ID texture) {
+	for (uint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+		if (textures[unit] == texture) textures[unit] = UNKNOWN;
+	}
+}
+
+void GLStateCache::forget_program(GL_ID program) {
+	if (this->program == program) this->program = UNKNOWN;
+}
+
+void GLStateCache::use_program(GL_ID program) {
+	if (!changed(this->program != program)) return;
+	glUseProgram(program);
+	this->program = program;
+}
+
+void GLStateCache::bind_vertex_array(GL_ID vao) {
+	if (!changed(vertex_array != vao)) return;
+	glBindVertexArray(vao);
+	vertex_array = vao;
+}
+
+void GLStateCache::bind_texture(uint unit, uint target, GL_ID texture) {
+	if (unit >= MAX_TEXTURE_UNITS) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		active_unit = unit;
+		stats.issued++;
+		return;
+	}
+	if (!changed(textures[unit] != texture || texture_targets[unit] != target)) return;
+	if (active_unit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		active_unit = unit;
+	}
+	glBindTexture(target, texture);
+	textures[unit] = texture;
+	texture_targets[unit] = target;
+}
+
+void GLStateCache::bind_texture(uint target, GL_ID texture) {
+	if (active_unit < MAX_TEXTURE_UNITS) {
+		bind_texture(active_unit, target, texture);
+		return;
+	}
+	// Unknown unit, issue the bind without caching it.
+	stats.issued++;
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::bind_framebuffer(uint target, GL_ID fbo) {
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool differs = (draw && draw_framebuffer != fbo) || (read && read_framebuffer != fbo);
+	if (!changed(differs)) return;
+	glBindFramebuffer(target, fbo);
+	if (draw) draw_framebuffer = fbo;
+	if (read) read_framebuffer = fbo;
+}
+
+void GLStateCache::bind_uniform_buffer(uint binding, GL_ID ubo) {
+	if (binding < MAX_UNIFORM_BINDINGS && !changed(uniform_buffers[binding] != ubo)) return;
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+	if (binding < MAX_UNIFORM_BINDINGS) uniform_buffers[binding] = ubo;
+	else stats.issued++;
+}
+
+void GLStateCache::set_viewport(glm::ivec4 viewport) {
+	if (!changed(this->viewport != viewport)) return;
+	glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+	this->viewport = viewport;
+}
+
+void GLStateCache::set_cull(bool enabled) {
+	set_capability(GL_CULL_FACE, cull_enabled, enabled);
+}
+
+void GLStateCache::set_cull_face(uint face) {
+	if (!changed(cull_face != face)) return;
+	glCullFace(face);
+	cull_face = face;
+}
+
+void GLStateCache::set_depth_test(bool enabled) {
+	set_capability(GL_DEPTH_TEST, depth_test_enabled, enabled);
+}
+
+void GLStateCache::set_depth_mask(bool write) {
+	if (!changed(depth_mask != (int)write)) return;
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	depth_mask = write;
+}
+
+void GLStateCache::set_depth_func(uint func) {
+	if (!changed(depth_func != func)) return;
+	glDepthFunc(func);
+	depth_func = func;
+}
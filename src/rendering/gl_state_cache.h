@@ -0,0 +1,69 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <array>
+
+typedef unsigned int GL_ID;
+typedef unsigned int uint;
+
+struct GLStateStats {
+	uint issued = 0;
+	uint skipped = 0;
+};
+
+/// @brief Mirrors the GL bindings and fixed function state the renderer touches and drops calls that would not change
+/// anything. Any code calling GL directly must call invalidate() afterwards so the next request is issued again.
+class GLStateCache {
+	static const uint MAX_TEXTURE_UNITS = 16;
+	static const uint MAX_UNIFORM_BINDINGS = 8;
+	static const uint UNKNOWN = 0xFFFFFFFF;
+
+	GL_ID program;
+	GL_ID vertex_array;
+	GL_ID draw_framebuffer;
+	GL_ID read_framebuffer;
+	uint active_unit;
+	std::array<uint, MAX_TEXTURE_UNITS> texture_targets;
+	std::array<GL_ID, MAX_TEXTURE_UNITS> textures;
+	std::array<GL_ID, MAX_UNIFORM_BINDINGS> uniform_buffers;
+	glm::ivec4 viewport;
+	uint cull_face;
+	uint depth_func;
+	// -1 unknown, 0 disabled, 1 enabled.
+	int cull_enabled;
+	int depth_test_enabled;
+	int depth_mask;
+
+	GLStateStats stats;
+
+	/// @brief Counts the request and returns true if it has to reach GL.
+	bool changed(bool differs);
+	void set_capability(uint cap, int& cached, bool state);
+
+public:
+	GLStateCache() { invalidate(); }
+
+	/// @brief Forget every cached value, the next request of each kind is always issued.
+	void invalidate();
+	/// @brief Must be called when a texture or program is deleted, GL reuses their names for new objects.
+	void forget_texture(GL_ID texture);
+	void forget_program(GL_ID program);
+	void reset_stats() { stats = GLStateStats(); }
+	const GLStateStats& get_stats() const { return stats; }
+
+	void use_program(GL_ID program);
+	void bind_vertex_array(GL_ID vao);
+	/// @brief Binds a texture on the given unit, switching the active unit only if needed.
+	void bind_texture(uint unit, uint target, GL_ID texture);
+	/// @brief Binds a texture on the current unit, used when uploading data.
+	void bind_texture(uint target, GL_ID texture);
+	/// @brief Target can be GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER.
+	void bind_framebuffer(uint target, GL_ID fbo);
+	void bind_uniform_buffer(uint binding, GL_ID ubo);
+	void set_viewport(glm::ivec4 viewport);
+	void set_cull(bool enabled);
+	void set_cull_face(uint face);
+	void set_depth_test(bool enabled);
+	void set_depth_mask(bool write);
+	void set_depth_func(uint func);
+};
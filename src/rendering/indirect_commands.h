@@ -0,0 +1,79 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "render_queue.h"
+
+class GPUGeometryBuffer;
+
+/// @brief Where a mesh lives inside the shared geometry buffer of its vertex layout.
+struct GeometryRange {
+	GPUGeometryBuffer* geometry = nullptr;
+	uint first_vertex = 0;
+	uint vertex_count = 0;
+	uint first_index = 0;
+	uint index_count = 0;
+};
+
+/// @brief Layout mandated by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+	uint count;
+	uint instance_count;
+	uint first_index;
+	int base_vertex;
+	uint base_instance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20);
+
+/// @brief Consecutive commands sharing a material and geometry buffer, submitted with a single multi draw.
+struct IndirectBatch {
+	GPUMaterial* material;
+	GPUGeometryBuffer* geometry;
+	uint first_command;
+	uint command_count;
+};
+
+/// @brief Turns a sorted render queue into indirect draw commands and the instance data they index. Does not touch GL,
+/// the caller uploads the arrays and issues the draws.
+class IndirectCommandBuilder {
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<IndirectBatch> batches;
+	std::vector<InstanceData> instances;
+
+public:
+	void clear() { commands.clear(); batches.clear(); instances.clear(); }
+
+	/// @brief Items sharing a material and mesh must be contiguous, as they are after RenderQueue::sort().
+	/// @param range_of Callable returning the GeometryRange of a GPUMesh*.
+	template <typename RangeOf>
+	void build(const std::vector<DrawItem>& items, RangeOf range_of) {
+		clear();
+		size_t first = 0;
+		while (first < items.size()) {
+			auto& item = items[first];
+			size_t last = first + 1;
+			while (last < items.size() && items[last].material == item.material && items[last].mesh == item.mesh) last++;
+
+			GeometryRange range = range_of(item.mesh);
+			if (batches.empty() || batches.back().material != item.material || batches.back().geometry != range.geometry) {
+				batches.push_back(IndirectBatch{ .material = item.material, .geometry = range.geometry, .first_command = (uint)commands.size(), .command_count = 0 });
+			}
+
+			commands.push_back(DrawElementsIndirectCommand{
+				.count = range.index_count,
+				.instance_count = (uint)(last - first),
+				.first_index = range.first_index,
+				.base_vertex = (int)range.first_vertex,
+				.base_instance = (uint)instances.size(),
+			});
+			batches.back().command_count++;
+
+			for (size_t i = first; i < last; i++) instances.push_back(*items[i].instance);
+			first = last;
+		}
+	}
+
+	const std::vector<DrawElementsIndirectCommand>& get_commands() const { return commands; }
+	const std::vector<IndirectBatch>& get_batches() const { return batches; }
+	const std::vector<InstanceData>& get_instances() const { return instances; }
+};
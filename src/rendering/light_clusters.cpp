@@ -0,0 +1,103 @@
+#include "light_clusters.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cmath>
+
+LightClusterGrid::LightClusterGrid() {
+	std::iota(slice_ids.begin(), slice_ids.end(), 0);
+	cells.resize(CELL_COUNT);
+}
+
+glm::vec2 LightClusterGrid::get_slice_params() const {
+	float log_ratio = std::log(far_plane / near_plane);
+	return glm::vec2(SLICES / log_ratio, -(float)SLICES * std::log(near_plane) / log_ratio);
+}
+
+uint LightClusterGrid::slice_of(float depth) const {
+	glm::vec2 params = get_slice_params();
+	float slice = std::floor(std::log(std::max(depth, near_plane)) * params.x + params.y);
+	return (uint)std::clamp(slice, 0.0f, (float)(SLICES - 1));
+}
+
+void LightClusterGrid::rebuild_cell_bounds(const glm::mat4& proj) {
+	bounds_proj = proj;
+	near_plane = proj[3][2] / (proj[2][2] - 1.0f);
+	far_plane = proj[3][2] / (proj[2][2] + 1.0f);
+
+	// View space ray through every tile corner, scaled so z = -1 and multiplied by the slice depths.
+	glm::mat4 inv_proj = glm::inverse(proj);
+	auto corner_ray = [&inv_proj](float x, float y) {
+		glm::vec4 p = inv_proj * glm::vec4(x, y, -1.0f, 1.0f);
+		glm::vec3 v = glm::vec3(p) / p.w;
+		return v / -v.z;
+	};
+
+	cell_bounds.resize(CELL_COUNT);
+	for (uint s = 0; s < SLICES; s++) {
+		float slice_near = near_plane * std::pow(far_plane / near_plane, (float)s / SLICES);
+		float slice_far = near_plane * std::pow(far_plane / near_plane, (float)(s + 1) / SLICES);
+		for (uint y = 0; y < TILES_Y; y++) {
+			for (uint x = 0; x < TILES_X; x++) {
+				float x0 = -1.0f + 2.0f * x / TILES_X, x1 = -1.0f + 2.0f * (x + 1) / TILES_X;
+				float y0 = -1.0f + 2.0f * y / TILES_Y, y1 = -1.0f + 2.0f * (y + 1) / TILES_Y;
+				glm::vec3 rays[4] = { corner_ray(x0, y0), corner_ray(x1, y0), corner_ray(x0, y1), corner_ray(x1, y1) };
+
+				AABB box;
+				for (auto& ray : rays) {
+					box.expand(ray * slice_near);
+					box.expand(ray * slice_far);
+				}
+				cell_bounds[(s * TILES_Y + y) * TILES_X + x] = box;
+			}
+		}
+	}
+}
+
+void LightClusterGrid::bin_slice(uint s) {
+	auto& bins = slices[s];
+	bins.lights.clear();
+	bins.indices.clear();
+	for (uint i = 0; i < (uint)view_lights.size(); i++) {
+		if (light_slices[i].x <= s && s <= light_slices[i].y) bins.lights.push_back(i);
+	}
+
+	for (uint t = 0; t < TILE_COUNT; t++) {
+		auto& box = cell_bounds[s * TILE_COUNT + t];
+		uint offset = (uint)bins.indices.size();
+		for (auto i : bins.lights) {
+			glm::vec3 center = glm::vec3(view_lights[i]);
+			glm::vec3 closest = glm::clamp(center, box.min, box.max);
+			glm::vec3 delta = center - closest;
+			if (glm::dot(delta, delta) <= view_lights[i].w * view_lights[i].w) bins.indices.push_back(i);
+		}
+		bins.cells[t] = glm::uvec2(offset, (uint)bins.indices.size() - offset);
+	}
+}
+
+void LightClusterGrid::build(const glm::mat4& view, const glm::mat4& proj, const std::vector<ClusterLight>& lights) {
+	if (proj != bounds_proj) rebuild_cell_bounds(proj);
+
+	view_lights.clear();
+	light_slices.clear();
+	for (auto& light : lights) {
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		float depth = -center.z;
+		view_lights.push_back(glm::vec4(center, light.range));
+		// Lights fully behind the camera or past the far plane get an empty slice range.
+		if (depth + light.range < near_plane || depth - light.range > far_plane) light_slices.push_back(glm::uvec2(1, 0));
+		else light_slices.push_back(glm::uvec2(slice_of(depth - light.range), slice_of(depth + light.range)));
+	}
+
+	std::for_each(std::execution::par, slice_ids.begin(), slice_ids.end(), [this](uint s) { bin_slice(s); });
+
+	indices.clear();
+	for (uint s = 0; s < SLICES; s++) {
+		uint base = (uint)indices.size();
+		auto& bins = slices[s];
+		indices.insert(indices.end(), bins.indices.begin(), bins.indices.end());
+		for (uint t = 0; t < TILE_COUNT; t++) {
+			cells[s * TILE_COUNT + t] = glm::uvec2(base + bins.cells[t].x, bins.cells[t].y);
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "bounds.h"
+
+/// @brief Point light as seen by the cluster binning, in world space.
+struct ClusterLight {
+	glm::vec3 position;
+	float range;
+};
+
+/// @brief Splits the camera frustum in a froxel grid (screen tiles times exponential depth slices) and lists the point
+/// lights touching every cell. Binning runs on the CPU with one task per depth slice. The output is laid out for texture
+/// buffers: one (offset, count) pair per cell pointing into a flat light index list.
+class LightClusterGrid {
+public:
+	static constexpr uint TILES_X = 16;
+	static constexpr uint TILES_Y = 9;
+	static constexpr uint SLICES = 24;
+	static constexpr uint TILE_COUNT = TILES_X * TILES_Y;
+	static constexpr uint CELL_COUNT = TILE_COUNT * SLICES;
+
+private:
+	struct SliceBins {
+		std::vector<uint32_t> lights; // Lights whose depth range overlaps the slice.
+		std::vector<uint32_t> indices;
+		std::array<glm::uvec2, TILE_COUNT> cells;
+	};
+
+	glm::mat4 bounds_proj = glm::mat4(0.0f);
+	float near_plane = 0.1f;
+	float far_plane = 100.0f;
+	std::vector<AABB> cell_bounds; // View space, rebuilt when the projection changes.
+	std::vector<glm::vec4> view_lights;
+	std::vector<glm::uvec2> light_slices;
+	std::array<SliceBins, SLICES> slices;
+	std::array<uint, SLICES> slice_ids;
+
+	std::vector<glm::uvec2> cells;
+	std::vector<uint32_t> indices;
+
+	void rebuild_cell_bounds(const glm::mat4& proj);
+	uint slice_of(float depth) const;
+	void bin_slice(uint slice);
+
+public:
+	LightClusterGrid();
+
+	/// @brief Bins the lights for a perspective camera. Light indices in the output refer to the given list.
+	void build(const glm::mat4& view, const glm::mat4& proj, const std::vector<ClusterLight>& lights);
+
+	const std::vector<glm::uvec2>& get_cells() const { return cells; }
+	const std::vector<uint32_t>& get_indices() const { return indices; }
+	/// @brief Scale and bias turning log(view depth) into a slice index.
+	glm::vec2 get_slice_params() const;
+};
@@ -0,0 +1,26 @@
+#include "pixel_format.h"
+
+uint get_block_bytes(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::RGBA8:
+		return 4;
+	case PixelFormat::BC1:
+		return 8;
+	case PixelFormat::BC3:
+	case PixelFormat::BC5:
+	case PixelFormat::BC7:
+		return 16;
+	}
+	return 0;
+}
+
+size_t get_image_bytes(PixelFormat format, glm::uvec2 size) {
+	if (!is_block_compressed(format)) return (size_t)size.x * size.y * get_block_bytes(format);
+	return (size_t)((size.x + 3) / 4) * ((size.y + 3) / 4) * get_block_bytes(format);
+}
+
+uint get_mip_count(glm::uvec2 size) {
+	uint count = 1;
+	for (uint largest = glm::max(size.x, size.y); largest > 1; largest /= 2) count++;
+	return count;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+typedef unsigned int uint;
+
+/// @brief How texture pixels are stored. Block compressed formats encode 4x4 pixel blocks, partial blocks at the
+/// edges of small mips still take a whole block.
+enum class PixelFormat : uint8_t {
+	RGBA8 = 0,
+	BC1, // RGB, 8 bytes per block.
+	BC3, // RGBA, 16 bytes per block, alpha stored separately from color.
+	BC5, // RG, 16 bytes per block, for two channel data like normal maps.
+	BC7, // RGBA, 16 bytes per block, best quality.
+};
+
+/// @brief One level of a mip chain, data packed in its pixel format without row padding.
+struct TextureMip {
+	glm::uvec2 size;
+	std::span<const std::byte> data;
+};
+
+inline bool is_block_compressed(PixelFormat format) { return format != PixelFormat::RGBA8; }
+/// @brief Bytes per 4x4 block, or per pixel for uncompressed formats.
+uint get_block_bytes(PixelFormat format);
+size_t get_image_bytes(PixelFormat format, glm::uvec2 size);
+/// @brief Levels in a full chain down to 1x1.
+uint get_mip_count(glm::uvec2 size);
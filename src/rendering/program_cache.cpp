@@ -0,0 +1,130 @@
+#include "program_cache.h"
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "../utils.h"
+#include "../logging.h"
+
+const char PROGRAM_BINARY_MAGIC[4] = { 'S', 'W', 'M', 'P' };
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+struct ProgramBinaryHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t size;
+	double compile_ms;
+};
+
+void ProgramCache::init(std::string folder) {
+	this->folder = folder;
+	GLint formats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	supported = formats > 0;
+	if (!supported) Console::log_warning("Program binaries not supported, shaders are compiled on every launch.");
+
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		auto value = reinterpret_cast<const char*>(glGetString(name));
+		if (value) driver_hash = utils::hash_bytes(value, std::strlen(value), driver_hash);
+	}
+}
+
+std::string ProgramCache::get_path(uint64_t key) const {
+	return std::format("{}/{:016x}.bin", folder, key);
+}
+
+uint64_t ProgramCache::get_key(const char* vert, const char* frag) const {
+	uint64_t key = utils::hash_bytes(&driver_hash, sizeof(driver_hash));
+	key = utils::hash_bytes(vert, std::strlen(vert), key);
+	// Separates the sources so moving text from one stage to the other changes the key.
+	key = utils::hash_bytes("\0", 1, key);
+	return utils::hash_bytes(frag, std::strlen(frag), key);
+}
+
+GL_ID ProgramCache::load(uint64_t key) {
+	if (!is_active()) return 0;
+	auto start = std::chrono::steady_clock::now();
+	auto path = get_path(key);
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return 0;
+
+	ProgramBinaryHeader header;
+	std::vector<char> binary;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	bool valid = file && std::memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC)) == 0
+		&& header.version == PROGRAM_BINARY_VERSION && header.key == key;
+	if (valid) {
+		binary.resize(header.size);
+		file.read(binary.data(), binary.size());
+		valid = (bool)file;
+	}
+	file.close();
+
+	GL_ID program = 0;
+	if (valid) {
+		program = glCreateProgram();
+		glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+		int success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	if (!program) {
+		Console::log_verbose("Program binary {} rejected, compiling from source.", path);
+		stats.rejected++;
+		std::error_code error;
+		std::filesystem::remove(path, error);
+		return 0;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	stats.hits++;
+	stats.saved_ms += header.compile_ms - elapsed.count();
+	Console::log_info("Program cache hit {:016x}: {:.2f} ms instead of {:.2f} ms. {} hits, {} misses, {:.1f} ms saved so far.",
+		key, elapsed.count(), header.compile_ms, stats.hits, stats.misses, stats.saved_ms);
+	return program;
+}
+
+void ProgramCache::store(uint64_t key, GL_ID program, double compile_ms) {
+	if (!is_active()) return;
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	ProgramBinaryHeader header = {};
+	std::memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC));
+	header.version = PROGRAM_BINARY_VERSION;
+	header.key = key;
+	header.compile_ms = compile_ms;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	header.format = format;
+	header.size = (uint32_t)length;
+
+	std::error_code error;
+	std::filesystem::create_directories(folder, error);
+	auto path = get_path(key);
+	auto temp_path = std::format("{}.{}.tmp", path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file) {
+			Console::log_warning("Could not write program binary {}", temp_path);
+			return;
+		}
+	}
+	std::filesystem::rename(temp_path, path, error);
+	if (error) Console::log_warning("Could not replace program binary {}: {}", path, error.message());
+
+	Console::log_info("Program cache miss {:016x}: compiled in {:.2f} ms. {} hits, {} misses, {:.1f} ms saved so far.",
+		key, compile_ms, stats.hits, stats.misses, stats.saved_ms);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <GL/glew.h>
+#include <string>
+#include <cstdint>
+
+typedef unsigned int GL_ID;
+typedef unsigned int uint;
+
+struct ProgramCacheStats {
+	uint hits = 0;
+	uint misses = 0;
+	/// @brief Binaries the driver refused, usually after a driver update the key did not catch.
+	uint rejected = 0;
+	/// @brief Compile time the hits would have taken, as measured when they were cached, minus the time loading them.
+	double saved_ms = 0.0;
+};
+
+/// @brief Linked programs saved to disk with glGetProgramBinary, so later launches skip compiling and linking. Binaries
+/// are keyed by the sources and the driver, anything the driver rejects anyway is compiled again and replaced.
+class ProgramCache {
+	std::string folder;
+	bool supported = false;
+	uint64_t driver_hash = 0;
+	ProgramCacheStats stats;
+
+	std::string get_path(uint64_t key) const;
+
+public:
+	bool enabled = true;
+
+	/// @brief Needs a current GL context, binaries only load on the driver that made them.
+	void init(std::string folder);
+	bool is_active() const { return enabled && supported; }
+	/// @brief Hash of the sources and the driver vendor, renderer and version. Defines are part of the sources.
+	uint64_t get_key(const char* vert, const char* frag) const;
+	/// @brief Creates a linked program from the cached binary. Zero if there is none or the driver rejected it.
+	GL_ID load(uint64_t key);
+	/// @brief Saves the binary of a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+	void store(uint64_t key, GL_ID program, double compile_ms);
+	void record_miss() { stats.misses++; }
+	const ProgramCacheStats& get_stats() const { return stats; }
+};
@@ -0,0 +1,49 @@
+#include "range_allocator.h"
+#include <algorithm>
+
+uint RangeAllocator::allocate(uint count) {
+	if (count == 0) return INVALID;
+
+	for (size_t i = 0; i < free_ranges.size(); i++) {
+		auto& range = free_ranges[i];
+		if (range.count < count) continue;
+
+		uint offset = range.offset;
+		range.offset += count;
+		range.count -= count;
+		if (range.count == 0) free_ranges.erase(free_ranges.begin() + i);
+		free_count -= count;
+		return offset;
+	}
+	return INVALID;
+}
+
+void RangeAllocator::free(uint offset, uint count) {
+	if (count == 0 || offset == INVALID) return;
+
+	auto next = std::lower_bound(free_ranges.begin(), free_ranges.end(), offset,
+		[](const FreeRange& range, uint offset) { return range.offset < offset; });
+	auto it = free_ranges.insert(next, FreeRange{ offset, count });
+	free_count += count;
+
+	// Merge with the following range, then with the previous one.
+	auto after = it + 1;
+	if (after != free_ranges.end() && it->offset + it->count == after->offset) {
+		it->count += after->count;
+		it = free_ranges.erase(after) - 1;
+	}
+	if (it != free_ranges.begin()) {
+		auto before = it - 1;
+		if (before->offset + before->count == it->offset) {
+			before->count += it->count;
+			free_ranges.erase(it);
+		}
+	}
+}
+
+void RangeAllocator::grow(uint new_capacity) {
+	if (new_capacity <= capacity) return;
+	uint old_capacity = capacity;
+	capacity = new_capacity;
+	free(old_capacity, new_capacity - old_capacity);
+}
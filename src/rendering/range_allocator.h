@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+/// @brief First fit allocator over a linear range of elements. Only keeps the bookkeeping, the storage it describes
+/// lives elsewhere (usually a GPU buffer). Freed ranges are merged with their neighbours.
+class RangeAllocator {
+	struct FreeRange {
+		uint offset;
+		uint count;
+	};
+
+	std::vector<FreeRange> free_ranges; // Sorted by offset.
+	uint capacity = 0;
+	uint free_count = 0;
+
+public:
+	static constexpr uint INVALID = UINT32_MAX;
+
+	/// @brief Returns the offset of the range or INVALID if no free range is big enough.
+	uint allocate(uint count);
+	void free(uint offset, uint count);
+	/// @brief Extends the managed range, the new elements are free.
+	void grow(uint new_capacity);
+
+	uint get_capacity() const { return capacity; }
+	uint get_free_count() const { return free_count; }
+};
@@ -0,0 +1,49 @@
+#include "render_queue.h"
+#include <array>
+#include <cstring>
+
+RenderQueueStats& RenderQueueStats::operator +=(const RenderQueueStats& other) {
+	draws += other.draws;
+	instances += other.instances;
+	culled += other.culled;
+	shader_changes += other.shader_changes;
+	material_changes += other.material_changes;
+	mesh_changes += other.mesh_changes;
+	return *this;
+}
+
+uint64_t RenderQueue::make_key(RenderPass pass, uint shader, uint material, uint mesh, float depth) {
+	// Positive floats keep their order when compared as integers, so the top bits are a cheap depth quantization.
+	depth = depth > 0.0f ? depth : 0.0f;
+	uint32_t depth_bits;
+	std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+	uint64_t key = ((uint64_t)(pass & 0xF) << 60)
+		| ((uint64_t)(shader & 0xFFF) << 48)
+		| ((uint64_t)(material & 0xFFFF) << 32);
+	// Sorting by mesh would only order depth within each mesh, nearest occluders first is the point of the pre-pass.
+	if (pass == RenderPass::DepthPrePass) return key | ((uint64_t)(depth_bits >> 16) << 16) | (uint64_t)(mesh & 0xFFFF);
+	return key | ((uint64_t)(mesh & 0xFFFF) << 16) | (uint64_t)(depth_bits >> 16);
+}
+
+void RenderQueue::sort() {
+	if (items.size() < 2) return;
+	scratch.resize(items.size());
+
+	for (uint shift = 0; shift < 64; shift += 8) {
+		std::array<size_t, 256> offsets = {};
+		for (auto& item : items) offsets[(item.key >> shift) & 0xFF]++;
+
+		// Every item shares this byte, the pass would not move anything.
+		if (offsets[(items[0].key >> shift) & 0xFF] == items.size()) continue;
+
+		size_t sum = 0;
+		for (auto& offset : offsets) {
+			size_t count = offset;
+			offset = sum;
+			sum += count;
+		}
+		for (auto& item : items) scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+		items.swap(scratch);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+class GPUMaterial;
+class GPUMesh;
+
+enum RenderPass {
+	ShadowPass = 0,
+	DepthPrePass,
+	OpaquePass,
+};
+
+/// @brief Per instance vertex attributes, see GPUGeometryBuffer::bind_instances.
+struct InstanceData {
+	glm::mat4 model;
+	glm::mat3 normal; // Inverse transpose of the model basis, computed when the transform changes.
+};
+
+struct DrawItem {
+	uint64_t key;
+	GPUMaterial* material;
+	GPUMesh* mesh;
+	const InstanceData* instance;
+};
+
+struct RenderQueueStats {
+	uint draws = 0;
+	uint instances = 0;
+	uint culled = 0;
+	uint shader_changes = 0;
+	uint material_changes = 0;
+	uint mesh_changes = 0;
+
+	RenderQueueStats& operator +=(const RenderQueueStats& other);
+};
+
+/// @brief Collects draw items for a pass and orders them by a 64 bit key so submission changes as little state as possible.
+/// Key layout from most to least significant: pass (4), shader (12), material (16), mesh (16), depth (16). The depth
+/// pre-pass draws everything with one material, so its key swaps mesh and depth to sort front to back.
+class RenderQueue {
+	std::vector<DrawItem> items;
+	std::vector<DrawItem> scratch;
+
+public:
+	static uint64_t make_key(RenderPass pass, uint shader, uint material, uint mesh, float depth);
+
+	void clear() { items.clear(); }
+	void push(const DrawItem& item) { items.push_back(item); }
+	/// @brief LSD radix sort on the key, skipping bytes that are equal across every item.
+	void sort();
+
+	size_t size() const { return items.size(); }
+	const std::vector<DrawItem>& get_items() const { return items; }
+};
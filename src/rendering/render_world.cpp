@@ -5,10 +5,87 @@ RenderWorld::RenderWorld() {
 	env = App::get_render_backend()->enviroments.create();
 }
 
+void RenderWorld::add_camera(Camera* camera) {
+	cameras.push_back(App::get_render_backend()->cameras.get_handle(camera));
+}
+
+void RenderWorld::add_light(Light* light) {
+	lights.push_back(App::get_render_backend()->lights.get_handle(light));
+}
+
+void RenderWorld::add_material(GPUMaterial* material) {
+	materials.push_back(App::get_render_backend()->materials.get_handle(material));
+}
+
+void RenderWorld::add_visual(GPUVisual* visual) {
+	auto handle = App::get_render_backend()->visuals.get_handle(visual);
+	if (visual_proxies.contains(handle)) return;
+
+	visuals.push_back(handle);
+	record_change(visual->get_world_bounds());
+	visual_proxies[handle] = VisualProxy{
+		.node = visual_tree.insert(visual->get_world_bounds(), handle.get_raw()),
+		.version = visual->get_version(),
+	};
+}
+
+template<typename T, typename P>
+static void remove_invalid_handles(std::vector<Handle<T>>& handles, const P& pool) {
+	std::erase_if(handles, [&pool](Handle<T> h) { return !pool.is_valid(h); });
+}
+
+void RenderWorld::remove_destroyed() {
+	auto render_bd = App::get_render_backend();
+	remove_invalid_handles(cameras, render_bd->cameras);
+	remove_invalid_handles(lights, render_bd->lights);
+	remove_invalid_handles(materials, render_bd->materials);
+	remove_invalid_handles(visuals, render_bd->visuals);
+
+	for (auto it = visual_proxies.begin(); it != visual_proxies.end();) {
+		if (render_bd->visuals.is_valid(it->first)) { it++; continue; }
+		record_change(visual_tree.get_bounds(it->second.node));
+		visual_tree.remove(it->second.node);
+		it = visual_proxies.erase(it);
+	}
+}
+
+void RenderWorld::update_visual_tree() {
+	auto& pool = App::get_render_backend()->visuals;
+	for (auto& [handle, proxy] : visual_proxies) {
+		auto visual = pool.get(handle);
+		if (!visual || visual->get_version() == proxy.version) continue;
+		auto bounds = visual->get_world_bounds();
+		record_change(visual_tree.get_bounds(proxy.node));
+		record_change(bounds);
+		visual_tree.move(proxy.node, bounds);
+		proxy.version = visual->get_version();
+	}
+}
+
+void RenderWorld::query_visuals(const Frustum& frustum, std::vector<GPUVisual*>& out) {
+	auto& pool = App::get_render_backend()->visuals;
+	query_results.clear();
+	visual_tree.query(frustum, query_results);
+	for (auto raw : query_results) {
+		if (auto visual = pool.get(Handle<GPUVisual>::from_raw(raw))) out.push_back(visual);
+	}
+}
+
+Option<GPUVisual*> RenderWorld::raycast_visuals(glm::vec3 origin, glm::vec3 dir, float max_dist) {
+	uint32_t raw;
+	float dist;
+	if (!visual_tree.raycast(origin, dir, max_dist, raw, dist)) return None;
+	auto visual = App::get_render_backend()->visuals.get(Handle<GPUVisual>::from_raw(raw));
+	if (!visual) return None;
+	return visual;
+}
+
 Option<Camera*> RenderWorld::get_active_camera() {
 	Option<Camera*> active = None;
 	int min_priority = 999999;
-	for (auto c : cameras) {
+	for (auto h : cameras) {
+		auto c = App::get_render_backend()->cameras.get(h);
+		if (!c) continue;
 		if (c->priority < min_priority) {
 			min_priority = c->priority;
 			active = c;
@@ -37,7 +114,7 @@ Viewport::Viewport() {
 }
 
 void Viewport::use_viewport() {
-	glViewport(0, 0, size.x, size.y);
+	App::get_render_backend()->gl_state.set_viewport({ 0, 0, size.x, size.y });
 	fbo->use_framebuffer();
 }
 
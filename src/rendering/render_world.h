@@ -5,6 +5,9 @@
 #include "boost/signals2.hpp"
 #include <imgui.h>
 #include "../venum.h"
+#include "../Handle.h"
+#include "bvh.h"
+#include <unordered_map>
 
 class Camera;
 struct Light;
@@ -37,10 +40,21 @@ public:
 	glm::vec3 ambient_color = glm::vec3(0.3f, 0.3f, 0.1f);
 	float ambient_intensity = 0.3f;
 
-	GPUVisual* skybox;
+	Handle<GPUVisual> skybox;
 };
 
 class RenderWorld {
+	struct VisualProxy {
+		int32_t node;
+		uint version;
+	};
+
+	DynamicBVH visual_tree;
+	std::unordered_map<Handle<GPUVisual>, VisualProxy> visual_proxies;
+	std::vector<uint32_t> query_results;
+	std::vector<AABB> changed_bounds;
+
+	void record_change(const AABB& box) { if (!box.is_empty()) changed_bounds.push_back(box); }
 
 public:
 	RenderWorld();
@@ -48,15 +62,37 @@ public:
 	Option<Viewport*> vp;
 	Option<RenderEnviroment*> env;
 	Option<ImDrawData*> imgui_draw_cmd;
+	/// @brief Lays down depth before shading so fragments hidden behind others skip the lighting. Pays off on scenes
+	/// with a lot of overdraw, otherwise it only adds a geometry pass.
+	bool depth_prepass = false;
 
 	boost::signals2::signal<void()> on_pre_render;
 	boost::signals2::signal<void()> on_ui_pass;
 	boost::signals2::signal<void()> on_post_render;
 
-	std::vector<Camera*> cameras;
-	std::vector<Light*> lights;
-	std::vector<GPUMaterial*> materials;
-	std::vector<GPUVisual*> visuals;
+	std::vector<Handle<Camera>> cameras;
+	std::vector<Handle<Light>> lights;
+	std::vector<Handle<GPUMaterial>> materials;
+	std::vector<Handle<GPUVisual>> visuals;
+
+	void add_camera(Camera* camera);
+	void add_light(Light* light);
+	void add_material(GPUMaterial* material);
+	void add_visual(GPUVisual* visual);
+
+	/// @brief Drops handles to resources that were destroyed in the backend since the last call.
+	void remove_destroyed();
+	/// @brief Refits the bounds of visuals whose transform or model changed since the last call.
+	void update_visual_tree();
+	/// @brief World bounds visuals had before and after being added, moved or destroyed since the last clear. Used to
+	/// find which cached shadows a change can reach.
+	const std::vector<AABB>& get_changed_bounds() const { return changed_bounds; }
+	void clear_changed_bounds() { changed_bounds.clear(); }
+
+	/// @brief Appends every visual at least partially inside the frustum.
+	void query_visuals(const Frustum& frustum, std::vector<GPUVisual*>& out);
+	/// @brief Closest visual whose world bounds are hit by the ray, meant for picking.
+	Option<GPUVisual*> raycast_visuals(glm::vec3 origin, glm::vec3 dir, float max_dist = FLT_MAX);
 
 	Option<Camera*> get_active_camera();
 
@@ -2,6 +2,9 @@
 #include "../core.h"
 #include <string>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
+#include <cfloat>
+#include <chrono>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "imgui.h"
@@ -9,7 +12,21 @@
 #include "../imgui/imgui_impl_opengl3.h"
 #include "../logging.h"
 
-const int SHADOW_RES = 1024;
+const int SHADOW_ATLAS_RES = 2048;
+const int SHADOW_ATLAS_LAYERS = 4;
+// Largest tiles each light type asks the atlas for.
+const uint CASCADE_SHADOW_RES = 1024;
+const uint POINT_SHADOW_RES = 512;
+
+static GLStateCache& gl_state() {
+	return App::get_render_backend()->gl_state;
+}
+
+namespace uniforms {
+	static const UniformId view_proj("matViewProj");
+	static const UniformId oct_normals("octNormals");
+	static const UniformId oct_tangents("octTangents");
+}
 
 RendererBackend::RendererBackend() {
 }
@@ -52,6 +69,16 @@ Result<void, RendererError> RendererBackend::setup_glew() {
 }
 
 Result<void, RendererError> RendererBackend::setup_internals() {
+	// Created first, every mesh suballocates from it.
+	geometry = geometry_buffers.create();
+	// Before the first shader is loaded.
+	program_cache.init("shader_cache");
+	multi_draw_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+	if (!multi_draw_indirect) Console::log_warning("glMultiDrawElementsIndirect not supported, falling back to one draw per mesh.");
+	bc_compression = GLEW_EXT_texture_compression_s3tc && (GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc)
+		&& (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc);
+	if (!bc_compression) Console::log_warning("Block compressed textures not supported, textures are uploaded uncompressed.");
+
 	auto rshadowmap_shader = App::get_asset_backend()->load_file<GPUShader>("depth");
 	if (!rshadowmap_shader) { return Error(RendererError{ .error = "Failed to load the depth shader." }); }
 	auto shadowmap_shader = rshadowmap_shader.value();
@@ -60,11 +87,23 @@ Result<void, RendererError> RendererBackend::setup_internals() {
 
 	shadows_fbo = frame_buffers.create();
 
+	shadow_atlas.set_size(SHADOW_ATLAS_RES, SHADOW_ATLAS_LAYERS);
 	shadowmap_textures = texture_arrays.create();
-	shadowmap_textures->set_as_depth(SHADOW_RES, SHADOW_RES, 16, NULL);
+	shadowmap_textures->set_as_depth(SHADOW_ATLAS_RES, SHADOW_ATLAS_RES, SHADOW_ATLAS_LAYERS, NULL);
 	shadowmap_textures->set_filter(TextureFilter::Linear);
 	shadowmap_textures->set_wrap(TextureWrap::ClampBorder);
 	shadowmap_textures->set_border_color(glm::vec4(1.0, 1.0, 1.0, 1.0));
+
+	frame_ubo = uniform_buffers.create();
+	instance_buffer = instance_buffers.create();
+	indirect_buffer = indirect_buffers.create();
+
+	light_buffer = texture_buffers.create();
+	light_buffer->set_format(GL_RGBA32F);
+	cluster_cells_buffer = texture_buffers.create();
+	cluster_cells_buffer->set_format(GL_RG32UI);
+	cluster_indices_buffer = texture_buffers.create();
+	cluster_indices_buffer->set_format(GL_R32UI);
 }
 
 Result<void, RendererError> RendererBackend::setup_imgui() {
@@ -106,7 +145,7 @@ void RendererBackend::debug_backend(RenderWorld* world) {
 	if (!is_imgui_installed()) return;
 
 	bool active = true;
-	world->on_ui_pass.connect([this, &active]() {
+	world->on_ui_pass.connect([this, world, &active]() {
 		ImGui::Begin("Render Backend", &active);
 		for (auto m : materials) {
 			if (auto material = static_cast<GPUPbrMaterial*>(m)) {
@@ -115,23 +154,81 @@ void RendererBackend::debug_backend(RenderWorld* world) {
 				ImGui::SliderFloat("Roughness", &material->roughness, 0, 1);
 			}
 		}
+		ImGui::Text("GL state calls issued: %u skipped: %u", gl_frame_stats.issued, gl_frame_stats.skipped);
+		ImGui::Text("Draws: %u Instances: %u Culled: %u Shader changes: %u Material changes: %u Mesh changes: %u",
+			queue_frame_stats.draws, queue_frame_stats.instances, queue_frame_stats.culled, queue_frame_stats.shader_changes, queue_frame_stats.material_changes, queue_frame_stats.mesh_changes);
+		ImGui::Text("Shadow views rendered: %u cached: %u", shadow_stats.rendered, shadow_stats.cached);
+		auto& streaming = texture_streamer.get_stats();
+		ImGui::Text("Streamed textures: %u loading: %u resident: %.1f MB wanted: %.1f MB uploaded: %.1f MB evicted mips: %u",
+			streaming.textures, streaming.loading, streaming.resident_bytes / 1048576.0, streaming.wanted_bytes / 1048576.0, streaming.uploaded_bytes / 1048576.0, streaming.evicted_mips);
+		ImGui::SliderInt("Texture mip bias", &texture_streamer.settings.mip_bias, -2, 4);
+		ImGui::Checkbox("Depth pre-pass", &world->depth_prepass);
+		ImGui::SliderFloat("LOD hysteresis", &lod_settings.hysteresis, 0, 0.5f);
+		const uint min_shadow_bias = 0, max_shadow_bias = 3;
+		ImGui::SliderScalar("Shadow LOD bias", ImGuiDataType_U32, &lod_settings.shadow_bias, &min_shadow_bias, &max_shadow_bias);
+		auto timings = get_pass_timings(world);
+		ImGui::Text("GPU ms shadows: %.3f depth pre-pass: %.3f opaque: %.3f", timings.shadows, timings.depth_prepass, timings.opaque);
 		ImGui::End();
 	});
 }
 
 void RendererBackend::render_worlds() {
+	// Windows and ImGui touch GL outside the cache between frames.
+	gl_state.invalidate();
+	gl_state.reset_stats();
+	queue_stats = RenderQueueStats();
+
 	for (auto w : worlds) {
 		if (!w->is_ready()) continue;
 		auto result = render_world(w);
 		if (!result) std::println("{}", result.error().error);
 	}
+
+	std::erase_if(world_timers, [this](auto& entry) {
+		if (worlds.is_valid(entry.first)) return false;
+		timer_queries.destroy(entry.second.shadows);
+		timer_queries.destroy(entry.second.depth_prepass);
+		timer_queries.destroy(entry.second.opaque);
+		return true;
+	});
+
+	gl_frame_stats = gl_state.get_stats();
+	queue_frame_stats = queue_stats;
+	texture_streamer.update(App::get_asset_backend()->get_workers());
+	compact_pools();
+}
+
+void RendererBackend::compact_pools() {
+	// Only worth the moves once a pool spans several chunks that are mostly holes, like after unloading a level.
+	auto compact = [](auto& pool) {
+		if (pool.capacity() > 64 && pool.get_occupancy() < 0.5f) pool.compact();
+	};
+	compact(visuals);
+	compact(lights);
+	compact(cameras);
 }
 
 Result<void, RendererError> RendererBackend::render_world(RenderWorld* world) {
 	if (!world->is_ready()) return Error(RendererError{ .error = "World not ready to be rendered. Check it was initialized properly." });
 
+	world->remove_destroyed();
+	world->update_visual_tree();
 	auto camera = world->get_active_camera();
-	render_shadowmaps(world->lights, world->visuals);
+	lod_camera = camera.has_value();
+	if (camera) {
+		lod_camera_view = LODView::from_matrices(camera.value()->get_proj_mat(), camera.value()->get_view_mat());
+		glm::ivec2 framebuffer;
+		glfwGetFramebufferSize(get_main_window()->gl_wnd, &framebuffer.x, &framebuffer.y);
+		lod_viewport_height = world->vp ? world->vp.value()->get_size().y : (float)framebuffer.y;
+	}
+	gather_lights(world);
+	auto& timers = get_world_timers(world);
+	timers.shadows->begin();
+	render_shadowmaps(world);
+	timers.shadows->end();
+	world->clear_changed_bounds();
+	update_light_clusters(world);
+	update_frame_data(world);
 	update_material_globals(world);
 
 	if (world->vp) world->vp.value()->use_viewport();
@@ -143,7 +240,7 @@ Result<void, RendererError> RendererBackend::render_world(RenderWorld* world) {
 
 	if (camera) {
 		render_skybox(world);
-		render_visuals(camera.value()->get_proj_mat(), camera.value()->get_view_mat(), world->visuals, nullptr);
+		render_opaque(world, camera.value()->get_proj_mat(), camera.value()->get_view_mat());
 	}
 
 	if (is_imgui_installed() && world->imgui_draw_cmd) {
@@ -163,32 +260,180 @@ Result<void, RendererError> RendererBackend::render_world(RenderWorld* world) {
 	GPUFrameBuffer::unbind_framebuffer();
 }
 
-void RendererBackend::render_shadowmaps(std::vector<Light*> lights, std::vector<GPUVisual*> visuals) {
+const std::vector<GPUVisual*>& RendererBackend::cull_visuals(RenderWorld* world, glm::mat4 view_proj) {
+	visible_visuals.clear();
+	world->query_visuals(Frustum::from_matrix(view_proj), visible_visuals);
+	queue_stats.culled += (uint)(world->visuals.size() - visible_visuals.size());
+	return visible_visuals;
+}
+
+void RendererBackend::gather_lights(RenderWorld* world) {
+	frame_lights.clear();
+	for (auto h : world->lights) {
+		auto light = lights.get(h);
+		if (light && light->type == LightType::Directional) frame_lights.push_back(FrameLight{ light, -1 });
+	}
+	for (auto h : world->lights) {
+		auto light = lights.get(h);
+		if (light && light->type != LightType::Directional) frame_lights.push_back(FrameLight{ light, -1 });
+	}
 
-	for (size_t i = 0; i < lights.size(); i++) {
-		auto light = lights[i];
+	// Shadow views go to the first casters, lights past the limit render unshadowed.
+	auto camera = world->get_active_camera();
+	shadow_views.clear();
+	shadow_sizes.clear();
+	uint first_view = 0;
+	for (auto& frame_light : frame_lights) {
+		auto light = frame_light.light;
 		if (!light->get_cast_shadows()) continue;
 
-		auto proj = light->build_proj_matrix();
-		auto view = light->build_view_matrix();
+		uint size = get_shadow_importance(light, camera);
+		if (size == 0) continue;
+
+		uint count = 1;
+		if (light->type == LightType::Point) count = 6;
+		else if (camera) count = std::clamp(shadow_cascades.cascades, 2u, MAX_CASCADES);
+		if (first_view + count > MAX_SHADOWS) continue;
+
+		frame_light.shadow_view = (int)first_view;
+		for (uint face = 0; face < count; face++) {
+			shadow_views.push_back(ShadowView{ .light = light, .face = face });
+			shadow_sizes.push_back(size);
+		}
+		first_view += count;
+	}
+
+	// Matrices are built once the tiles are known, cascades snap to the texels of their own tile.
+	shadow_atlas.allocate(shadow_sizes, shadow_tiles);
+	cascade_splits = glm::vec4(0.0f);
+	cascade_count = 0;
+	for (size_t i = 0; i < shadow_views.size(); i++) {
+		auto& shadow_view = shadow_views[i];
+		auto light = shadow_view.light;
+		shadow_view.tile = shadow_tiles[i];
+
+		if (light->type == LightType::Point) {
+			shadow_view.view = light->build_cube_view_matrix(shadow_view.face);
+			shadow_view.proj = light->build_proj_matrix();
+		}
+		else if (camera) {
+			// Splits only depend on the camera, so every directional light shares them.
+			if (shadow_view.face == 0) {
+				fit_shadow_cascades(camera.value()->get_view_mat(), camera.value()->get_proj_mat(), light->dir, shadow_cascades, std::max(shadow_view.tile.size, 1u), cascades);
+				cascade_count = (uint)cascades.size();
+				for (uint c = 0; c < cascade_count; c++) cascade_splits[c] = cascades[c].split_depth;
+			}
+			shadow_view.view = cascades[shadow_view.face].view;
+			shadow_view.proj = cascades[shadow_view.face].proj;
+		}
+		else {
+			shadow_view.view = light->build_view_matrix();
+			shadow_view.proj = light->build_proj_matrix();
+		}
+	}
+}
+
+uint RendererBackend::get_shadow_importance(Light* light, Option<Camera*> camera) {
+	if (light->type == LightType::Directional) return CASCADE_SHADOW_RES;
+	if (!camera) return POINT_SHADOW_RES / 2;
+
+	// Point lights scale with the screen height covered by their range, lights out of view cast nothing visible.
+	auto view = camera.value()->get_view_mat();
+	auto proj = camera.value()->get_proj_mat();
+	BoundingSphere sphere{ .center = light->position, .radius = light->range };
+	if (!Frustum::from_matrix(proj * view).intersects(sphere)) return 0;
+
+	float dist = glm::length(glm::vec3(view * glm::vec4(light->position, 1.0f)));
+	if (dist <= light->range) return POINT_SHADOW_RES;
+	float coverage = light->range / std::sqrt(dist * dist - light->range * light->range) * proj[1][1];
+	return (uint)(std::min(coverage, 1.0f) * POINT_SHADOW_RES);
+}
+
+bool RendererBackend::is_shadow_cached(const ShadowView& shadow_view, const std::vector<AABB>& changed_bounds) const {
+	glm::mat4 view_proj = shadow_view.proj * shadow_view.view;
+	auto cached = std::find_if(shadow_cache.begin(), shadow_cache.end(), [&](const ShadowView& other) {
+		return other.tile == shadow_view.tile && other.proj * other.view == view_proj;
+	});
+	if (cached == shadow_cache.end()) return false;
+
+	auto frustum = Frustum::from_matrix(view_proj);
+	for (auto& box : changed_bounds) {
+		if (frustum.intersects(box)) return false;
+	}
+	return true;
+}
+
+void RendererBackend::render_shadowmaps(RenderWorld* world) {
+	// Tiles only hold shadows of the last world rendered into them.
+	if (shadow_cache_world != world || shadow_cache_bias != lod_settings.shadow_bias) {
+		shadow_cache.clear();
+		shadow_cache_world = world;
+		shadow_cache_bias = lod_settings.shadow_bias;
+	}
+
+	shadow_stats = ShadowStats();
+	next_shadow_cache.clear();
+	auto& changed_bounds = world->get_changed_bounds();
+	for (auto& shadow_view : shadow_views) {
+		auto& tile = shadow_view.tile;
+		if (tile.size == 0) continue;
 
-		//shadows_fbo->set_output_depth(sm->shadowmap);
-		shadows_fbo->set_output_depth(shadowmap_textures, i);
+		if (is_shadow_cached(shadow_view, changed_bounds)) {
+			next_shadow_cache.push_back(shadow_view);
+			shadow_stats.cached++;
+			continue;
+		}
+
+		shadows_fbo->set_output_depth(shadowmap_textures, tile.layer);
 		if (!shadows_fbo->is_complete()) {
 			Console::log_error("Shadowmap frame buffer {} is incompleted. Some shadows might be missing.", shadows_fbo->get_gl_id());
 			continue;
 		}
-		glViewport(0, 0, SHADOW_RES, SHADOW_RES);
+		gl_state.set_viewport({ tile.offset.x, tile.offset.y, tile.size, tile.size });
 		shadows_fbo->use_framebuffer();
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//sm->shadowmap->activate(SamplerID::Albedo);
+		// Only this tile is cleared, the rest of the layer may hold cached shadows.
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(tile.offset.x, tile.offset.y, tile.size, tile.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+
 		shadowmap_textures->activate(SamplerID::Albedo);
-		render_visuals(proj, view, visuals, shadowmap_mat);
+		auto& proj = shadow_view.proj;
+		auto& view = shadow_view.view;
+		lod_shadow_view = LODView::from_matrices(proj, view);
+		render_visuals(RenderPass::ShadowPass, proj, view, cull_visuals(world, proj * view), shadowmap_mat);
+		next_shadow_cache.push_back(shadow_view);
+		shadow_stats.rendered++;
+	}
+	std::swap(shadow_cache, next_shadow_cache);
 
-		GPUFrameBuffer::unbind_framebuffer();
+	GPUFrameBuffer::unbind_framebuffer();
+}
+
+GPUGeometryBuffer* RendererBackend::get_geometry(const VertexLayout& layout) {
+	for (auto buffer : geometry_buffers) {
+		if (buffer->get_layout() == layout) return buffer;
 	}
+	auto buffer = geometry_buffers.create();
+	buffer->set_layout(layout);
+	return buffer;
+}
+
+RendererBackend::WorldTimers& RendererBackend::get_world_timers(RenderWorld* world) {
+	auto [it, inserted] = world_timers.try_emplace(worlds.get_handle(world));
+	if (inserted) it->second = WorldTimers{ timer_queries.create(), timer_queries.create(), timer_queries.create() };
+	return it->second;
+}
 
+PassTimings RendererBackend::get_pass_timings(RenderWorld* world) const {
+	auto it = world_timers.find(worlds.get_handle(world));
+	if (it == world_timers.end()) return PassTimings();
+	return PassTimings{
+		.shadows = it->second.shadows->get_ms(),
+		.depth_prepass = it->second.depth_prepass->get_ms(),
+		.opaque = it->second.opaque->get_ms(),
+	};
 }
 
 void RendererBackend::render_skybox(RenderWorld* world) {
@@ -197,35 +442,174 @@ void RendererBackend::render_skybox(RenderWorld* world) {
 	if (!opt_camera) return;
 	if (!world->env) return;
 
-	auto camera = opt_camera.value();
-	auto view = glm::mat4(glm::mat3(camera->get_view_mat()));
-	auto proj = camera->get_proj_mat();
+	// Camera matrices come from the frame uniform block.
+	auto skybox = visuals.get(world->env.value()->skybox);
+	if (!skybox) return;
 
-	auto env = world->env;
-	auto skybox = env.value()->skybox;
+	gl_state.set_cull_face(GL_FRONT);
+	gl_state.set_depth_mask(false);
+	render_visual(skybox);
+	gl_state.set_depth_mask(true);
+	gl_state.set_cull_face(GL_BACK);
+}
 
-	skybox->get_material()->get_shader()->set_matrix4("projection", proj);
-	skybox->get_material()->get_shader()->set_matrix4("view", view);
+void RendererBackend::render_opaque(RenderWorld* world, glm::mat4 proj, glm::mat4 view) {
+	auto& visible = cull_visuals(world, proj * view);
+	auto& timers = get_world_timers(world);
 
-	glCullFace(GL_FRONT);
-	glDepthMask(GL_FALSE);
-	render_visual(skybox);
-	glDepthMask(GL_TRUE);
-	glCullFace(GL_BACK);
+	if (!world->depth_prepass) {
+		// Otherwise the last pre-pass cost would keep showing next to live opaque timings.
+		timers.depth_prepass->reset();
+		timers.opaque->begin();
+		render_visuals(RenderPass::OpaquePass, proj, view, visible, nullptr);
+		timers.opaque->end();
+		return;
+	}
+
+	// Depth only, front to back across all meshes, see RenderQueue::make_key. The depth shader transforms vertices exactly like pbr.vert so depths match bit for bit.
+	timers.depth_prepass->begin();
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	render_visuals(RenderPass::DepthPrePass, proj, view, visible, shadowmap_mat);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	timers.depth_prepass->end();
+
+	// Every fragment but the visible one fails the depth test before the lighting runs.
+	timers.opaque->begin();
+	gl_state.set_depth_func(GL_EQUAL);
+	gl_state.set_depth_mask(false);
+	render_visuals(RenderPass::OpaquePass, proj, view, visible, nullptr);
+	gl_state.set_depth_mask(true);
+	gl_state.set_depth_func(GL_LESS);
+	timers.opaque->end();
+}
+
+uint RendererBackend::select_lod(GPUVisual* visual, RenderPass pass) {
+	auto model = visual->get_model();
+	uint count = model->get_lod_count();
+	if (count == 1) return 0;
+
+	// Picked without hysteresis, which would make the level depend on the frames before the shadow was cached.
+	if (pass == RenderPass::ShadowPass) {
+		uint lod = model->select_lod(get_screen_size(visual, lod_shadow_view), 0, 0.0f);
+		return glm::min(lod + lod_settings.shadow_bias, count - 1);
+	}
+	if (!lod_camera) return 0;
+
+	uint lod = model->select_lod(get_screen_size(visual, lod_camera_view), visual->get_lod(), lod_settings.hysteresis);
+
+	// The pre-pass and the shading pass select the same level, their depths have to match.
+	visual->set_lod(lod);
+	return lod;
 }
 
-void RendererBackend::render_visuals(glm::mat4 proj, glm::mat4 view, std::vector<GPUVisual*> visuals, GPUMaterial* mat_override = nullptr) {
+RendererBackend::LODView RendererBackend::LODView::from_matrices(glm::mat4 proj, glm::mat4 view) {
+	// Orthographic projections keep 1 in the last element, perspective ones 0.
+	return LODView{ .eye = glm::vec3(glm::inverse(view)[3]), .proj_scale = proj[1][1], .ortho = proj[3][3] == 1.0f };
+}
+
+float RendererBackend::get_screen_size(GPUVisual* visual, const LODView& lod_view) const {
+	auto model = visual->get_model();
+	auto& xform = *visual->get_xform();
+	float scale = glm::max(glm::length(glm::vec3(xform[0])), glm::max(glm::length(glm::vec3(xform[1])), glm::length(glm::vec3(xform[2]))));
+	float radius = model->sphere.radius * scale;
+	// proj_scale is 2 / height for orthographic views, the sphere covers the same fraction at any distance.
+	if (lod_view.ortho) return radius * lod_view.proj_scale;
+	float distance = glm::length(glm::vec3(xform * glm::vec4(model->sphere.center, 1.0f)) - lod_view.eye);
+	return distance > radius ? radius / distance * lod_view.proj_scale : FLT_MAX;
+}
+
+void RendererBackend::render_visuals(RenderPass pass, glm::mat4 proj, glm::mat4 view, const std::vector<GPUVisual*>& visuals, GPUMaterial* mat_override = nullptr) {
+	render_queue.clear();
 	for (auto v : visuals) {
-		auto mvp = proj * view * *v->get_xform();
+		auto model = v->get_model();
 		auto mat = mat_override ? mat_override : v->get_material();
-		mat->get_shader()->set_matrix4("matModel", *v->get_xform());
-		mat->get_shader()->set_matrix4("mvp", mvp);
-		render_visual(mat, v->get_model());
+		if (!model || !mat) continue;
+		auto xform = v->get_xform();
+		float depth = -(view * (*xform)[3]).z;
+		uint shader_id = shaders.get_handle(mat->get_shader()).get_index();
+		uint material_id = materials.get_handle(mat).get_index();
+
+		// Only the shading pass samples the material textures, the sphere covers screen size times the height in pixels.
+		if (pass == RenderPass::OpaquePass && lod_camera) {
+			float pixels = glm::min(get_screen_size(v, lod_camera_view), 1e6f) * lod_viewport_height;
+			for (auto texture : mat->get_textures()) {
+				if (texture) texture_streamer.request(texture, pixels);
+			}
+		}
+
+		for (auto mesh : model->get_lod_meshes(select_lod(v, pass))) {
+			uint mesh_id = meshes.get_handle(mesh).get_index();
+			render_queue.push(DrawItem{
+				.key = RenderQueue::make_key(pass, shader_id, material_id, mesh_id, depth),
+				.material = mat,
+				.mesh = mesh,
+				.instance = v->get_instance(),
+			});
+		}
 	}
+	render_queue.sort();
+	submit_queue(proj * view, render_queue);
+}
+
+void RendererBackend::submit_queue(glm::mat4 view_proj, const RenderQueue& queue) {
+	RenderQueueStats stats;
+	GPUShader* shader = nullptr;
+	GPUMaterial* material = nullptr;
+
+	auto& items = queue.get_items();
+	if (items.empty()) return;
+
+	// The queue is sorted by material and mesh, every run sharing both becomes one command and every material one batch.
+	indirect_commands.build(items, [](const GPUMesh* mesh) { return mesh->get_range(); });
+	auto& commands = indirect_commands.get_commands();
+	instance_buffer->set_data(indirect_commands.get_instances());
+
+	// Meshes live in one shared geometry buffer per vertex layout, vertex arrays only change between layouts.
+	GPUGeometryBuffer* bound_geometry = nullptr;
+	if (multi_draw_indirect) indirect_buffer->set_data(commands);
+
+	for (auto& batch : indirect_commands.get_batches()) {
+		if (batch.geometry != bound_geometry) {
+			bound_geometry = batch.geometry;
+			bound_geometry->use();
+			if (multi_draw_indirect) bound_geometry->bind_instances(instance_buffer->get_gl_id(), 0);
+		}
+
+		material = batch.material;
+		material->use_material();
+		stats.material_changes++;
+		if (material->get_shader() != shader) {
+			shader = material->get_shader();
+			stats.shader_changes++;
+		}
+		shader->set_matrix4(uniforms::view_proj, view_proj);
+		bound_geometry->set_decode_uniforms(shader);
+		stats.mesh_changes += batch.command_count;
+
+		if (multi_draw_indirect) {
+			// base_instance offsets the instance attributes, so every command reads its own matrices.
+			glMultiDrawElementsIndirect(GL_TRIANGLES, bound_geometry->get_gl_index_type(), (void*)(batch.first_command * sizeof(DrawElementsIndirectCommand)), batch.command_count, 0);
+			stats.draws++;
+		}
+		else {
+			for (uint i = batch.first_command; i < batch.first_command + batch.command_count; i++) {
+				auto& cmd = commands[i];
+				bound_geometry->bind_instances(instance_buffer->get_gl_id(), cmd.base_instance * sizeof(InstanceData));
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cmd.count, bound_geometry->get_gl_index_type(), (void*)(size_t)(cmd.first_index * bound_geometry->get_layout().get_index_size()), cmd.instance_count, cmd.base_vertex);
+				stats.draws++;
+			}
+		}
+	}
+	stats.instances += (uint)items.size();
+
+	queue_stats += stats;
 }
 
 void RendererBackend::render_visual(GPUVisual* visual) {
-	render_visual(visual->get_material(), visual->get_model());
+	auto material = visual->get_material();
+	auto model = visual->get_model();
+	if (!material || !model) return;
+	render_visual(material, model);
 }
 
 void RendererBackend::render_visual(GPUMaterial* material, GPUModel* model) {
@@ -233,44 +617,73 @@ void RendererBackend::render_visual(GPUMaterial* material, GPUModel* model) {
 
 	for (auto mesh : model->meshes) {
 		mesh->use_mesh();
-		glDrawElements(GL_TRIANGLES, mesh->get_elements_count(), GL_UNSIGNED_INT, 0);
+		mesh->draw();
 	}
 }
 
-void RendererBackend::update_material_globals(RenderWorld* world) {
-	auto materials = world->materials;
-	auto lights = world->lights;
-	auto opt_camera = world->get_active_camera();
-	for (auto material : materials) {
-		material->update_internals();
+void RendererBackend::update_frame_data(RenderWorld* world) {
+	GPUFrameData data = {};
 
-		auto shader = material->get_shader();
-		if (opt_camera) {
-			shader->set_vec3("viewPos", glm::inverse(opt_camera.value()->get_view_mat())[3]);
-		}
+	if (auto opt_camera = world->get_active_camera()) {
+		auto camera = opt_camera.value();
+		data.view = camera->get_view_mat();
+		data.proj = camera->get_proj_mat();
+		data.view_pos = glm::vec4(glm::vec3(glm::inverse(data.view)[3]), 1.0f);
+	}
 
-		if (world->env) {
-			auto env = world->env.value();
-			shader->set_vec3("ambientColor", env->ambient_color);
-			shader->set_float("ambient", env->ambient_intensity);
-		}
+	if (world->env) {
+		auto env = world->env.value();
+		data.ambient = glm::vec4(env->ambient_color, env->ambient_intensity);
+	}
 
-		shader->set_int("numOfLights", lights.size());
-		for (size_t i = 0; i < lights.size(); i++) {
-			auto light = lights[i];
-			std::string ligth_access_std = "lights[" + std::to_string(i) + "].";
-			shader->set_bool((ligth_access_std + "enabled").c_str(), true);
-			shader->set_int((ligth_access_std + "type").c_str(), (int)light->type);
-			shader->set_vec3((ligth_access_std + "position").c_str(), light->position);
-			shader->set_vec3((ligth_access_std + "direction").c_str(), light->dir);
-			shader->set_vec3((ligth_access_std + "color").c_str(), light->color);
-			shader->set_float((ligth_access_std + "intensity").c_str(), light->intensity);
-
-			if (light->get_cast_shadows()) {
-				shader->set_matrix4("matLight[" + std::to_string(i) + "]", light->build_proj_matrix() * light->build_view_matrix());
-				material->set_texture(SamplerID::Shadows, shadowmap_textures);
-			}
-		}
+	int directional = 0;
+	for (auto& [light, shadow_view] : frame_lights) {
+		if (light->type == LightType::Directional) directional++;
+	}
+	for (size_t i = 0; i < shadow_views.size(); i++) {
+		data.light_matrices[i] = shadow_views[i].proj * shadow_views[i].view;
+		data.shadow_tiles[i] = shadow_views[i].tile.get_uv_rect(shadow_atlas.get_resolution());
+	}
+	data.light_count = glm::ivec4(directional, (int)frame_lights.size(), cascade_count, 0);
+	data.cascade_splits = cascade_splits;
+	data.cluster_grid = glm::ivec4(LightClusterGrid::TILES_X, LightClusterGrid::TILES_Y, LightClusterGrid::SLICES, 0);
+	data.cluster_params = glm::vec4(light_clusters.get_slice_params(), 0.0f, 0.0f);
+
+	frame_ubo->set_data(&data, sizeof(data));
+	frame_ubo->bind(UniformBlockBinding::FrameBlock);
+}
+
+void RendererBackend::update_light_clusters(RenderWorld* world) {
+	light_data.clear();
+	cluster_lights.clear();
+	for (auto& [light, shadow_view] : frame_lights) {
+		light_data.push_back(GPULightData{
+			.position = glm::vec4(light->position, (float)light->type),
+			.direction = glm::vec4(light->dir, (float)shadow_view),
+			.color = glm::vec4(light->color * light->intensity, light->range),
+		});
+		if (light->type != LightType::Directional) cluster_lights.push_back(ClusterLight{ light->position, light->range });
+	}
+
+	auto camera = world->get_active_camera();
+	if (camera) light_clusters.build(camera.value()->get_view_mat(), camera.value()->get_proj_mat(), cluster_lights);
+
+	// Cluster light indices are relative to the point lights, which come after the directional ones.
+	light_buffer->set_data(light_data.data(), sizeof(GPULightData) * light_data.size());
+	cluster_cells_buffer->set_data(light_clusters.get_cells().data(), sizeof(glm::uvec2) * light_clusters.get_cells().size());
+	cluster_indices_buffer->set_data(light_clusters.get_indices().data(), sizeof(uint32_t) * light_clusters.get_indices().size());
+
+	light_buffer->activate(SamplerID::LightData);
+	cluster_cells_buffer->activate(SamplerID::ClusterCells);
+	cluster_indices_buffer->activate(SamplerID::ClusterIndices);
+}
+
+void RendererBackend::update_material_globals(RenderWorld* world) {
+	for (auto h : world->materials) {
+		auto material = materials.get(h);
+		if (!material) continue;
+		material->update_internals();
+		material->set_texture(SamplerID::Shadows, shadowmap_textures);
 	}
 }
 
@@ -303,8 +716,8 @@ void AppWindow::close() {
 
 void AppWindow::swap_buffers() {
 	if (vp) {
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, vp->fbo->get_gl_id());
+		gl_state().bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		gl_state().bind_framebuffer(GL_READ_FRAMEBUFFER, vp->fbo->get_gl_id());
 		auto size = get_size();
 		glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 	}
@@ -347,7 +760,24 @@ Result<GL_ID, ShaderError> GPUShader::compile_source(ShaderSrcType type, const c
 	return compiled;
 }
 
+GPUShader::~GPUShader() {
+	if (!gl_program) return;
+	glDeleteProgram(gl_program);
+	gl_state().forget_program(gl_program);
+}
+
 Result<void, ShaderError> GPUShader::compile_shader(const char* vert, const char* frag) {
+	auto& cache = App::get_render_backend()->program_cache;
+	uint64_t key = cache.get_key(vert, frag);
+	if (GL_ID program = cache.load(key)) {
+		gl_program = program;
+		introspect_uniforms();
+		bind_uniform_blocks();
+		return Result<void, ShaderError>();
+	}
+	if (cache.is_active()) cache.record_miss();
+	auto start = std::chrono::steady_clock::now();
+
 	auto rvertex = compile_source(ShaderSrcType::VertexSrc, vert);
 	if (!rvertex) { return Error(rvertex.error()); }
 	auto vertex = rvertex.value();
@@ -357,6 +787,7 @@ Result<void, ShaderError> GPUShader::compile_shader(const char* vert, const char
 	auto fragment = rfragment.value();
 
 	gl_program = glCreateProgram();
+	if (cache.is_active()) glProgramParameteri(gl_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(gl_program, vertex);
 	glAttachShader(gl_program, fragment);
 	glLinkProgram(gl_program);
@@ -371,62 +802,153 @@ Result<void, ShaderError> GPUShader::compile_shader(const char* vert, const char
 
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	cache.store(key, gl_program, elapsed.count());
+
+	introspect_uniforms();
+	bind_uniform_blocks();
+	return Result<void, ShaderError>();
+}
+
+void GPUShader::introspect_uniforms() {
+	uniform_slots.clear();
+	uniform_lookup.clear();
+	uniform_ids.clear();
+
+	int count = 0;
+	int max_length = 0;
+	glGetProgramiv(gl_program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(gl_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<char> name_buffer(max_length + 1);
+
+	auto add_slot = [this](const std::string& name) {
+		int location = glGetUniformLocation(gl_program, name.c_str());
+		if (location < 0) return; // Uniform block members don't have a location.
+		uniform_lookup[name] = uniform_slots.size();
+		uniform_slots.push_back(UniformSlot{ .location = location });
+	};
+
+	for (int i = 0; i < count; i++) {
+		int length = 0;
+		int array_size = 0;
+		GLenum type;
+		glGetActiveUniform(gl_program, i, name_buffer.size(), &length, &array_size, &type, name_buffer.data());
+		std::string name(name_buffer.data(), length);
+
+		// Arrays are reported once as "name[0]", register every element plus the bare name.
+		auto array_pos = name.rfind("[0]");
+		if (array_pos != std::string::npos && array_pos + 3 == name.size()) {
+			auto base = name.substr(0, array_pos);
+			for (int e = 0; e < array_size; e++) {
+				add_slot(std::format("{}[{}]", base, e));
+			}
+			if (uniform_lookup.contains(name)) uniform_lookup[base] = uniform_lookup[name];
+		}
+		else {
+			add_slot(name);
+		}
+	}
 }
 
-void GPUShader::use_shader() const {
-	glUseProgram(gl_program);
+void GPUShader::bind_uniform_blocks() {
+	static const std::pair<const char*, UniformBlockBinding> blocks[] = {
+		{ "FrameData", UniformBlockBinding::FrameBlock },
+		{ "MaterialData", UniformBlockBinding::MaterialBlock },
+	};
+
+	for (auto& [name, binding] : blocks) {
+		auto index = glGetUniformBlockIndex(gl_program, name);
+		if (index == GL_INVALID_INDEX) continue;
+		glUniformBlockBinding(gl_program, index, binding);
+	}
 }
 
-void GPUShader::set_sampler_id(std::string uniform, SamplerID id) {
-	set_sampler_id(uniform, (uint)id);
+int GPUShader::find_slot(const char* uniform) const {
+	auto it = uniform_lookup.find(uniform);
+	if (it == uniform_lookup.end()) return -1;
+	return it->second;
 }
 
-void GPUShader::set_sampler_id(std::string uniform, uint id) {
-	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform.c_str());
-	glUniform1i(uniform_loc, id);
+int GPUShader::find_slot(UniformId uniform) const {
+	const int UNRESOLVED = -2;
+	if (uniform.get_id() >= uniform_ids.size()) uniform_ids.resize(UniformId::get_count(), UNRESOLVED);
+	int& slot = uniform_ids[uniform.get_id()];
+	if (slot == UNRESOLVED) slot = find_slot(uniform.get_name().c_str());
+	return slot;
 }
 
-void GPUShader::set_bool(const char* uniform, bool value) const {
-	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform1i(uniform_loc, (int)value);
+bool GPUShader::update_slot(int slot, const void* value, size_t size) const {
+	if (slot < 0) return false;
+	auto& cached = uniform_slots[slot];
+	if (cached.has_value && memcmp(cached.value.data(), value, size) == 0) return false;
+	memcpy(cached.value.data(), value, size);
+	cached.has_value = true;
+	return true;
 }
 
-void GPUShader::set_int(const char* uniform, int value) const {
+void GPUShader::upload(int slot, int value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform1i(uniform_loc, value);
+	glUniform1i(uniform_slots[slot].location, value);
 }
 
-void GPUShader::set_float(const char* uniform, float value) const {
+void GPUShader::upload(int slot, float value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform1f(uniform_loc, value);
+	glUniform1f(uniform_slots[slot].location, value);
 }
 
-void GPUShader::set_vec2(const char* uniform, glm::vec2 value) const {
+void GPUShader::upload(int slot, glm::vec2 value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform2f(uniform_loc, value.x, value.y);
+	glUniform2f(uniform_slots[slot].location, value.x, value.y);
 }
 
-void GPUShader::set_vec3(const char* uniform, glm::vec3 value) const {
+void GPUShader::upload(int slot, glm::vec3 value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform3f(uniform_loc, value.x, value.y, value.z);
+	glUniform3f(uniform_slots[slot].location, value.x, value.y, value.z);
 }
 
-void GPUShader::set_vec4(const char* uniform, glm::vec4 value) const {
+void GPUShader::upload(int slot, glm::vec4 value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniform4f(uniform_loc, value.x, value.y, value.z, value.w);
+	glUniform4f(uniform_slots[slot].location, value.x, value.y, value.z, value.w);
 }
 
-void GPUShader::set_matrix4(const char* uniform, glm::mat4 matrix) const {
+void GPUShader::upload(int slot, const glm::mat4& value) const {
+	if (!update_slot(slot, &value, sizeof(value))) return;
 	use_shader();
-	unsigned int uniform_loc = glGetUniformLocation(gl_program, uniform);
-	glUniformMatrix4fv(uniform_loc, 1, GL_FALSE, glm::value_ptr(matrix));
+	glUniformMatrix4fv(uniform_slots[slot].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void GPUShader::use_shader() const {
+	gl_state().use_program(gl_program);
+}
+
+void GPUShader::set_sampler_id(std::string uniform, SamplerID id) {
+	set_sampler_id(uniform, (uint)id);
+}
+
+void GPUShader::set_sampler_id(std::string uniform, uint id) {
+	upload(find_slot(uniform.c_str()), (int)id);
+}
+
+std::vector<std::string>& UniformId::get_names() {
+	static std::vector<std::string> names;
+	return names;
+}
+
+UniformId::UniformId(const char* name) {
+	static std::unordered_map<std::string, uint> ids;
+	auto it = ids.find(name);
+	if (it != ids.end()) {
+		id = it->second;
+		return;
+	}
+	id = get_names().size();
+	get_names().push_back(name);
+	ids[name] = id;
 }
 
 inline int to_gl_define(ShaderSrcType type) {
@@ -451,47 +973,314 @@ uint to_gl(TextureFormat format) {
 	return 0;
 }
 
-GPUMesh::GPUMesh() {
-	elements_count = 0;
-	vertex_count = 0;
+uint to_gl(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::RGBA8:
+		return GL_RGBA8;
+	case PixelFormat::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case PixelFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case PixelFormat::BC5:
+		return GL_COMPRESSED_RG_RGTC2;
+	case PixelFormat::BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return 0;
+}
+
+struct GLVertexFormat {
+	int components;
+	uint type;
+	bool normalized;
+};
+
+static GLVertexFormat to_gl(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Float2: return { 2, GL_FLOAT, false };
+	case VertexFormat::Float3: return { 3, GL_FLOAT, false };
+	case VertexFormat::Half2: return { 2, GL_HALF_FLOAT, false };
+	case VertexFormat::Half4: return { 4, GL_HALF_FLOAT, false };
+	case VertexFormat::Unorm16x2: return { 2, GL_UNSIGNED_SHORT, true };
+	case VertexFormat::Snorm16x2: return { 2, GL_SHORT, true };
+	case VertexFormat::Unorm8x4: return { 4, GL_UNSIGNED_BYTE, true };
+	case VertexFormat::None:
+	default:
+		return { 0, GL_FLOAT, false };
+	}
+}
+
+GPUGeometryBuffer::GPUGeometryBuffer() {
+	gl_vertex_buffer = 0;
+	gl_elements_buffer = 0;
 	glGenVertexArrays(1, &gl_vertex_array);
+	grow_vertices(1 << 16);
+	grow_indices(3 << 16);
+}
+
+void GPUGeometryBuffer::grow_vertices(uint capacity) {
+	GL_ID old_buffer = gl_vertex_buffer;
+	uint old_capacity = vertex_ranges.get_capacity();
+
 	glGenBuffers(1, &gl_vertex_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_vertex_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, layout.get_stride() * capacity, NULL, GL_STATIC_DRAW);
+	if (old_capacity > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, old_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, layout.get_stride() * old_capacity);
+		glDeleteBuffers(1, &old_buffer);
+	}
+
+	vertex_ranges.grow(capacity);
+	setup_vertex_attributes();
+}
+
+void GPUGeometryBuffer::grow_indices(uint capacity) {
+	GL_ID old_buffer = gl_elements_buffer;
+	uint old_capacity = index_ranges.get_capacity();
+
 	glGenBuffers(1, &gl_elements_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_elements_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, layout.get_index_size() * capacity, NULL, GL_STATIC_DRAW);
+	if (old_capacity > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, old_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, layout.get_index_size() * old_capacity);
+		glDeleteBuffers(1, &old_buffer);
+	}
+
+	index_ranges.grow(capacity);
+	setup_vertex_attributes();
 }
 
-void GPUMesh::set_triangles(std::vector<unsigned int> indices) {
-	elements_count = indices.size();
-	glBindVertexArray(gl_vertex_array);
+void GPUGeometryBuffer::setup_vertex_attributes() const {
+	use();
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_elements_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, gl_vertex_buffer);
+
+	uint stride = layout.get_stride();
+	for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++) {
+		auto attribute = (VertexAttribute)i;
+		auto format = layout.get_format(attribute);
+		if (format == VertexFormat::None) {
+			// Missing colors read white like the Vertex default, the rest read zero.
+			glDisableVertexAttribArray(i);
+			if (attribute == VertexColor) glVertexAttrib4f(i, 1.0f, 1.0f, 1.0f, 1.0f);
+			continue;
+		}
+
+		auto [components, type, normalized] = to_gl(format);
+		glVertexAttribPointer(i, components, type, normalized, stride, (void*)(size_t)layout.get_offset(attribute));
+		glEnableVertexAttribArray(i);
+	}
+}
+
+void GPUGeometryBuffer::set_layout(const VertexLayout& layout) {
+	if (vertex_ranges.get_free_count() != vertex_ranges.get_capacity() || index_ranges.get_free_count() != index_ranges.get_capacity()) {
+		Console::log_error("Geometry buffer {} already holds meshes, its layout can't change.", gl_vertex_array);
+		return;
+	}
+
+	this->layout = layout;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_vertex_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, layout.get_stride() * vertex_ranges.get_capacity(), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_elements_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, layout.get_index_size() * index_ranges.get_capacity(), NULL, GL_STATIC_DRAW);
+	setup_vertex_attributes();
+}
+
+uint GPUGeometryBuffer::get_gl_index_type() const {
+	return layout.index_format == IndexFormat::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void GPUGeometryBuffer::set_decode_uniforms(GPUShader* shader) const {
+	shader->set_bool(uniforms::oct_normals, layout.get_format(VertexNormal) == VertexFormat::Snorm16x2);
+	shader->set_bool(uniforms::oct_tangents, layout.get_format(VertexTangent) == VertexFormat::Snorm16x2);
+}
+
+uint GPUGeometryBuffer::allocate_vertices(uint count) {
+	uint first = vertex_ranges.allocate(count);
+	if (first != RangeAllocator::INVALID) return first;
+	grow_vertices(std::max(vertex_ranges.get_capacity() * 2, vertex_ranges.get_capacity() + count));
+	return vertex_ranges.allocate(count);
+}
+
+uint GPUGeometryBuffer::allocate_indices(uint count) {
+	uint first = index_ranges.allocate(count);
+	if (first != RangeAllocator::INVALID) return first;
+	grow_indices(std::max(index_ranges.get_capacity() * 2, index_ranges.get_capacity() + count));
+	return index_ranges.allocate(count);
+}
+
+// Uploads go through the copy target so they never touch the element binding of whatever vertex array is bound.
+void GPUGeometryBuffer::upload_vertices(uint first, const std::vector<Vertex>& vertices) {
+	if (vertices.empty()) return;
+	layout.encode(vertices, encoded);
+	upload_encoded_vertices(first, encoded);
+}
+
+void GPUGeometryBuffer::upload_encoded_vertices(uint first, std::span<const std::byte> vertices) {
+	if (vertices.empty()) return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_vertex_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, layout.get_stride() * first, vertices.size(), vertices.data());
+}
+
+void GPUGeometryBuffer::upload_encoded_indices(uint first, std::span<const std::byte> indices) {
+	if (indices.empty()) return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, gl_elements_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, layout.get_index_size() * first, indices.size(), indices.data());
+}
+
+void GPUGeometryBuffer::upload_indices(uint first, const std::vector<unsigned int>& indices) {
+	if (indices.empty()) return;
+	layout.encode_indices(indices, encoded);
+	upload_encoded_indices(first, encoded);
+}
+
+void GPUGeometryBuffer::use() const {
+	gl_state().bind_vertex_array(gl_vertex_array);
+}
+
+void GPUGeometryBuffer::bind_instances(GL_ID instance_buffer, size_t offset) const {
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	for (int i = 0; i < 4; i++) {
+		uint location = INSTANCE_XFORM_LOCATION + i;
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, model) + sizeof(glm::vec4) * i));	// INSTANCE MODEL COLUMN
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+	for (int i = 0; i < 3; i++) {
+		uint location = INSTANCE_NORMAL_LOCATION + i;
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, normal) + sizeof(glm::vec3) * i));	// INSTANCE NORMAL COLUMN
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+}
+
+GPUMesh::GPUMesh() {
+	geometry = App::get_render_backend()->get_geometry();
+	range.geometry = geometry;
+}
+
+void GPUMesh::set_layout(const VertexLayout& layout) {
+	if (layout == geometry->get_layout()) return;
+	geometry->free_vertices(range.first_vertex, range.vertex_count);
+	geometry->free_indices(range.first_index, range.index_count);
+	geometry = App::get_render_backend()->get_geometry(layout);
+	range = GeometryRange{ .geometry = geometry };
+}
+
+GPUMesh::~GPUMesh() {
+	geometry->free_vertices(range.first_vertex, range.vertex_count);
+	geometry->free_indices(range.first_index, range.index_count);
+}
+
+void GPUMesh::set_triangles(std::vector<unsigned int> indices) {
+	geometry->free_indices(range.first_index, range.index_count);
+	range.index_count = indices.size();
+	range.first_index = indices.empty() ? 0 : geometry->allocate_indices(range.index_count);
+	geometry->upload_indices(range.first_index, indices);
 }
 
 void GPUMesh::set_vertices(std::vector<Vertex> vertices) {
-	vertex_count = vertices.size();
-	glBindVertexArray(gl_vertex_array);
-	glBindBuffer(GL_ARRAY_BUFFER, gl_vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
+	geometry->free_vertices(range.first_vertex, range.vertex_count);
+	range.vertex_count = vertices.size();
+	range.first_vertex = vertices.empty() ? 0 : geometry->allocate_vertices(range.vertex_count);
+	geometry->upload_vertices(range.first_vertex, vertices);
+
+	bounds = AABB();
+	for (auto& vertex : vertices) bounds.expand(vertex.position);
+	sphere = BoundingSphere{ .center = bounds.get_center(), .radius = 0.0f };
+	for (auto& vertex : vertices) sphere.radius = glm::max(sphere.radius, glm::length(vertex.position - sphere.center));
+}
+
+void GPUMesh::set_encoded(std::span<const std::byte> vertices, std::span<const std::byte> indices, const AABB& bounds, const BoundingSphere& sphere) {
+	auto& layout = geometry->get_layout();
+	geometry->free_vertices(range.first_vertex, range.vertex_count);
+	range.vertex_count = (uint)(vertices.size() / layout.get_stride());
+	range.first_vertex = range.vertex_count == 0 ? 0 : geometry->allocate_vertices(range.vertex_count);
+	geometry->upload_encoded_vertices(range.first_vertex, vertices);
+
+	geometry->free_indices(range.first_index, range.index_count);
+	range.index_count = (uint)(indices.size() / layout.get_index_size());
+	range.first_index = range.index_count == 0 ? 0 : geometry->allocate_indices(range.index_count);
+	geometry->upload_encoded_indices(range.first_index, indices);
+
+	this->bounds = bounds;
+	this->sphere = sphere;
+}
+
+void GPUModel::update_bounds() {
+	bounds = AABB();
+	for (auto mesh : meshes) bounds.expand(mesh->get_bounds());
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 14, (void*)0);	// VERTEX POSITION
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 14, (void*)(sizeof(float) * 3));	// VERTEX NORMAL
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 14, (void*)(sizeof(float) * 6));	// VERTEX TANGENT
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 14, (void*)(sizeof(float) * 9));	// VERTEX COLOR
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 14, (void*)(sizeof(float) * 12));	// VERTEX COORDS
-	glEnableVertexAttribArray(4);
+	sphere = BoundingSphere{ .center = bounds.get_center(), .radius = 0.0f };
+	for (auto mesh : meshes) {
+		auto& s = mesh->get_sphere();
+		sphere.radius = glm::max(sphere.radius, glm::length(s.center - sphere.center) + s.radius);
+	}
+}
+
+uint GPUModel::select_lod(float screen_size, uint current, float hysteresis) const {
+	auto level = [this](float size) {
+		uint lod = 0;
+		while (lod < lods.size() && size < lods[lod].screen_size) lod++;
+		return lod;
+	};
+
+	// Coarser once the size is clearly below a threshold, finer once it is clearly above it.
+	uint coarsest = level(screen_size / (1.0f - hysteresis));
+	uint finest = level(screen_size / (1.0f + hysteresis));
+	return std::clamp(current, coarsest, finest);
+}
+
+void GPUVisual::set_xform(glm::mat4 xform) {
+	// Normal matrix computed once here instead of for every vertex in the shader.
+	instance.model = xform;
+	instance.normal = glm::transpose(glm::inverse(glm::mat3(xform)));
+	version++;
+}
+
+void GPUVisual::set_model(GPUModel* model) {
+	set_model(App::get_render_backend()->models.get_handle(model));
+}
+
+GPUModel* GPUVisual::get_model() const {
+	return App::get_render_backend()->models.get(model);
+}
+
+void GPUVisual::set_material(GPUMaterial* material) {
+	set_material(App::get_render_backend()->materials.get_handle(material));
+}
+
+GPUMaterial* GPUVisual::get_material() const {
+	return App::get_render_backend()->materials.get(material);
+}
+
+AABB GPUVisual::get_world_bounds() const {
+	auto model = get_model();
+	return model ? model->bounds.transformed(instance.model) : AABB();
 }
 
 void GPUMesh::use_mesh() const {
-	glBindVertexArray(gl_vertex_array);
+	geometry->use();
+}
+
+void GPUMesh::draw() const {
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.index_count, geometry->get_gl_index_type(), (void*)(size_t)(range.first_index * geometry->get_layout().get_index_size()), range.first_vertex);
 }
 
 void Camera::set_view(glm::vec3 pos, glm::vec3 target, glm::vec3 up) {
 	view = glm::lookAt(pos, target, up);
 }
 
+void Camera::build_ray(glm::vec2 ndc, glm::vec3& origin, glm::vec3& dir) const {
+	glm::mat4 inv_view_proj = glm::inverse(proj * view);
+	glm::vec4 near_point = inv_view_proj * glm::vec4(ndc, -1.0f, 1.0f);
+	glm::vec4 far_point = inv_view_proj * glm::vec4(ndc, 1.0f, 1.0f);
+	origin = glm::vec3(near_point) / near_point.w;
+	dir = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+}
+
 void Camera::set_proj(float fov, glm::vec2 screen_size, glm::vec2 near_far_plane) {
 	proj = glm::perspectiveFov(fov, screen_size.x, screen_size.y, near_far_plane.x, near_far_plane.y);
 }
@@ -500,27 +1289,94 @@ GPUTexture2D::GPUTexture2D() {
 	glGenTextures(1, &gl_texture);
 }
 
+GPUTexture2D::~GPUTexture2D() {
+	App::get_render_backend()->texture_streamer.remove(this);
+	glDeleteTextures(1, &gl_texture);
+	gl_state().forget_texture(gl_texture);
+}
+
 void GPUTexture2D::activate(uint id) {
-	glActiveTexture(GL_TEXTURE0 + id);
-	use_texture();
+	gl_state().bind_texture(id, GL_TEXTURE_2D, gl_texture);
 }
 
 void GPUTexture2D::use_texture() {
-	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	gl_state().bind_texture(GL_TEXTURE_2D, gl_texture);
 }
 
 void GPUTexture2D::set_as_depth(uint width, uint heigth, unsigned char* data) {
-	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	size = glm::uvec2(width, heigth);
+	gpu_bytes = (size_t)width * heigth * 4 * 4 / 3;
+	use_texture();
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, heigth, 0, GL_DEPTH_COMPONENT, GL_FLOAT, data);
 	glGenerateMipmap(GL_TEXTURE_2D);
 }
 
 void GPUTexture2D::set_as_rgb8(uint width, uint heigth, unsigned char* data) {
-	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	size = glm::uvec2(width, heigth);
+	// Drivers pad RGB8 to four bytes, the mip chain adds a third.
+	gpu_bytes = (size_t)width * heigth * 4 * 4 / 3;
+	use_texture();
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, heigth, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 	glGenerateMipmap(GL_TEXTURE_2D);
 }
 
+static void upload_mip(PixelFormat format, uint level, const TextureMip& mip) {
+	if (is_block_compressed(format)) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, to_gl(format), mip.size.x, mip.size.y, 0, (GLsizei)mip.data.size(), mip.data.data());
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, level, to_gl(format), mip.size.x, mip.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.data.data());
+	}
+}
+
+void GPUTexture2D::set_mips(PixelFormat format, const std::vector<TextureMip>& mips, uint first) {
+	if (gpu_bytes > 0) {
+		GLint wrap_s, wrap_t, min_filter, mag_filter;
+		glm::vec4 border;
+		use_texture();
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrap_s);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrap_t);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &min_filter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &mag_filter);
+		glGetTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border.x);
+
+		glDeleteTextures(1, &gl_texture);
+		gl_state().forget_texture(gl_texture);
+		glGenTextures(1, &gl_texture);
+		use_texture();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border.x);
+	}
+
+	size = mips[0].size;
+	base_level = first;
+	gpu_bytes = 0;
+	use_texture();
+	for (uint level = first; level < mips.size(); level++) {
+		upload_mip(format, level, mips[level]);
+		gpu_bytes += mips[level].data.size();
+	}
+	// Chains may stop before 1x1, sampling past the last level would make the texture incomplete.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.size() - 1);
+}
+
+void GPUTexture2D::add_finer_mip(PixelFormat format, const TextureMip& mip) {
+	base_level--;
+	use_texture();
+	upload_mip(format, base_level, mip);
+	gpu_bytes += mip.data.size();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+}
+
+void GPUTexture2D::set_min_lod(float lod) {
+	use_texture();
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, lod);
+}
+
 uint GPUTexture2D::get_gl_type() const {
 	return GL_TEXTURE_2D;
 }
@@ -535,18 +1391,121 @@ void GPUMaterial::use_material() const {
 		textures[i]->activate(i);
 	}
 	shader->use_shader();
+	bind_internals();
+}
+
+GPUUniformBuffer::GPUUniformBuffer() {
+	size = 0;
+	glGenBuffers(1, &gl_ubo);
+}
+
+void GPUUniformBuffer::set_data(const void* data, uint size) {
+	glBindBuffer(GL_UNIFORM_BUFFER, gl_ubo);
+	if (size == this->size) {
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	}
+	else {
+		glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+		this->size = size;
+	}
+}
+
+void GPUUniformBuffer::bind(UniformBlockBinding binding) const {
+	gl_state().bind_uniform_buffer(binding, gl_ubo);
+}
+
+GPUInstanceBuffer::GPUInstanceBuffer() {
+	capacity = 0;
+	glGenBuffers(1, &gl_vbo);
+}
+
+void GPUInstanceBuffer::set_data(const std::vector<InstanceData>& instances) {
+	size_t size = sizeof(InstanceData) * instances.size();
+	if (size == 0) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, gl_vbo);
+	if (size > capacity) capacity = std::max(size, capacity * 2);
+	glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+}
+
+GPUTextureBuffer::GPUTextureBuffer() {
+	format = GL_R32UI;
+	capacity = 0;
+	glGenBuffers(1, &gl_buffer);
+	glGenTextures(1, &gl_texture);
 }
 
+void GPUTextureBuffer::set_format(uint format) {
+	this->format = format;
+	gl_state().bind_texture(GL_TEXTURE_BUFFER, gl_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, gl_buffer);
+}
+
+void GPUTextureBuffer::set_data(const void* data, size_t size) {
+	// Keep a minimum size so frames without data still sample a valid buffer.
+	if (size > capacity) capacity = std::max<size_t>(std::max(size, capacity * 2), 64);
+	if (capacity == 0) capacity = 64;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, gl_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+void GPUTextureBuffer::activate(uint unit) const {
+	gl_state().bind_texture(unit, GL_TEXTURE_BUFFER, gl_texture);
+}
+
+GPUIndirectBuffer::GPUIndirectBuffer() {
+	capacity = 0;
+	glGenBuffers(1, &gl_buffer);
+}
+
+void GPUIndirectBuffer::set_data(const std::vector<DrawElementsIndirectCommand>& commands) {
+	size_t size = sizeof(DrawElementsIndirectCommand) * commands.size();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gl_buffer);
+	if (size == 0) return;
+
+	if (size > capacity) capacity = std::max(size, capacity * 2);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, commands.data());
+}
+
+GPUTimerQuery::GPUTimerQuery() {
+	glGenQueries(LATENCY, gl_queries.data());
+}
+
+void GPUTimerQuery::begin() {
+	// The query in this slot was issued LATENCY runs ago, its result is almost always ready by now.
+	if (pending[current]) {
+		GLuint64 elapsed_ns;
+		glGetQueryObjectui64v(gl_queries[current], GL_QUERY_RESULT, &elapsed_ns);
+		elapsed_ms = elapsed_ns / 1000000.0;
+		pending[current] = false;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, gl_queries[current]);
+}
+
+void GPUTimerQuery::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[current] = true;
+	current = (current + 1) % LATENCY;
+}
+
+void GPUTimerQuery::reset() {
+	pending.fill(false);
+	elapsed_ms = 0.0;
+}
+
+// Attachments leave the frame buffer bound, whoever renders next binds its own target through the state cache.
 void GPUFrameBuffer::set_format_2D(uint attachment, uint texture_type, GL_ID id) {
 	use_framebuffer();
 	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, texture_type, id, 0);
-	unbind_framebuffer();
 }
 
 void GPUFrameBuffer::set_format_3D(uint attachment, uint texture_type, uint layer, GL_ID id) {
 	use_framebuffer();
 	glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, id, 0, layer);
-	unbind_framebuffer();
 }
 
 GPUFrameBuffer::GPUFrameBuffer() {
@@ -554,23 +1513,24 @@ GPUFrameBuffer::GPUFrameBuffer() {
 }
 
 void GPUFrameBuffer::unbind_framebuffer() {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_state().bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
 bool GPUFrameBuffer::is_complete() {
+	use_framebuffer();
 	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
 }
 
 void GPUFrameBuffer::use_framebuffer() {
-	glBindFramebuffer(GL_FRAMEBUFFER, gl_fbo);
+	gl_state().bind_framebuffer(GL_FRAMEBUFFER, gl_fbo);
 }
 
 void GPUFrameBuffer::use_read() {
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, gl_fbo);
+	gl_state().bind_framebuffer(GL_READ_FRAMEBUFFER, gl_fbo);
 }
 
 void GPUFrameBuffer::use_draw() {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gl_fbo);
+	gl_state().bind_framebuffer(GL_DRAW_FRAMEBUFFER, gl_fbo);
 }
 
 void GPUFrameBuffer::set_output_depth(GPUTexture2D* texture) {
@@ -622,10 +1582,16 @@ glm::mat4 Light::build_proj_matrix() {
 		return glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 20.0f);
 	case Point:
 	default:
-		return glm::identity<glm::mat4>();
+		return glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, range);
 	}
 }
 
+glm::mat4 Light::build_cube_view_matrix(uint face) {
+	static const glm::vec3 dirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+	return glm::lookAt(position, position + dirs[face], ups[face]);
+}
+
 void Light::set_cast_shadows(bool state) {
 	cast_shadows = state;
 }
@@ -639,19 +1605,18 @@ GL_ID GPUTexture2DArray::get_gl_id() const {
 }
 
 void GPUTexture2DArray::activate(uint id) {
-	glActiveTexture(GL_TEXTURE0 + id);
-	use_texture();
+	gl_state().bind_texture(id, GL_TEXTURE_2D_ARRAY, gl_texture_array);
 }
 
 void GPUTexture2DArray::use_texture() {
-	glBindTexture(GL_TEXTURE_2D_ARRAY, gl_texture_array);
+	gl_state().bind_texture(GL_TEXTURE_2D_ARRAY, gl_texture_array);
 }
 
 void GPUTexture2DArray::set_as_depth(uint width, uint heigth, unsigned char* data) {
 	set_as_depth(width, heigth, 1, data);
 }
 void GPUTexture2DArray::set_as_depth(uint width, uint heigth, uint depth, unsigned char* data) {
-	glBindTexture(GL_TEXTURE_2D_ARRAY, gl_texture_array);
+	use_texture();
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, width, heigth, depth, 0, GL_DEPTH_COMPONENT, GL_FLOAT, data);
 	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 }
@@ -661,7 +1626,7 @@ void GPUTexture2DArray::set_as_rgb8(uint width, uint heigth, unsigned char* data
 }
 
 void GPUTexture2DArray::set_as_rgb8(uint width, uint heigth, uint depth, unsigned char* data) {
-	glBindTexture(GL_TEXTURE_2D_ARRAY, gl_texture_array);
+	use_texture();
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, width, heigth, depth, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 }
@@ -674,6 +1639,11 @@ GPUCubemapTexture::GPUCubemapTexture() {
 	glGenTextures(1, &gl_cubemap);
 }
 
+GPUCubemapTexture::~GPUCubemapTexture() {
+	glDeleteTextures(1, &gl_cubemap);
+	gl_state().forget_texture(gl_cubemap);
+}
+
 GL_ID GPUCubemapTexture::get_gl_id() const {
 	return gl_cubemap;
 }
@@ -685,6 +1655,7 @@ void GPUCubemapTexture::set_as_rgb8(uint width, uint heigth, unsigned char* data
 }
 
 void GPUCubemapTexture::set_as_rgb8(uint width, uint heigth, std::vector<unsigned char*> data) {
+	size = glm::uvec2(width, heigth);
 	use_texture();
 	for (size_t i = 0; i < 6; i++) {
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, heigth, 0, GL_RGB, GL_UNSIGNED_BYTE, data[i]);
@@ -696,12 +1667,11 @@ uint GPUCubemapTexture::get_gl_type() const {
 }
 
 void GPUTexture::activate(uint id) {
-	glActiveTexture(GL_TEXTURE0 + id);
-	use_texture();
+	gl_state().bind_texture(id, get_gl_type(), get_gl_id());
 }
 
 void GPUTexture::use_texture() {
-	glBindTexture(get_gl_type(), get_gl_id());
+	gl_state().bind_texture(get_gl_type(), get_gl_id());
 }
 
 void GPUTexture::set_as_depth_stencil(uint width, uint heigth, unsigned char* data) {
@@ -726,7 +1696,7 @@ void GPUTexture::set_wrap(TextureWrap wrap) {
 		break;
 	}
 	auto type = get_gl_type();
-	glBindTexture(type, get_gl_id());
+	use_texture();
 	glTexParameteri(type, GL_TEXTURE_WRAP_S, gl_wrap);
 	glTexParameteri(type, GL_TEXTURE_WRAP_T, gl_wrap);
 }
@@ -746,7 +1716,7 @@ void GPUTexture::set_filter(TextureFilter filter) {
 	}
 
 	auto type = get_gl_type();
-	glBindTexture(type, get_gl_id());
+	use_texture();
 	glTexParameteri(type, GL_TEXTURE_MIN_FILTER, gl_filter);
 	glTexParameteri(type, GL_TEXTURE_MAG_FILTER, gl_mm_filter);
 }
@@ -756,11 +1726,26 @@ void GPUTexture::set_border_color(glm::vec4 color) {
 	glTexParameterfv(get_gl_type(), GL_TEXTURE_BORDER_COLOR, &color.x);
 }
 
+GPUPbrMaterial::GPUPbrMaterial() {
+	ubo = App::get_render_backend()->uniform_buffers.create();
+}
+
 void GPUPbrMaterial::update_internals() {
-	auto shader = get_shader();
-	shader->set_vec4("albedoColor", albedo);
-	shader->set_vec4("emissiveColor", emissive);
-	shader->set_float("metallicValue", metallic);
-	shader->set_float("roughnessValue", roughness);
-	shader->set_float("aoValue", ambient_occlusion);
+	GPUPbrMaterialData data = {
+		.albedo = albedo,
+		.emissive = emissive,
+		.metallic = metallic,
+		.roughness = roughness,
+		.ambient_occlusion = ambient_occlusion,
+		.padding = 0.0f,
+	};
+	if (has_uploaded && memcmp(&data, &uploaded, sizeof(data)) == 0) return;
+
+	ubo->set_data(&data, sizeof(data));
+	uploaded = data;
+	has_uploaded = true;
+}
+
+void GPUPbrMaterial::bind_internals() const {
+	ubo->bind(UniformBlockBinding::MaterialBlock);
 }
@@ -6,6 +6,9 @@
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <string>
+#include <array>
+#include <span>
+#include <unordered_map>
 #include "../utils.h"
 #include "glm/common.hpp"
 #include <assimp/Importer.hpp>
@@ -13,11 +16,33 @@
 #include <assimp/postprocess.h>
 #include "../MemPool.h"
 #include "render_world.h"
+#include "gl_state_cache.h"
+#include "render_queue.h"
+#include "bounds.h"
+#include "range_allocator.h"
+#include "indirect_commands.h"
+#include "light_clusters.h"
+#include "shadow_cascades.h"
+#include "shadow_atlas.h"
+#include "vertex_layout.h"
+#include "pixel_format.h"
+#include "texture_streamer.h"
+#include "program_cache.h"
 #include "../venum.h"
 
 typedef unsigned int GL_ID;
 typedef unsigned int uint;
 
+/// @brief Shadow views rendered in the same frame, each one a tile of the shadow atlas. Directional lights use one per
+/// cascade and point lights one per cube face. Must match MAX_SHADOWS in the shaders.
+const int MAX_SHADOWS = 16;
+/// @brief Near plane of the point light shadow faces. Must match POINT_SHADOW_NEAR in pbr.frag.
+const float POINT_SHADOW_NEAR = 0.05f;
+/// @brief First of the four vertex attribute locations holding the per instance model matrix.
+const int INSTANCE_XFORM_LOCATION = 5;
+/// @brief First of the three vertex attribute locations holding the per instance normal matrix.
+const int INSTANCE_NORMAL_LOCATION = 9;
+
 class Viewport;
 class RenderEnviroment;
 class RenderWorld;
@@ -57,6 +82,8 @@ public:
 	glm::mat4 get_view_mat() const { return view; }
 	void set_proj(float fov, glm::vec2 screen_size, glm::vec2 near_far_plane);
 	glm::mat4 get_proj_mat() const { return proj; }
+	/// @brief World space ray going through a point of the screen given in normalized device coordinates.
+	void build_ray(glm::vec2 ndc, glm::vec3& origin, glm::vec3& dir) const;
 };
 
 enum ShaderSrcType {
@@ -71,57 +98,169 @@ enum SamplerID {
 	Emissive,
 	Shadows,
 	Skybox,
+	LightData,
+	ClusterCells,
+	ClusterIndices,
+};
+
+/// @brief Fixed binding points for the uniform blocks shared between shaders.
+enum UniformBlockBinding {
+	FrameBlock = 0,
+	MaterialBlock,
 };
 
 struct ShaderError {
 	std::string error;
 };
 
+/// @brief Interned uniform name. Create them once (usually as statics) and use them instead of strings in hot paths,
+/// shaders resolve each id to a location only the first time it's used.
+class UniformId {
+	uint id;
+
+	static std::vector<std::string>& get_names();
+
+public:
+	UniformId(const char* name);
+	UniformId(const std::string& name) : UniformId(name.c_str()) {}
+
+	uint get_id() const { return id; }
+	const std::string& get_name() const { return get_names()[id]; }
+	static uint get_count() { return get_names().size(); }
+};
+
 class GPUShader {
-	GL_ID gl_program;
+	GL_ID gl_program = 0;
+
+	struct UniformSlot {
+		int location;
+		// Last value uploaded, used to skip redundant uploads.
+		bool has_value = false;
+		std::array<unsigned char, sizeof(glm::mat4)> value;
+	};
+
+	// Filled when linking from the program active uniforms.
+	mutable std::vector<UniformSlot> uniform_slots;
+	std::unordered_map<std::string, int> uniform_lookup;
+	// UniformId to slot index, resolved lazily.
+	mutable std::vector<int> uniform_ids;
 
 private:
 	Result<GL_ID, ShaderError> compile_source(ShaderSrcType type, const char* src);
+	void introspect_uniforms();
+	void bind_uniform_blocks();
+
+	int find_slot(const char* uniform) const;
+	int find_slot(UniformId uniform) const;
+	/// @brief Stores the value in the slot cache, returns false if the slot doesn't exist or already had that value.
+	bool update_slot(int slot, const void* value, size_t size) const;
+	void upload(int slot, int value) const;
+	void upload(int slot, float value) const;
+	void upload(int slot, glm::vec2 value) const;
+	void upload(int slot, glm::vec3 value) const;
+	void upload(int slot, glm::vec4 value) const;
+	void upload(int slot, const glm::mat4& value) const;
 
 public:
+	~GPUShader();
 	Result<void, ShaderError>  compile_shader(const char* vert, const char* frag);
 	void use_shader() const;
+	bool has_uniform(const char* uniform) const { return find_slot(uniform) >= 0; }
 	void set_sampler_id(std::string uniform, SamplerID id);
 	void set_sampler_id(std::string uniform, uint id);
-	void set_bool(const char* uniform, bool value) const;
-	void set_int(const char* uniform, int value) const;
-	void set_float(const char* uniform, float value) const;
-	void set_vec2(const char* uniform, glm::vec2 value) const;
-	void set_vec3(const char* uniform, glm::vec3 value) const;
-	void set_vec4(const char* uniform, glm::vec4 value) const;
+	void set_bool(const char* uniform, bool value) const { upload(find_slot(uniform), (int)value); }
+	void set_bool(UniformId uniform, bool value) const { upload(find_slot(uniform), (int)value); }
+	void set_int(const char* uniform, int value) const { upload(find_slot(uniform), value); }
+	void set_int(UniformId uniform, int value) const { upload(find_slot(uniform), value); }
+	void set_float(const char* uniform, float value) const { upload(find_slot(uniform), value); }
+	void set_float(UniformId uniform, float value) const { upload(find_slot(uniform), value); }
+	void set_vec2(const char* uniform, glm::vec2 value) const { upload(find_slot(uniform), value); }
+	void set_vec2(UniformId uniform, glm::vec2 value) const { upload(find_slot(uniform), value); }
+	void set_vec3(const char* uniform, glm::vec3 value) const { upload(find_slot(uniform), value); }
+	void set_vec3(UniformId uniform, glm::vec3 value) const { upload(find_slot(uniform), value); }
+	void set_vec4(const char* uniform, glm::vec4 value) const { upload(find_slot(uniform), value); }
+	void set_vec4(UniformId uniform, glm::vec4 value) const { upload(find_slot(uniform), value); }
 	void set_matrix4(const std::string uniform, glm::mat4 matrix) const { set_matrix4(uniform.c_str(), matrix); }
-	void set_matrix4(const char* uniform, glm::mat4 matrix) const;
+	void set_matrix4(const char* uniform, glm::mat4 matrix) const { upload(find_slot(uniform), matrix); }
+	void set_matrix4(UniformId uniform, glm::mat4 matrix) const { upload(find_slot(uniform), matrix); }
 };
 
-struct Vertex {
-	glm::vec3 position;
-	glm::vec3 normal = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 tangent = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
-	glm::vec2 coords = glm::vec2(0.0f, 0.0f);
+/// @brief Vertex and index buffers shared by every mesh with the same vertex layout, described by a single vertex array
+/// so switching meshes does not rebind anything. Meshes suballocate ranges and draw with a base vertex. Buffers grow by
+/// copying on the GPU.
+class GPUGeometryBuffer {
+	GL_ID gl_vertex_array;
+	GL_ID gl_vertex_buffer;
+	GL_ID gl_elements_buffer;
+	RangeAllocator vertex_ranges;
+	RangeAllocator index_ranges;
+	VertexLayout layout;
+	std::vector<std::byte> encoded;
+
+	void grow_vertices(uint capacity);
+	void grow_indices(uint capacity);
+	void setup_vertex_attributes() const;
+
+public:
+	GPUGeometryBuffer();
+
+	/// @brief Only allowed while nothing is allocated.
+	void set_layout(const VertexLayout& layout);
+	const VertexLayout& get_layout() const { return layout; }
+	/// @brief GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, as drawing the indices expects.
+	uint get_gl_index_type() const;
+
+	uint allocate_vertices(uint count);
+	uint allocate_indices(uint count);
+	void free_vertices(uint first, uint count) { vertex_ranges.free(first, count); }
+	void free_indices(uint first, uint count) { index_ranges.free(first, count); }
+	void upload_vertices(uint first, const std::vector<Vertex>& vertices);
+	void upload_indices(uint first, const std::vector<unsigned int>& indices);
+	/// @brief Uploads vertices already packed with the layout of the buffer.
+	void upload_encoded_vertices(uint first, std::span<const std::byte> vertices);
+	/// @brief Uploads indices already stored in the index format of the layout.
+	void upload_encoded_indices(uint first, std::span<const std::byte> indices);
+
+	void use() const;
+	/// @brief Points the instance matrix attributes at an instance buffer, offset in bytes. The geometry must be in use.
+	void bind_instances(GL_ID instance_buffer, size_t offset) const;
+	/// @brief Tells the shader how to decode the attributes stored in a quantized format.
+	void set_decode_uniforms(GPUShader* shader) const;
+
+	uint get_vertex_capacity() const { return vertex_ranges.get_capacity(); }
+	uint get_index_capacity() const { return index_ranges.get_capacity(); }
 };
 
 class GPUMesh {
-	GL_ID gl_vertex_array; // Holds vertex structure
-	uint vertex_count;
-	GL_ID gl_vertex_buffer; // Holds vertex data
-	uint elements_count;
-	GL_ID gl_elements_buffer; // Holds triangle data
+	GPUGeometryBuffer* geometry;
+	GeometryRange range;
+	AABB bounds;
+	BoundingSphere sphere;
 
 public:
 	GPUMesh();
+	~GPUMesh();
 
+	/// @brief Moves the mesh to the geometry buffer of the layout. Must be called before setting the vertices.
+	void set_layout(const VertexLayout& layout);
+	const VertexLayout& get_layout() const { return geometry->get_layout(); }
 	void set_triangles(std::vector<unsigned int> indices);
 	void set_vertices(std::vector<Vertex> vertices);
+	/// @brief Bytes the vertices and indices take in the geometry buffer.
+	size_t get_gpu_bytes() const { return (size_t)range.vertex_count * get_layout().get_stride() + (size_t)range.index_count * get_layout().get_index_size(); }
+	/// @brief Uploads streams already packed with the layout of the mesh, like the ones of a cooked model. The bounds
+	/// cannot be computed from packed positions so they come along.
+	void set_encoded(std::span<const std::byte> vertices, std::span<const std::byte> indices, const AABB& bounds, const BoundingSphere& sphere);
 
 	void use_mesh() const;
-	uint get_vertex_count() const { return vertex_count; }
-	uint get_elements_count() const { return elements_count; }
+	/// @brief Draws the mesh once with whatever material is in use. The mesh must be in use.
+	void draw() const;
+	const GeometryRange& get_range() const { return range; }
+	uint get_vertex_count() const { return range.vertex_count; }
+	uint get_elements_count() const { return range.index_count; }
+	/// @brief Local space bounds, computed from the positions given to set_vertices.
+	const AABB& get_bounds() const { return bounds; }
+	const BoundingSphere& get_sphere() const { return sphere; }
 };
 
 enum TextureFormat {
@@ -129,6 +268,8 @@ enum TextureFormat {
 	D24_S8,
 };
 uint to_gl(TextureFormat format);
+/// @brief Sized internal format, compressed ones need GL_EXT_texture_compression_s3tc, RGTC and BPTC.
+uint to_gl(PixelFormat format);
 enum TextureWrap {
 	Repeat,
 	Mirrored,
@@ -155,9 +296,26 @@ public:
 
 class GPUTexture2D : public GPUTexture {
 	GL_ID gl_texture;
+	glm::uvec2 size = glm::uvec2(0);
+	size_t gpu_bytes = 0;
+	uint base_level = 0;
 
 public:
 	GPUTexture2D();
+	~GPUTexture2D();
+	glm::uvec2 get_size() const { return size; }
+	/// @brief Memory used by every mip.
+	size_t get_gpu_bytes() const { return gpu_bytes; }
+	/// @brief Uploads a prebuilt mip chain as it is, compressed formats go straight to the GPU without decoding. Only the
+	/// mips from first on are uploaded and sampled, finer ones can be added later. GL cannot free single levels, so a
+	/// texture that already had mips is recreated, keeping its sampler parameters.
+	void set_mips(PixelFormat format, const std::vector<TextureMip>& mips, uint first = 0);
+	/// @brief Uploads the mip one level finer than the base level and samples from it.
+	void add_finer_mip(PixelFormat format, const TextureMip& mip);
+	/// @brief Finest level uploaded.
+	uint get_base_level() const { return base_level; }
+	/// @brief Finest level sampled, relative to the base level. Fractional values blend between levels.
+	void set_min_lod(float lod);
 
 public:
 	GL_ID get_gl_id() const override { return gl_texture; }
@@ -230,9 +388,13 @@ public:
 
 class GPUCubemapTexture : public GPUTexture {
 	GL_ID gl_cubemap;
+	glm::uvec2 size = glm::uvec2(0);
 
 public:
 	GPUCubemapTexture();
+	~GPUCubemapTexture();
+	/// @brief Size of each face.
+	glm::uvec2 get_size() const { return size; }
 
 	GL_ID get_gl_id() const override;
 	uint get_gl_type() const override;
@@ -241,11 +403,137 @@ public:
 	void set_as_rgb8(uint width, uint heigth, std::vector<unsigned char*> data);
 };
 
+/// @brief Coarser version of a model, with one mesh for each mesh of the full detail level.
+struct ModelLOD {
+	std::vector<GPUMesh*> meshes;
+	/// @brief Used once the model covers less than this fraction of the screen height.
+	float screen_size;
+};
+
 class GPUModel {
 public:
+	/// @brief Full detail level.
 	std::vector<GPUMesh*> meshes;
+	/// @brief Coarser levels, ordered by decreasing screen size.
+	std::vector<ModelLOD> lods;
+	AABB bounds;
+	BoundingSphere sphere;
+
+	/// @brief Merges the bounds of every mesh. Must be called after the mesh list changes.
+	void update_bounds();
+	uint get_lod_count() const { return (uint)lods.size() + 1; }
+	const std::vector<GPUMesh*>& get_lod_meshes(uint lod) const { return lod == 0 ? meshes : lods[lod - 1].meshes; }
+	/// @brief Level for a projected size. The current level is kept until the size moves past a threshold by more than
+	/// the hysteresis fraction, so models sitting at a threshold do not switch every frame.
+	uint select_lod(float screen_size, uint current, float hysteresis) const;
+};
+
+/// @brief GPU buffer backing a uniform block. Bound to a fixed binding point so every shader declaring the block reads it.
+class GPUUniformBuffer {
+	GL_ID gl_ubo;
+	uint size;
+
+public:
+	GPUUniformBuffer();
+
+	GL_ID get_gl_id() const { return gl_ubo; }
+	void set_data(const void* data, uint size);
+	void bind(UniformBlockBinding binding) const;
+};
+
+/// @brief Vertex buffer streamed every pass with the model and normal matrix of each instance.
+class GPUInstanceBuffer {
+	GL_ID gl_vbo;
+	size_t capacity;
+
+public:
+	GPUInstanceBuffer();
+
+	GL_ID get_gl_id() const { return gl_vbo; }
+	/// @brief Orphans the previous contents so the driver does not stall on draws still reading them.
+	void set_data(const std::vector<InstanceData>& instances);
+};
+
+/// @brief Buffer read by shaders through a samplerBuffer. The format is a sized GL internal format like GL_RGBA32F.
+class GPUTextureBuffer {
+	GL_ID gl_buffer;
+	GL_ID gl_texture;
+	uint format;
+	size_t capacity;
+
+public:
+	GPUTextureBuffer();
+
+	void set_format(uint format);
+	void set_data(const void* data, size_t size);
+	void activate(uint unit) const;
+};
+
+/// @brief Draw indirect buffer streamed every pass with the commands built by IndirectCommandBuilder.
+class GPUIndirectBuffer {
+	GL_ID gl_buffer;
+	size_t capacity;
+
+public:
+	GPUIndirectBuffer();
+
+	GL_ID get_gl_id() const { return gl_buffer; }
+	/// @brief Uploads the commands and leaves the buffer bound to GL_DRAW_INDIRECT_BUFFER.
+	void set_data(const std::vector<DrawElementsIndirectCommand>& commands);
+};
+
+/// @brief Measures the GPU time spent between begin and end. Results are read a few frames later so fetching them does
+/// not stall the pipeline. Only one timer can be running at a time.
+class GPUTimerQuery {
+	static constexpr uint LATENCY = 3;
+	std::array<GL_ID, LATENCY> gl_queries;
+	std::array<bool, LATENCY> pending = {};
+	uint current = 0;
+	double elapsed_ms = 0.0;
+
+public:
+	GPUTimerQuery();
+
+	void begin();
+	void end();
+	/// @brief Latest measurement available, in milliseconds.
+	double get_ms() const { return elapsed_ms; }
+	/// @brief Drops the measurement and the queries still in flight, for passes that stopped running.
+	void reset();
+};
+
+// std140 layouts of the uniform blocks, see pbr.frag.
+// Three texels of the lightData buffer, directional lights first.
+struct GPULightData {
+	glm::vec4 position; // w: light type
+	glm::vec4 direction; // w: first shadow view, -1 if the light casts no shadows
+	glm::vec4 color; // rgb: color * intensity, w: range
 };
 
+struct GPUFrameData {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::vec4 view_pos;
+	glm::vec4 ambient; // w: intensity
+	glm::ivec4 light_count; // x: directional lights, y: all lights, z: cascades per directional light
+	glm::ivec4 cluster_grid; // xyz: cells per axis
+	glm::vec4 cluster_params; // x: depth slice scale, y: depth slice bias
+	glm::vec4 cascade_splits; // Far view depth of every cascade
+	glm::mat4 light_matrices[MAX_SHADOWS];
+	glm::vec4 shadow_tiles[MAX_SHADOWS]; // xy: atlas offset, z: atlas size, w: layer
+};
+static_assert(sizeof(GPUFrameData) == 224 + MAX_SHADOWS * (sizeof(glm::mat4) + sizeof(glm::vec4)), "GPUFrameData must follow std140");
+
+struct GPUPbrMaterialData {
+	glm::vec4 albedo;
+	glm::vec4 emissive;
+	float metallic;
+	float roughness;
+	float ambient_occlusion;
+	float padding;
+};
+static_assert(sizeof(GPUPbrMaterialData) == 48, "GPUPbrMaterialData must follow std140");
+
 class GPUMaterial {
 	GPUShader* shader;
 	std::vector<GPUTexture*> textures = std::vector<GPUTexture*>(16, nullptr);
@@ -257,10 +545,18 @@ public:
 	GPUShader* get_shader() { return shader; }
 	void set_texture(uint id, GPUTexture* texture) { this->textures[id] = texture; }
 	void set_texture(SamplerID id, GPUTexture* texture) { this->textures[id] = texture; }
+	const std::vector<GPUTexture*>& get_textures() const { return textures; }
+	/// @brief Called once per frame to push changed parameters to the GPU.
 	virtual void update_internals() {}
+	/// @brief Called on every use_material to bind per material GPU state.
+	virtual void bind_internals() const {}
 };
 
 class GPUPbrMaterial : public GPUMaterial {
+	GPUUniformBuffer* ubo;
+	GPUPbrMaterialData uploaded;
+	bool has_uploaded = false;
+
 public:
 	glm::vec4 albedo = glm::vec4(1.0, 1.0, 1.0, 1.0);
 	glm::vec4 emissive = glm::vec4(0.0, 0.0, 0.0, 0.0);
@@ -268,21 +564,40 @@ public:
 	float roughness = 0.1f;
 	float ambient_occlusion = 1.0f;
 
+	GPUPbrMaterial();
 	void update_internals() override;
+	void bind_internals() const override;
 };
 
+/// @brief Model drawn with a material at a transform. The model and material are referenced by handle, so a visual
+/// whose model was released by the asset registry is skipped instead of reading freed memory.
 class GPUVisual {
-	glm::mat4 xform;
-	GPUMaterial* material;
-	GPUModel* model;
+	InstanceData instance;
+	Handle<GPUMaterial> material;
+	Handle<GPUModel> model;
+	uint version = 0;
+	uint lod = 0;
 
 public:
-	void set_xform(glm::mat4 xform) { this->xform = xform; }
-	glm::mat4* get_xform() { return &xform; }
-	void set_model(GPUModel* model) { this->model = model; }
-	GPUModel* get_model() { return model; }
-	void set_material(GPUMaterial* shader) { this->material = shader; }
-	GPUMaterial* get_material() { return material; }
+	void set_xform(glm::mat4 xform);
+	const glm::mat4* get_xform() const { return &instance.model; }
+	const InstanceData* get_instance() const { return &instance; }
+	void set_model(Handle<GPUModel> model) { this->model = model; lod = 0; version++; }
+	void set_model(GPUModel* model);
+	/// @brief Bumped whenever the world bounds may have changed.
+	uint get_version() const { return version; }
+	Handle<GPUModel> get_model_handle() const { return model; }
+	/// @brief Resolves the model handle, nullptr if none was set or it was destroyed.
+	GPUModel* get_model() const;
+	void set_material(Handle<GPUMaterial> material) { this->material = material; }
+	void set_material(GPUMaterial* material);
+	Handle<GPUMaterial> get_material_handle() const { return material; }
+	/// @brief Resolves the material handle, nullptr if none was set or it was destroyed.
+	GPUMaterial* get_material() const;
+	AABB get_world_bounds() const;
+	/// @brief Level of detail the camera drew last, the start point of the next selection.
+	uint get_lod() const { return lod; }
+	void set_lod(uint lod) { this->lod = lod; }
 };
 
 enum LightType {
@@ -295,9 +610,13 @@ struct Light {
 	glm::vec3 position;
 	float intensity;
 	glm::vec3 color;
+	/// @brief Distance where point lights fade out completely, also used to bin them into light clusters.
+	float range = 10.0f;
 
 	glm::mat4 build_view_matrix();
 	glm::mat4 build_proj_matrix();
+	/// @brief View of one face of a point light shadow cube, in +X -X +Y -Y +Z -Z order.
+	glm::mat4 build_cube_view_matrix(uint face);
 
 	void set_cast_shadows(bool state);
 	bool get_cast_shadows() { return cast_shadows; }
@@ -306,6 +625,30 @@ private:
 	bool cast_shadows;
 };
 
+// Plain data nothing keeps raw pointers to across frames, the backend compacts their pools.
+template <> struct is_pool_relocatable<Camera> : std::true_type {};
+template <> struct is_pool_relocatable<Light> : std::true_type {};
+template <> struct is_pool_relocatable<GPUVisual> : std::true_type {};
+
+
+/// @brief GPU time of the world passes, in milliseconds.
+struct PassTimings {
+	double shadows = 0.0;
+	double depth_prepass = 0.0;
+	double opaque = 0.0;
+};
+
+struct ShadowStats {
+	uint rendered = 0;
+	uint cached = 0;
+};
+
+struct LODSettings {
+	/// @brief Fraction the screen size has to move past a threshold before the level changes.
+	float hysteresis = 0.1f;
+	/// @brief Levels added to the level picked from the shadow view, their texels rarely show the difference.
+	uint shadow_bias = 1;
+};
 
 struct RendererError {
 	std::string error;
@@ -316,26 +659,111 @@ private:
 	GPUFrameBuffer* shadows_fbo;
 	GPUMaterial* shadowmap_mat;
 	GPUTexture2DArray* shadowmap_textures;
+	GPUUniformBuffer* frame_ubo;
+	GPUInstanceBuffer* instance_buffer;
+	GPUIndirectBuffer* indirect_buffer;
+	GPUGeometryBuffer* geometry;
+	IndirectCommandBuilder indirect_commands;
+	bool multi_draw_indirect;
+	bool bc_compression;
+
+	// Each world has its own timers, one set shared by every world rendered in a frame would mix their numbers.
+	struct WorldTimers {
+		GPUTimerQuery* shadows;
+		GPUTimerQuery* depth_prepass;
+		GPUTimerQuery* opaque;
+	};
+	std::unordered_map<Handle<RenderWorld>, WorldTimers> world_timers;
+
+	// Lights of the world being rendered, directional ones first, with the first shadow view they were given.
+	// Directional lights own one view per cascade and point lights one per cube face.
+	struct FrameLight {
+		Light* light;
+		int shadow_view;
+	};
+	struct ShadowView {
+		Light* light;
+		uint face; // Cascade or cube face.
+		ShadowTile tile;
+		glm::mat4 view;
+		glm::mat4 proj;
+	};
+	std::vector<FrameLight> frame_lights;
+	std::vector<ShadowView> shadow_views;
+	std::vector<uint> shadow_sizes;
+	std::vector<ShadowTile> shadow_tiles;
+	ShadowAtlas shadow_atlas;
+	// Views whose tile still holds a valid shadowmap, reused while the view and the casters inside it do not change.
+	std::vector<ShadowView> shadow_cache;
+	std::vector<ShadowView> next_shadow_cache;
+	RenderWorld* shadow_cache_world = nullptr;
+	uint shadow_cache_bias = 0;
+	ShadowStats shadow_stats;
+	std::vector<ShadowCascade> cascades;
+	glm::vec4 cascade_splits;
+	uint cascade_count;
+	std::vector<GPULightData> light_data;
+	std::vector<ClusterLight> cluster_lights;
+	LightClusterGrid light_clusters;
+	GPUTextureBuffer* light_buffer;
+	GPUTextureBuffer* cluster_cells_buffer;
+	GPUTextureBuffer* cluster_indices_buffer;
 
 	bool imgui_installed;
+	GLStateStats gl_frame_stats;
+
+	RenderQueue render_queue;
+	RenderQueueStats queue_stats;
+	RenderQueueStats queue_frame_stats;
+
+	std::vector<GPUVisual*> visible_visuals;
+
+	// Point of view levels of detail are picked from.
+	struct LODView {
+		glm::vec3 eye;
+		float proj_scale;
+		bool ortho;
+
+		static LODView from_matrices(glm::mat4 proj, glm::mat4 view);
+	};
+	// Camera passes pick levels from the camera. Shadow passes pick them from the shadow view being rendered, so the
+	// level a caster gets only depends on what the shadow cache already compares and a cached tile never goes stale.
+	bool lod_camera = false;
+	LODView lod_camera_view;
+	LODView lod_shadow_view;
+	float lod_viewport_height;
 
 public:
+	GLStateCache gl_state;
+
+	/// @brief True when the driver can sample every block compressed PixelFormat.
+	bool supports_bc_compression() const { return bc_compression; }
+	// Declared before the pools, textures unregister from it when destroyed.
+	TextureStreamer texture_streamer;
+	ProgramCache program_cache;
 
 	std::vector<AppWindow*> windows;
 	MemPool<RenderWorld> worlds;
 	MemPool<Viewport> viewports;
 	MemPool<RenderEnviroment> enviroments;
 	MemPool<GPUShader> shaders;
+	// Declared before the meshes so it outlives them, meshes return their ranges when destroyed.
+	MemPool<GPUGeometryBuffer> geometry_buffers;
 	MemPool<GPUMesh> meshes;
 	MemPool<GPUTexture2D> textures;
 	MemPool<GPUTexture2DArray> texture_arrays;
 	MemPool<GPUCubemapTexture> cubemaps;
 	MemPool<GPURenderBuffer> render_buffers;
 	MemPool<GPUFrameBuffer> frame_buffers;
+	MemPool<GPUUniformBuffer> uniform_buffers;
+	MemPool<GPUInstanceBuffer> instance_buffers;
+	MemPool<GPUIndirectBuffer> indirect_buffers;
+	MemPool<GPUTextureBuffer> texture_buffers;
+	MemPool<GPUTimerQuery> timer_queries;
 	MemPool<Light> lights;
 	MemPool<GPUModel> models;
 	MemPool<Camera> cameras;
-	MemPool<GPUMaterial> materials;
+	MemPool<GPUMaterial, sizeof(GPUPbrMaterial)> materials;
 	MemPool<GPUVisual> visuals;
 
 
@@ -345,10 +773,29 @@ private:
 	Result<void, RendererError> setup_internals();
 	Result<void, RendererError> setup_imgui();
 
-	void render_shadowmaps(std::vector<Light*> lights, std::vector<GPUVisual*> visuals);
+	/// @brief Timers of the world, created the first time it renders.
+	WorldTimers& get_world_timers(RenderWorld* world);
+	/// @brief Frustum culls the visuals of the world. The result is overwritten by the next call.
+	const std::vector<GPUVisual*>& cull_visuals(RenderWorld* world, glm::mat4 view_proj);
+	void gather_lights(RenderWorld* world);
+	/// @brief Atlas tile size a shadow casting light asks for, 0 if none of its shadows can be seen.
+	uint get_shadow_importance(Light* light, Option<Camera*> camera);
+	/// @brief True if the tile still holds this view and no caster inside it changed.
+	bool is_shadow_cached(const ShadowView& view, const std::vector<AABB>& changed_bounds) const;
+	void render_shadowmaps(RenderWorld* world);
+	/// @brief Bins the point lights into the camera clusters and uploads the light buffers.
+	void update_light_clusters(RenderWorld* world);
 	void render_skybox(RenderWorld* world);
-	void render_visuals(glm::mat4 proj, glm::mat4 view, std::vector<GPUVisual*> visuals, GPUMaterial* mat_override);
+	/// @brief Renders the opaque visuals of the camera, after a depth only pass if the world asks for it.
+	void render_opaque(RenderWorld* world, glm::mat4 proj, glm::mat4 view);
+	/// @brief Level of detail of the visual for the pass. Camera passes remember it in the visual, shadows add the bias.
+	uint select_lod(GPUVisual* visual, RenderPass pass);
+	/// @brief Fraction of the view height covered by the bounding sphere of the visual.
+	float get_screen_size(GPUVisual* visual, const LODView& lod_view) const;
+	void render_visuals(RenderPass pass, glm::mat4 proj, glm::mat4 view, const std::vector<GPUVisual*>& visuals, GPUMaterial* mat_override);
+	void submit_queue(glm::mat4 view_proj, const RenderQueue& queue);
 	void render_visual(GPUMaterial* material, GPUModel* model);
+	void update_frame_data(RenderWorld* world);
 	void update_material_globals(RenderWorld* world);
 	void render_visual(GPUVisual* visual);
 
@@ -357,6 +804,19 @@ public:
 	RendererBackend();
 	Result<void, RendererError> setup();
 	bool is_imgui_installed() { return imgui_installed; }
+	/// @brief GL state calls issued and skipped by the state cache during the last frame.
+	const GLStateStats& get_gl_stats() const { return gl_frame_stats; }
+	/// @brief Draws and state changes submitted by the render queues during the last frame.
+	const RenderQueueStats& get_queue_stats() const { return queue_frame_stats; }
+	/// @brief Shadow views rendered and reused from the atlas during the last frame.
+	const ShadowStats& get_shadow_stats() const { return shadow_stats; }
+	/// @brief GPU time of the passes of the world, measured a few frames ago. Passes the world skips report zero.
+	PassTimings get_pass_timings(RenderWorld* world) const;
+	ShadowCascadeSettings shadow_cascades;
+	LODSettings lod_settings;
+
+	/// @brief Shared buffer meshes with the layout allocate their vertices and indices from, created on first use.
+	GPUGeometryBuffer* get_geometry(const VertexLayout& layout = VertexLayout());
 
 	AppWindow* get_main_window() { return windows[0]; }
 
@@ -365,6 +825,9 @@ public:
 	void destroy_window(AppWindow* wnd);
 
 	void debug_backend(RenderWorld* world);
+	/// @brief Compacts the visual, light and camera pools that are mostly empty. Handles survive it, raw pointers to
+	/// those objects must not be kept across frames. Runs at the end of every render_worlds().
+	void compact_pools();
 
 	void render_worlds();
 	Result<void, RendererError> render_world(RenderWorld* world);
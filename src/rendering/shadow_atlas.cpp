@@ -0,0 +1,61 @@
+#include "shadow_atlas.h"
+#include <algorithm>
+#include <numeric>
+#include <bit>
+
+glm::vec4 ShadowTile::get_uv_rect(uint resolution) const {
+	return glm::vec4(glm::vec2(offset) / (float)resolution, (float)size / resolution, (float)layer);
+}
+
+// Even bits of the Morton index are x, odd bits are y.
+static uint compact_bits(uint v) {
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0F0F0F0F;
+	v = (v | (v >> 4)) & 0x00FF00FF;
+	v = (v | (v >> 8)) & 0x0000FFFF;
+	return v;
+}
+
+void ShadowAtlas::allocate(const std::vector<uint>& sizes, std::vector<ShadowTile>& tiles) {
+	tiles.assign(sizes.size(), ShadowTile());
+
+	// Work in MIN_TILE sized cells, a tile of size s covers (s / MIN_TILE)^2 of them.
+	uint cells_per_layer = (resolution / MIN_TILE) * (resolution / MIN_TILE);
+	uint capacity = cells_per_layer * layers;
+	std::vector<uint> tile_sizes(sizes.size());
+	uint64_t requested = 0;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		tile_sizes[i] = std::clamp(std::bit_ceil(std::max(sizes[i], 1u)), MIN_TILE, resolution);
+		requested += (tile_sizes[i] / MIN_TILE) * (tile_sizes[i] / MIN_TILE);
+	}
+	while (requested > capacity) {
+		bool shrunk = false;
+		requested = 0;
+		for (auto& size : tile_sizes) {
+			if (size > MIN_TILE) { size /= 2; shrunk = true; }
+			requested += (size / MIN_TILE) * (size / MIN_TILE);
+		}
+		if (!shrunk) break;
+	}
+
+	order.resize(sizes.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&tile_sizes](uint a, uint b) { return tile_sizes[a] > tile_sizes[b]; });
+
+	// Every placed tile is at least as big as the next one, so the cursor is always aligned to the next tile size and
+	// a layer either has room for it or is completely full.
+	uint cursor = 0;
+	for (auto i : order) {
+		uint cells = (tile_sizes[i] / MIN_TILE) * (tile_sizes[i] / MIN_TILE);
+		if (cursor + cells > capacity) break;
+
+		uint cell = cursor % cells_per_layer;
+		tiles[i] = ShadowTile{
+			.layer = cursor / cells_per_layer,
+			.offset = glm::uvec2(compact_bits(cell), compact_bits(cell >> 1)) * MIN_TILE,
+			.size = tile_sizes[i],
+		};
+		cursor += cells;
+	}
+}
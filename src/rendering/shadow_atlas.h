@@ -0,0 +1,38 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+typedef unsigned int uint;
+
+/// @brief Square region of the shadow atlas in texels. Tiles with size 0 were not placed.
+struct ShadowTile {
+	uint layer = 0;
+	glm::uvec2 offset = glm::uvec2(0);
+	uint size = 0;
+
+	bool operator==(const ShadowTile&) const = default;
+	/// @brief xy: offset, z: size, both in atlas UVs, w: layer.
+	glm::vec4 get_uv_rect(uint resolution) const;
+};
+
+/// @brief Packs power of two square tiles into the layers of a shadowmap array. Tiles are placed largest first along a
+/// Morton curve, which keeps every tile aligned to its own size without tracking free space. Placement only depends on
+/// the requested sizes, so the same requests land on the same tiles every frame.
+class ShadowAtlas {
+	uint resolution = 2048;
+	uint layers = 4;
+	std::vector<uint> order;
+
+public:
+	static constexpr uint MIN_TILE = 128;
+
+	void set_size(uint resolution, uint layers) { this->resolution = resolution; this->layers = layers; }
+	uint get_resolution() const { return resolution; }
+	uint get_layers() const { return layers; }
+
+	/// @brief Places one tile per requested size, tiles[i] belongs to sizes[i]. Sizes are rounded up to powers of two.
+	/// If the atlas is too small every tile above MIN_TILE is halved until they fit, tiles that still do not fit get
+	/// size 0.
+	void allocate(const std::vector<uint>& sizes, std::vector<ShadowTile>& tiles);
+};
@@ -0,0 +1,69 @@
+#include "shadow_cascades.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+void fit_shadow_cascades(const glm::mat4& camera_view, const glm::mat4& camera_proj, glm::vec3 light_dir,
+	const ShadowCascadeSettings& settings, uint resolution, std::vector<ShadowCascade>& cascades) {
+	cascades.clear();
+	uint count = std::clamp(settings.cascades, 2u, MAX_CASCADES);
+
+	float near_plane = camera_proj[3][2] / (camera_proj[2][2] - 1.0f);
+	float far_plane = std::min(camera_proj[3][2] / (camera_proj[2][2] + 1.0f), settings.max_distance);
+
+	// World space corners of the camera frustum, near ones first, clamped to the shadow distance.
+	glm::mat4 inv_view_proj = glm::inverse(camera_proj * camera_view);
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 ndc = glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i < 4 ? -1.0f : 1.0f, 1.0f);
+		glm::vec4 p = inv_view_proj * ndc;
+		corners[i] = glm::vec3(p) / p.w;
+	}
+	float full_far = camera_proj[3][2] / (camera_proj[2][2] + 1.0f);
+	for (int i = 0; i < 4; i++) {
+		corners[i + 4] = corners[i] + (corners[i + 4] - corners[i]) * ((far_plane - near_plane) / (full_far - near_plane));
+	}
+
+	// Fixed light orientation, only the projection moves with the camera.
+	light_dir = glm::normalize(light_dir);
+	glm::vec3 up = std::abs(light_dir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), light_dir, up);
+
+	float prev_split = near_plane;
+	for (uint c = 0; c < count; c++) {
+		float t = (float)(c + 1) / count;
+		float log_split = near_plane * std::pow(far_plane / near_plane, t);
+		float uniform_split = near_plane + (far_plane - near_plane) * t;
+		float split = settings.split_lambda * log_split + (1.0f - settings.split_lambda) * uniform_split;
+
+		float t0 = (prev_split - near_plane) / (far_plane - near_plane);
+		float t1 = (split - near_plane) / (far_plane - near_plane);
+		glm::vec3 slice[8];
+		glm::vec3 center = glm::vec3(0.0f);
+		for (int i = 0; i < 4; i++) {
+			slice[i] = corners[i] + (corners[i + 4] - corners[i]) * t0;
+			slice[i + 4] = corners[i] + (corners[i + 4] - corners[i]) * t1;
+			center += slice[i] + slice[i + 4];
+		}
+		center /= 8.0f;
+
+		float radius = 0.0f;
+		for (auto& corner : slice) radius = std::max(radius, glm::length(corner - center));
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// Snap the center to the texel grid in light space.
+		float texel = 2.0f * radius / resolution;
+		glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.0f));
+		light_center.x = std::floor(light_center.x / texel) * texel;
+		light_center.y = std::floor(light_center.y / texel) * texel;
+
+		// Light view looks down -z, so depths in front of the center are -light_center.z +- radius.
+		cascades.push_back(ShadowCascade{
+			.view = light_view,
+			.proj = glm::ortho(light_center.x - radius, light_center.x + radius, light_center.y - radius, light_center.y + radius,
+				-light_center.z - radius - settings.caster_distance, -light_center.z + radius),
+			.split_depth = split,
+		});
+		prev_split = split;
+	}
+}
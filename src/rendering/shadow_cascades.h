@@ -0,0 +1,30 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+typedef unsigned int uint;
+
+const uint MAX_CASCADES = 4;
+
+struct ShadowCascadeSettings {
+	/// @brief Cascades per directional light, clamped to [2, MAX_CASCADES].
+	uint cascades = 4;
+	/// @brief Blend between logarithmic (1) and uniform (0) split distances.
+	float split_lambda = 0.75f;
+	/// @brief Shadows end at this view distance even if the camera sees further.
+	float max_distance = 100.0f;
+	/// @brief Extra depth towards the light so casters outside the camera slice still reach the map.
+	float caster_distance = 50.0f;
+};
+
+struct ShadowCascade {
+	glm::mat4 view;
+	glm::mat4 proj;
+	float split_depth; // Far view space depth covered by the cascade.
+};
+
+/// @brief Splits the camera frustum with the practical split scheme and fits an orthographic light projection to each
+/// slice. Slices are bounded by spheres so the projection size does not change when the camera rotates, and the
+/// projection is snapped to whole shadowmap texels so static shadows do not shimmer when it moves.
+void fit_shadow_cascades(const glm::mat4& camera_view, const glm::mat4& camera_proj, glm::vec3 light_dir,
+	const ShadowCascadeSettings& settings, uint resolution, std::vector<ShadowCascade>& cascades);
@@ -0,0 +1,128 @@
+#include "texture_streamer.h"
+#include "renderer.h"
+#include "../thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+void TextureStreamer::add(GPUTexture2D* texture, std::shared_ptr<TextureStreamSource> source) {
+	StreamedTexture streamed;
+	streamed.texture = texture;
+	streamed.source = source;
+	uint count = (uint)source->mips.size();
+	streamed.chain_bytes.resize(count + 1, 0);
+	for (uint level = count; level-- > 0;) streamed.chain_bytes[level] = streamed.chain_bytes[level + 1] + source->mips[level].data.size();
+
+	// The last mip is always resident, even if it is larger than the resident size.
+	streamed.tail = count - 1;
+	while (streamed.tail > 0) {
+		auto size = source->mips[streamed.tail - 1].size;
+		if (glm::max(size.x, size.y) > settings.resident_size) break;
+		streamed.tail--;
+	}
+	streamed.wanted = streamed.tail;
+	streamed.min_lod = (float)streamed.tail;
+	streamed.loading = NO_LEVEL;
+
+	texture->set_mips(source->format, source->mips, streamed.tail);
+	textures[texture] = std::move(streamed);
+}
+
+void TextureStreamer::remove(const GPUTexture2D* texture) {
+	// Reads still running keep the source alive on their own.
+	textures.erase(texture);
+}
+
+void TextureStreamer::request(const GPUTexture* texture, float pixels) {
+	auto it = textures.find(texture);
+	if (it == textures.end()) return;
+	auto& streamed = it->second;
+
+	// Assumes the texture wraps the visual once, the level that maps one texel to each pixel is enough.
+	auto size = streamed.source->mips[0].size;
+	float ratio = (float)glm::max(size.x, size.y) / glm::max(pixels, 1.0f);
+	int level = (ratio <= 1.0f ? 0 : (int)std::floor(std::log2(ratio))) + settings.mip_bias;
+	uint clamped = (uint)glm::clamp(level, 0, (int)streamed.tail);
+
+	streamed.wanted = streamed.last_seen == frame ? glm::min(streamed.wanted, clamped) : clamped;
+	streamed.last_seen = frame;
+}
+
+size_t TextureStreamer::get_full_bytes(const GPUTexture* texture) const {
+	auto it = textures.find(texture);
+	return it == textures.end() ? 0 : it->second.chain_bytes[0];
+}
+
+uint TextureStreamer::get_target_level(const StreamedTexture& streamed) const {
+	if (streamed.last_seen == frame) return streamed.wanted;
+	// Recently drawn textures keep what they have, in case they show up again.
+	if (frame - streamed.last_seen <= settings.keep_frames) return streamed.texture->get_base_level();
+	return streamed.tail;
+}
+
+void TextureStreamer::update(ThreadPool& workers) {
+	auto now = std::chrono::steady_clock::now();
+	float delta = std::chrono::duration<float>(now - last_update).count();
+	last_update = now;
+	stats = TextureStreamingStats();
+	stats.textures = (uint)textures.size();
+
+	// The budget goes to the textures drawn most recently first, finer requests first among those.
+	order.clear();
+	for (auto& [texture, streamed] : textures) order.push_back(&streamed);
+	std::sort(order.begin(), order.end(), [this](const StreamedTexture* a, const StreamedTexture* b) {
+		if (a->last_seen != b->last_seen) return a->last_seen > b->last_seen;
+		return get_target_level(*a) < get_target_level(*b);
+	});
+
+	size_t used = 0;
+	for (auto streamed : order) {
+		auto texture = streamed->texture;
+		auto& source = *streamed->source;
+		uint target = get_target_level(*streamed);
+		stats.wanted_bytes += streamed->chain_bytes[target];
+		while (target < streamed->tail && used + streamed->chain_bytes[target] > settings.memory_budget) target++;
+		used += streamed->chain_bytes[target];
+
+		uint base = texture->get_base_level();
+		if (target > base) {
+			texture->set_mips(source.format, source.mips, target);
+			stats.evicted_mips += target - base;
+			streamed->min_lod = glm::max(streamed->min_lod, (float)target);
+			texture->set_min_lod(streamed->min_lod - target);
+			// A finer mip being read is not needed anymore.
+			streamed->loading = NO_LEVEL;
+			streamed->ready.reset();
+			base = target;
+		}
+
+		// One level at a time from coarse to fine. The worker touches every page of the mip so a mapped file is read
+		// from disk there instead of stalling the upload.
+		if (target < base && streamed->loading == NO_LEVEL) {
+			streamed->loading = base - 1;
+			streamed->ready = std::make_shared<std::atomic<bool>>(false);
+			workers.submit([source = streamed->source, ready = streamed->ready, data = source.mips[base - 1].data] {
+				auto bytes = reinterpret_cast<const volatile std::byte*>(data.data());
+				for (size_t i = 0; i < data.size(); i += 4096) (void)bytes[i];
+				ready->store(true, std::memory_order_release);
+			});
+		}
+
+		if (streamed->loading != NO_LEVEL && streamed->ready->load(std::memory_order_acquire) && stats.uploaded_bytes < settings.upload_budget) {
+			auto& mip = source.mips[streamed->loading];
+			texture->add_finer_mip(source.format, mip);
+			stats.uploaded_bytes += mip.data.size();
+			streamed->loading = NO_LEVEL;
+			streamed->ready.reset();
+		}
+		if (streamed->loading != NO_LEVEL) stats.loading++;
+
+		// New mips blend in, sampling stays clamped to the previous level and moves down one level per fade time.
+		float base_lod = (float)texture->get_base_level();
+		if (streamed->min_lod > base_lod) {
+			streamed->min_lod = settings.fade_time > 0.0f ? glm::max(base_lod, streamed->min_lod - delta / settings.fade_time) : base_lod;
+			texture->set_min_lod(streamed->min_lod - base_lod);
+		}
+		stats.resident_bytes += texture->get_gpu_bytes();
+	}
+	frame++;
+}
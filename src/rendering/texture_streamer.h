@@ -0,0 +1,92 @@
+#pragma once
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "pixel_format.h"
+
+class GPUTexture;
+class GPUTexture2D;
+class ThreadPool;
+
+/// @brief Full mip chain of a streamed texture, readable for as long as the texture exists.
+struct TextureStreamSource {
+	PixelFormat format = PixelFormat::RGBA8;
+	std::vector<TextureMip> mips;
+	/// @brief Keeps the memory the mips point into alive, usually a mapped cooked file.
+	std::shared_ptr<void> owner;
+};
+
+struct TextureStreamingSettings {
+	/// @brief Only affects textures loaded afterwards, the ones already streamed keep streaming.
+	bool enabled = true;
+	/// @brief GPU memory streamed textures may use, in bytes. Textures seen most recently get their mips first.
+	size_t memory_budget = 512ull << 20;
+	/// @brief Mips up to this size are uploaded with the texture and never evicted.
+	uint resident_size = 64;
+	/// @brief Bytes uploaded per frame, at least one mip is uploaded when any is ready.
+	size_t upload_budget = 8ull << 20;
+	/// @brief Added to the level computed from the screen size, positive values trade detail for memory.
+	int mip_bias = 0;
+	/// @brief Frames a texture keeps its mips after it was last drawn, before they can be evicted.
+	uint keep_frames = 120;
+	/// @brief Seconds new mips take to blend in through GL_TEXTURE_MIN_LOD, zero shows them at once.
+	float fade_time = 0.25f;
+};
+
+struct TextureStreamingStats {
+	uint textures = 0;
+	/// @brief Textures with mips being read or waiting for upload.
+	uint loading = 0;
+	size_t resident_bytes = 0;
+	/// @brief Bytes every texture would use at the level its visuals asked for, ignoring the budget.
+	size_t wanted_bytes = 0;
+	size_t uploaded_bytes = 0;
+	uint evicted_mips = 0;
+};
+
+/// @brief Keeps the finer mips of textures resident only while visuals on screen need them. Textures start with the
+/// coarse tail, the renderer requests the level each visual needs from its projected size, and once per frame the
+/// missing mips are read on the workers and uploaded while the ones nobody needs are evicted to fit the budget.
+class TextureStreamer {
+	struct StreamedTexture {
+		GPUTexture2D* texture;
+		std::shared_ptr<TextureStreamSource> source;
+		/// @brief Bytes from each level to the end of the chain.
+		std::vector<size_t> chain_bytes;
+		/// @brief First level of the always resident tail.
+		uint tail;
+		/// @brief Finest level requested during the frame.
+		uint wanted;
+		uint64_t last_seen = 0;
+		float min_lod;
+		/// @brief Level being read on a worker, NO_LEVEL if none.
+		uint loading;
+		std::shared_ptr<std::atomic<bool>> ready;
+	};
+
+	std::unordered_map<const GPUTexture*, StreamedTexture> textures;
+	std::vector<StreamedTexture*> order;
+	uint64_t frame = 1;
+	std::chrono::steady_clock::time_point last_update = std::chrono::steady_clock::now();
+	TextureStreamingStats stats;
+
+	uint get_target_level(const StreamedTexture& streamed) const;
+
+public:
+	static const uint NO_LEVEL = ~0u;
+	TextureStreamingSettings settings;
+
+	/// @brief Uploads the tail of the chain and streams the rest on demand. Removed when the texture is destroyed.
+	void add(GPUTexture2D* texture, std::shared_ptr<TextureStreamSource> source);
+	void remove(const GPUTexture2D* texture);
+	/// @brief Asks for the level a texture needs to cover this many pixels on screen. Ignored for textures that are
+	/// not streamed.
+	void request(const GPUTexture* texture, float pixels);
+	/// @brief Evicts and schedules mips for the requests of the frame and uploads the ones read. Main thread only.
+	void update(ThreadPool& workers);
+	/// @brief GPU bytes of the texture with every mip resident, whatever is resident now. Zero if it is not streamed.
+	size_t get_full_bytes(const GPUTexture* texture) const;
+	const TextureStreamingStats& get_stats() const { return stats; }
+};
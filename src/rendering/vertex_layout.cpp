@@ -0,0 +1,111 @@
+#include "vertex_layout.h"
+#include <glm/gtc/packing.hpp>
+#include <cstring>
+#include <cmath>
+
+uint get_format_size(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::Float2: return 8;
+	case VertexFormat::Float3: return 12;
+	case VertexFormat::Half2: return 4;
+	case VertexFormat::Half4: return 8;
+	case VertexFormat::Unorm16x2: return 4;
+	case VertexFormat::Snorm16x2: return 4;
+	case VertexFormat::Unorm8x4: return 4;
+	case VertexFormat::None:
+	default:
+		return 0;
+	}
+}
+
+glm::vec2 encode_octahedral(glm::vec3 dir) {
+	float l1 = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+	if (l1 == 0.0f) return glm::vec2(0.0f);
+
+	glm::vec2 oct = glm::vec2(dir) / l1;
+	if (dir.z < 0.0f) {
+		glm::vec2 sign = glm::vec2(oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f);
+		oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * sign;
+	}
+	return oct;
+}
+
+glm::vec3 decode_octahedral(glm::vec2 oct) {
+	glm::vec3 dir = glm::vec3(oct, 1.0f - std::abs(oct.x) - std::abs(oct.y));
+	if (dir.z < 0.0f) {
+		glm::vec2 sign = glm::vec2(dir.x >= 0.0f ? 1.0f : -1.0f, dir.y >= 0.0f ? 1.0f : -1.0f);
+		glm::vec2 xy = (1.0f - glm::abs(glm::vec2(dir.y, dir.x))) * sign;
+		dir.x = xy.x;
+		dir.y = xy.y;
+	}
+	return glm::normalize(dir);
+}
+
+uint VertexLayout::get_offset(VertexAttribute attribute) const {
+	uint offset = 0;
+	for (int i = 0; i < attribute; i++) offset += get_format_size(formats[i]);
+	return offset;
+}
+
+uint VertexLayout::get_stride() const {
+	return get_offset(VERTEX_ATTRIBUTE_COUNT);
+}
+
+template <typename T>
+static void write(std::byte*& dst, const T& value) {
+	std::memcpy(dst, &value, sizeof(T));
+	dst += sizeof(T);
+}
+
+// Vec2 attributes only use xy, unit vectors only use xyz.
+static void encode_attribute(VertexFormat format, glm::vec3 value, std::byte*& dst) {
+	switch (format) {
+	case VertexFormat::Float2:
+		write(dst, glm::vec2(value));
+		break;
+	case VertexFormat::Float3:
+		write(dst, value);
+		break;
+	case VertexFormat::Half2:
+		write(dst, glm::packHalf2x16(glm::vec2(value)));
+		break;
+	case VertexFormat::Half4:
+		write(dst, glm::packHalf4x16(glm::vec4(value, 1.0f)));
+		break;
+	case VertexFormat::Unorm16x2:
+		write(dst, glm::packUnorm2x16(glm::vec2(value)));
+		break;
+	case VertexFormat::Snorm16x2:
+		write(dst, glm::packSnorm2x16(encode_octahedral(value)));
+		break;
+	case VertexFormat::Unorm8x4:
+		write(dst, glm::packUnorm4x8(glm::vec4(value, 1.0f)));
+		break;
+	case VertexFormat::None:
+	default:
+		break;
+	}
+}
+
+void VertexLayout::encode(const std::vector<Vertex>& vertices, std::vector<std::byte>& out) const {
+	out.resize(get_stride() * vertices.size());
+	std::byte* dst = out.data();
+	for (auto& vertex : vertices) {
+		encode_attribute(formats[VertexPosition], vertex.position, dst);
+		encode_attribute(formats[VertexNormal], vertex.normal, dst);
+		encode_attribute(formats[VertexTangent], vertex.tangent, dst);
+		encode_attribute(formats[VertexColor], vertex.color, dst);
+		encode_attribute(formats[VertexCoords], glm::vec3(vertex.coords, 0.0f), dst);
+	}
+}
+
+void VertexLayout::encode_indices(const std::vector<unsigned int>& indices, std::vector<std::byte>& out) const {
+	out.resize(get_index_size() * indices.size());
+	std::byte* dst = out.data();
+	if (indices.empty()) return;
+	if (index_format == IndexFormat::U32) {
+		std::memcpy(dst, indices.data(), out.size());
+		return;
+	}
+	for (auto index : indices) write(dst, (uint16_t)index);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+typedef unsigned int uint;
+
+/// @brief Unpacked vertex, the input of every layout.
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 normal = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+	glm::vec2 coords = glm::vec2(0.0f, 0.0f);
+};
+
+/// @brief Vertex attribute locations, shared by every shader.
+enum VertexAttribute {
+	VertexPosition = 0,
+	VertexNormal,
+	VertexTangent,
+	VertexColor,
+	VertexCoords,
+	VERTEX_ATTRIBUTE_COUNT,
+};
+
+enum class VertexFormat : uint8_t {
+	None = 0, // Not stored, shaders read the default attribute value.
+	Float2,
+	Float3,
+	Half2,
+	Half4, // Three halves and padding, keeps the attribute 4 byte aligned.
+	Unorm16x2,
+	Snorm16x2, // Octahedral encoded unit vector.
+	Unorm8x4,
+};
+
+enum class IndexFormat : uint8_t {
+	U16 = 0, // Only for meshes with up to 65536 vertices, indices are relative to the mesh base vertex.
+	U32,
+};
+
+/// @brief How each attribute of a vertex is stored on the GPU, plus the width of the indices. Attributes are interleaved
+/// in VertexAttribute order.
+struct VertexLayout {
+	VertexFormat formats[VERTEX_ATTRIBUTE_COUNT] = {
+		VertexFormat::Float3, VertexFormat::Float3, VertexFormat::Float3, VertexFormat::Float3, VertexFormat::Float2,
+	};
+	IndexFormat index_format = IndexFormat::U32;
+
+	bool operator==(const VertexLayout&) const = default;
+
+	VertexFormat get_format(VertexAttribute attribute) const { return formats[attribute]; }
+	void set_format(VertexAttribute attribute, VertexFormat format) { formats[attribute] = format; }
+	uint get_offset(VertexAttribute attribute) const;
+	uint get_stride() const;
+	uint get_index_size() const { return index_format == IndexFormat::U16 ? 2 : 4; }
+
+	/// @brief Packs the vertices one after the other into out, which is resized to fit.
+	void encode(const std::vector<Vertex>& vertices, std::vector<std::byte>& out) const;
+	/// @brief Stores the indices in the index format into out, which is resized to fit.
+	void encode_indices(const std::vector<unsigned int>& indices, std::vector<std::byte>& out) const;
+};
+
+/// @brief Bytes taken by one attribute in the format.
+uint get_format_size(VertexFormat format);
+/// @brief Maps a unit vector to the [-1, 1] square of an octahedron unfolded over the xy plane.
+glm::vec2 encode_octahedral(glm::vec3 dir);
+glm::vec3 decode_octahedral(glm::vec2 oct);
@@ -0,0 +1,70 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint threads) {
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	for (uint i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+	{
+		std::lock_guard lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::parallel_for(uint count, std::function<void(uint)> job) {
+	// Shared with the helpers, a helper may only start once every index is done and the call returned.
+	struct Batch {
+		std::function<void(uint)> job;
+		uint count;
+		std::atomic<uint> next = 0;
+		std::atomic<uint> done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto batch = std::make_shared<Batch>();
+	batch->job = std::move(job);
+	batch->count = count;
+
+	auto run = [](Batch& batch) {
+		for (uint i = batch.next++; i < batch.count; i = batch.next++) {
+			batch.job(i);
+			if (++batch.done == batch.count) {
+				std::lock_guard lock(batch.mutex);
+				batch.finished.notify_all();
+			}
+		}
+	};
+
+	uint helpers = std::min(count > 0 ? count - 1 : 0, get_thread_count());
+	for (uint i = 0; i < helpers; i++) submit([batch, run] { run(*batch); });
+	run(*batch);
+
+	std::unique_lock lock(batch->mutex);
+	batch->finished.wait(lock, [&batch] { return batch->done == batch->count; });
+}
+
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+typedef unsigned int uint;
+
+/// @brief Fixed set of worker threads running jobs in the order they were submitted.
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void work();
+
+public:
+	/// @brief Zero uses one thread per core minus the main thread.
+	ThreadPool(uint threads = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	/// @brief Finishes the jobs already submitted before joining the workers.
+	~ThreadPool();
+
+	void submit(std::function<void()> job);
+	/// @brief Runs the job once for every index in [0, count) and returns when all of them finished. The calling thread
+	/// runs indices too, so jobs of this same pool can call it without waiting on themselves.
+	void parallel_for(uint count, std::function<void(uint)> job);
+	uint get_thread_count() const { return (uint)workers.size(); }
+};
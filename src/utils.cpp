@@ -20,3 +20,89 @@ const std::string utils::load_text(const char* path) {
 
 	return text;
 }
+
+uint64_t utils::hash_bytes(const void* data, size_t size, uint64_t seed) {
+	auto bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+bool utils::MappedFile::open(const char* path) {
+	close();
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	file_handle = file;
+	mapping_handle = mapping;
+	data = static_cast<const std::byte*>(view);
+	size = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void utils::MappedFile::close() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	data = nullptr;
+	size = 0;
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+}
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool utils::MappedFile::open(const char* path) {
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	// The mapping keeps its own reference to the file.
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) return false;
+
+	data = static_cast<const std::byte*>(view);
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void utils::MappedFile::close() {
+	if (data) munmap(const_cast<std::byte*>(data), size);
+	data = nullptr;
+	size = 0;
+}
+#endif
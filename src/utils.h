@@ -3,8 +3,47 @@
 #include <iostream> 
 #include <sstream>
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 
 
 namespace utils {
 	const std::string load_text(const char* path);
+
+	const uint64_t HASH_SEED = 14695981039346656037ull;
+	/// @brief 64 bit FNV-1a, chain calls by passing the previous hash as the seed.
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = HASH_SEED);
+
+	/// @brief Read only view of a whole file mapped into memory. Pages are loaded by the OS on first access, so nothing
+	/// is read until the bytes are used.
+	class MappedFile {
+		const std::byte* data = nullptr;
+		size_t size = 0;
+		void* file_handle = nullptr;
+		void* mapping_handle = nullptr;
+
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+		MappedFile& operator=(MappedFile&& other) noexcept {
+			if (this == &other) return *this;
+			close();
+			std::swap(data, other.data);
+			std::swap(size, other.size);
+			std::swap(file_handle, other.file_handle);
+			std::swap(mapping_handle, other.mapping_handle);
+			return *this;
+		}
+		~MappedFile() { close(); }
+
+		/// @brief Maps the file, closing any previous one. Returns false if it does not exist or cannot be mapped.
+		bool open(const char* path);
+		void close();
+		bool is_open() const { return data != nullptr; }
+		const std::byte* get_data() const { return data; }
+		size_t get_size() const { return size; }
+	};
 }
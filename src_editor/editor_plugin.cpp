@@ -54,6 +54,7 @@ Result<void, PluginError> EditorPlugin::setup_plugin(World* world) {
 
 	editor_ecs->component<CSelectedWorld>();
 	editor_ecs->component<CSelectedEntity>().member(flecs::Entity, "entity");
+	editor_ecs->component<CSelectedVisual>();
 
 	editor_ecs->component<CEditorWindow>().member<bool>("visible");
 	editor_ecs->component<CViewportWindow>().is_a<CEditorWindow>();
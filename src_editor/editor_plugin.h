@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../src/plugin.h"
+#include "../src/Handle.h"
 #include <imgui.h>
 
+class GPUVisual;
+
 struct CSelectedEntity {
 	flecs::entity_t entity;
 };
@@ -11,6 +14,11 @@ struct CSelectedWorld {
 	World* world;
 };
 
+/// @brief Visual last picked in the viewport, null when the click hit nothing.
+struct CSelectedVisual {
+	Handle<GPUVisual> visual;
+};
+
 class EditorPlugin : public Plugin {
 public:
 	Result<void, PluginError> setup_plugin(World* world) override;
@@ -9,6 +9,14 @@ void CEntityWindow::on_draw() {
 	auto selected_ecs = editor_ecs->ensure<CSelectedWorld>().world->get_ecs();
 	auto entity_id = editor_ecs->ensure<CSelectedEntity>().entity;
 
+	auto selected_visual = editor_ecs->ensure<CSelectedVisual>().visual;
+	if (auto visual = App::get_render_backend()->visuals.get(selected_visual)) {
+		auto bounds = visual->get_world_bounds();
+		ImGui::Text("Visual %u", selected_visual.get_index());
+		ImGui::Text("Bounds min (%.2f, %.2f, %.2f)", bounds.min.x, bounds.min.y, bounds.min.z);
+		ImGui::Text("Bounds max (%.2f, %.2f, %.2f)", bounds.max.x, bounds.max.y, bounds.max.z);
+	}
+
 	auto entity = selected_ecs->get_alive(entity_id);
 	if (!entity.is_valid()) return;
 	
@@ -2,6 +2,7 @@
 #include <imgui.h>
 #include "../../src/core.h"
 #include "../../src/rendering/render_plugin.h"
+#include "../editor_plugin.h"
 #include <print>
 
 ImVec2 CViewportWindow::get_viewport_size(ImVec2 window_size) {
@@ -46,5 +47,24 @@ void CViewportWindow::on_draw() {
 
 		ImGui::SetCursorPos(ImVec2(posX, posY));
 		ImGui::Image((void*)vp->get_color_ouput().value()->get_gl_id(), size, { 0, 1 }, { 1, 0 });
+		if (ImGui::IsItemClicked(ImGuiMouseButton_Left)) pick_visual(app_render_world->world, ImGui::GetItemRectMin(), size);
 	}
 }
+
+void CViewportWindow::pick_visual(RenderWorld* world, ImVec2 image_min, ImVec2 image_size) {
+	auto camera = world->get_active_camera();
+	if (!camera) return;
+
+	// Screen y grows downwards, NDC y upwards.
+	auto mouse = ImGui::GetMousePos();
+	glm::vec2 ndc = {
+		(mouse.x - image_min.x) / image_size.x * 2.0f - 1.0f,
+		1.0f - (mouse.y - image_min.y) / image_size.y * 2.0f,
+	};
+	glm::vec3 origin, dir;
+	camera.value()->build_ray(ndc, origin, dir);
+
+	auto& selected = editor_world->get_ecs()->ensure<CSelectedVisual>();
+	auto hit = world->raycast_visuals(origin, dir);
+	selected.visual = hit ? App::get_render_backend()->visuals.get_handle(hit.value()) : Handle<GPUVisual>();
+}
@@ -2,11 +2,15 @@
 #include "editor_window.h"
 #include <imgui.h>
 
+class RenderWorld;
+
 struct CViewportWindow : public CEditorWindow {
 private:
 	float viewport_aspect = 16.0 / 9.0;
 
 	ImVec2 get_viewport_size(ImVec2 window_size);
+	/// @brief Selects the closest visual under the mouse, the image rect is where the viewport was drawn.
+	void pick_visual(RenderWorld* world, ImVec2 image_min, ImVec2 image_size);
 
 public:
 	CViewportWindow();
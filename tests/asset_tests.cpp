@@ -0,0 +1,172 @@
+#include "test.h"
+#include "../src/assets/assets.h"
+#include <atomic>
+#include <thread>
+
+namespace {
+	struct FakeAsset {
+		std::string path;
+	};
+
+	class FakePayload : public ImportPayload {
+	public:
+		std::string path;
+	};
+
+	/// Importer without GL. The backend creates it, so what it sees is recorded in statics. Decoding can be held back
+	/// to keep a load in flight, unloads are recorded in order.
+	class FakeImport : public FileImport<FakeAsset> {
+	public:
+		static inline std::atomic<bool> hold_decoding = false;
+		static inline std::atomic<int> decodes = 0;
+		static inline int uploads = 0;
+		static inline std::vector<std::string> unloaded;
+
+		static void reset() {
+			hold_decoding = false;
+			decodes = 0;
+			uploads = 0;
+			unloaded.clear();
+		}
+
+		Result<std::unique_ptr<ImportPayload>, ImportError> decode_file(const char* path) override {
+			while (hold_decoding.load()) std::this_thread::yield();
+			decodes++;
+			auto payload = std::make_unique<FakePayload>();
+			payload->path = path;
+			return std::unique_ptr<ImportPayload>(std::move(payload));
+		}
+
+		Result<FakeAsset*, ImportError> upload(ImportPayload* payload) override {
+			uploads++;
+			return new FakeAsset{ static_cast<FakePayload*>(payload)->path };
+		}
+
+		AssetMemory get_memory(FakeAsset*) override { return AssetMemory{ .gpu = 100, .cpu = 10 }; }
+
+		void unload(FakeAsset* asset) override {
+			unloaded.push_back(asset->path);
+			delete asset;
+		}
+	};
+
+	// The backend keeps its importers for the app lifetime, each test leaks one.
+	void setup_backend(AssetBackend& assets) {
+		FakeImport::reset();
+		assets.register_importer<FakeImport>();
+		assets.memory_budget = AssetMemory{ .gpu = 1000, .cpu = 1000 };
+	}
+
+	FakeAsset* load(AssetBackend& assets, const char* path) {
+		auto asset = assets.load_file<FakeAsset>(path);
+		return asset ? asset.value() : nullptr;
+	}
+}
+
+TEST(assets_release_to_zero_keeps_cache_until_budget) {
+	AssetBackend assets;
+	setup_backend(assets);
+
+	auto first = load(assets, "a");
+	auto second = load(assets, "a");
+	CHECK(first != nullptr);
+	CHECK(first == second);
+	CHECK(FakeImport::decodes == 1);
+	CHECK(assets.get_memory_usage().gpu == 100);
+
+	// Still referenced once.
+	assets.release<FakeAsset>(AssetId("a"));
+	assets.memory_budget = AssetMemory();
+	assets.trim();
+	CHECK(FakeImport::unloaded.empty());
+	CHECK(assets.find<FakeAsset>(AssetId("a")) == first);
+
+	// The last release evicts right away since the budget is zero.
+	assets.release<FakeAsset>(AssetId("a"));
+	CHECK(FakeImport::unloaded == std::vector<std::string>{ "a" });
+	CHECK(assets.find<FakeAsset>(AssetId("a")) == nullptr);
+	CHECK(assets.get_memory_usage().gpu == 0);
+
+	// Extra releases are ignored and loading again decodes the file again.
+	assets.release<FakeAsset>(AssetId("a"));
+	assets.memory_budget = AssetMemory{ .gpu = 1000, .cpu = 1000 };
+	CHECK(load(assets, "a") != nullptr);
+	CHECK(FakeImport::decodes == 2);
+	assets.memory_budget = AssetMemory();
+	assets.release<FakeAsset>(AssetId("a"));
+}
+
+TEST(assets_trim_evicts_least_recently_released_first) {
+	AssetBackend assets;
+	setup_backend(assets);
+
+	for (auto path : { "a", "b", "c", "d" }) load(assets, path);
+	CHECK(assets.get_memory_usage().gpu == 400);
+
+	assets.release<FakeAsset>(AssetId("b"));
+	assets.release<FakeAsset>(AssetId("a"));
+	assets.release<FakeAsset>(AssetId("c"));
+	// Retaining takes c out of the unused list, so it is not a candidate anymore.
+	CHECK(assets.retain(typeid(FakeAsset), AssetId("c")) != nullptr);
+	CHECK(FakeImport::unloaded.empty());
+
+	// d and c stay referenced, b then a go until 200 bytes fit.
+	assets.memory_budget = AssetMemory{ .gpu = 250, .cpu = 1000 };
+	assets.trim();
+	CHECK((FakeImport::unloaded == std::vector<std::string>{ "b", "a" }));
+	CHECK(assets.get_memory_usage().gpu == 200);
+
+	assets.release<FakeAsset>(AssetId("d"));
+	assets.release<FakeAsset>(AssetId("c"));
+	assets.memory_budget = AssetMemory{ .gpu = 100, .cpu = 1000 };
+	assets.trim();
+	CHECK((FakeImport::unloaded == std::vector<std::string>{ "b", "a", "d" }));
+	CHECK(assets.find<FakeAsset>(AssetId("c")) != nullptr);
+
+	assets.memory_budget = AssetMemory();
+	assets.trim();
+	CHECK(assets.get_memory_usage().gpu == 0);
+}
+
+TEST(assets_acquire_finishes_load_in_flight) {
+	AssetBackend assets;
+	setup_backend(assets);
+
+	FakeImport::hold_decoding = true;
+	auto future = assets.load_file_async<FakeAsset>("slow");
+	CHECK(future.is_valid());
+	CHECK(future.get_status() == LoadStatus::Decoding);
+	CHECK(assets.get_pending_loads() == 1);
+	CHECK(assets.find<FakeAsset>(AssetId("slow")) == nullptr);
+
+	// A second async request shares the load instead of decoding the file again.
+	auto shared = assets.load_file_async<FakeAsset>("slow");
+
+	// The blocking load waits for the worker and uploads on the spot.
+	std::thread release_decoding([] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		FakeImport::hold_decoding = false;
+	});
+	auto asset = load(assets, "slow");
+	release_decoding.join();
+
+	CHECK(asset != nullptr);
+	CHECK(FakeImport::decodes == 1);
+	CHECK(FakeImport::uploads == 1);
+	CHECK(future.is_done());
+	CHECK(shared.is_done());
+	CHECK(future.get() && future.get().value() == asset);
+	CHECK(assets.get_pending_loads() == 0);
+
+	// The upload queue no longer holds the load.
+	assets.process_uploads();
+	CHECK(FakeImport::uploads == 1);
+
+	// Two async requests and the blocking one each hold a reference.
+	assets.memory_budget = AssetMemory();
+	assets.release<FakeAsset>(AssetId("slow"));
+	assets.release<FakeAsset>(AssetId("slow"));
+	CHECK(FakeImport::unloaded.empty());
+	assets.release<FakeAsset>(AssetId("slow"));
+	CHECK(FakeImport::unloaded == std::vector<std::string>{ "slow" });
+}
@@ -0,0 +1,166 @@
+#include "test.h"
+#include "../src/rendering/bvh.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+	AABB random_box(std::mt19937& rng, float world_size) {
+		std::uniform_real_distribution<float> pos(0.0f, world_size);
+		std::uniform_real_distribution<float> extent(0.25f, 1.5f);
+		glm::vec3 center(pos(rng), pos(rng), pos(rng));
+		glm::vec3 half(extent(rng), extent(rng), extent(rng));
+		return AABB{ .min = center - half, .max = center + half };
+	}
+
+	/// Reference slab test, independent from the one inside the tree.
+	float ray_distance(glm::vec3 origin, glm::vec3 dir, const AABB& box) {
+		float near_t = 0.0f;
+		float far_t = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++) {
+			if (std::abs(dir[axis]) < 1e-12f) {
+				if (origin[axis] < box.min[axis] || origin[axis] > box.max[axis]) return -1.0f;
+				continue;
+			}
+			float t0 = (box.min[axis] - origin[axis]) / dir[axis];
+			float t1 = (box.max[axis] - origin[axis]) / dir[axis];
+			near_t = std::max(near_t, std::min(t0, t1));
+			far_t = std::min(far_t, std::max(t0, t1));
+		}
+		return near_t <= far_t ? near_t : -1.0f;
+	}
+
+	std::vector<uint32_t> brute_query(const std::vector<AABB>& boxes, const std::vector<bool>& alive, const Frustum& frustum) {
+		std::vector<uint32_t> out;
+		for (uint32_t i = 0; i < boxes.size(); i++) {
+			if (alive[i] && frustum.intersects(boxes[i])) out.push_back(i);
+		}
+		return out;
+	}
+
+	/// Camera standing outside a corner of the world looking at its center.
+	glm::mat4 corner_camera(float world_size, float far_plane = 150.0f) {
+		glm::vec3 eye(-10.0f, world_size * 0.5f, -10.0f);
+		auto view = glm::lookAt(eye, glm::vec3(world_size * 0.5f), glm::vec3(0, 1, 0));
+		return glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, far_plane) * view;
+	}
+}
+
+TEST(bvh_matches_brute_force) {
+	std::mt19937 rng(42);
+	const float world_size = 200.0f;
+	DynamicBVH tree;
+	std::vector<AABB> boxes;
+	std::vector<int32_t> proxies;
+	std::vector<bool> alive;
+	for (uint32_t i = 0; i < 3000; i++) {
+		boxes.push_back(random_box(rng, world_size));
+		proxies.push_back(tree.insert(boxes.back(), i));
+		alive.push_back(true);
+	}
+
+	// Small moves stay inside the fat boxes, big ones reinsert the leaf.
+	std::uniform_int_distribution<uint32_t> pick(0, 2999);
+	std::uniform_real_distribution<float> nudge(-0.05f, 0.05f);
+	for (int i = 0; i < 2000; i++) {
+		uint32_t index = pick(rng);
+		if (!alive[index]) continue;
+		if (i % 3 == 0) {
+			tree.remove(proxies[index]);
+			alive[index] = false;
+			continue;
+		}
+		if (i % 3 == 1) boxes[index] = random_box(rng, world_size);
+		else {
+			glm::vec3 offset(nudge(rng), nudge(rng), nudge(rng));
+			boxes[index].min += offset;
+			boxes[index].max += offset;
+		}
+		tree.move(proxies[index], boxes[index]);
+	}
+	CHECK(tree.size() == (size_t)std::count(alive.begin(), alive.end(), true));
+
+	std::vector<glm::mat4> views = {
+		corner_camera(world_size),
+		glm::ortho(-40.0f, 40.0f, -40.0f, 40.0f, 0.0f, 300.0f) * glm::lookAt(glm::vec3(100, 250, 100), glm::vec3(100, 0, 100), glm::vec3(0, 0, 1)),
+		glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 30.0f) * glm::lookAt(glm::vec3(100), glm::vec3(100, 100, 130), glm::vec3(0, 1, 0)),
+	};
+	for (auto& view_proj : views) {
+		auto frustum = Frustum::from_matrix(view_proj);
+		std::vector<uint32_t> found;
+		tree.query(frustum, found);
+		std::sort(found.begin(), found.end());
+		auto expected = brute_query(boxes, alive, frustum);
+		CHECK(!expected.empty());
+		CHECK(found == expected);
+	}
+
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int i = 0; i < 500; i++) {
+		glm::vec3 origin(-5.0f, world_size * 0.5f, -5.0f);
+		glm::vec3 dir = glm::normalize(glm::vec3(1.0f, unit(rng) * 0.5f, 1.0f) + glm::vec3(unit(rng), 0, unit(rng)) * 0.3f);
+
+		float best = FLT_MAX;
+		for (uint32_t b = 0; b < boxes.size(); b++) {
+			float dist = alive[b] ? ray_distance(origin, dir, boxes[b]) : -1.0f;
+			if (dist >= 0.0f && dist < best) best = dist;
+		}
+		uint32_t hit = 0;
+		float hit_dist = 0.0f;
+		bool found = tree.raycast(origin, dir, FLT_MAX, hit, hit_dist);
+		CHECK(found == (best != FLT_MAX));
+		if (found && best != FLT_MAX) {
+			CHECK(std::abs(hit_dist - best) < 1e-3f);
+			CHECK(std::abs(ray_distance(origin, dir, boxes[hit]) - best) < 1e-3f);
+		}
+	}
+}
+
+BENCH(bvh_query_vs_brute_force) {
+	// The near camera sees about the same volume whatever the count, the far one ends up seeing most of the world.
+	std::println(std::cout, "  {:>8} | {:>9} | near camera: {:>7} {:>9} {:>9} | far camera: {:>7} {:>9} {:>9} | ray: {:>9} {:>9}",
+		"visuals", "build ms", "visible", "bvh ms", "brute ms", "visible", "bvh ms", "brute ms", "bvh ms", "brute ms");
+	for (uint32_t count : { 1000u, 10000u, 100000u, 1000000u }) {
+		std::mt19937 rng(count);
+		// About one visual per 8 cubic units, whatever the count.
+		float world_size = 2.0f * std::cbrt((float)count);
+		std::vector<AABB> boxes;
+		for (uint32_t i = 0; i < count; i++) boxes.push_back(random_box(rng, world_size));
+
+		DynamicBVH tree;
+		double build = time_ms([&] { for (uint32_t i = 0; i < count; i++) tree.insert(boxes[i], i); });
+
+		BoundsSoA soa;
+		for (auto& box : boxes) soa.push(box);
+
+		size_t visible[2];
+		double bvh_query[2], brute_query[2];
+		for (int camera = 0; camera < 2; camera++) {
+			auto frustum = Frustum::from_matrix(corner_camera(world_size, camera == 0 ? 30.0f : 150.0f));
+			std::vector<uint32_t> found;
+			bvh_query[camera] = time_ms([&] { found.clear(); tree.query(frustum, found); }, 20);
+			visible[camera] = found.size();
+			brute_query[camera] = time_ms([&] { found.clear(); soa.cull(frustum, found); }, 20);
+			CHECK(found.size() == visible[camera]);
+		}
+
+		glm::vec3 origin(-5.0f, world_size * 0.5f, -5.0f);
+		glm::vec3 dir = glm::normalize(glm::vec3(world_size * 0.5f) - origin);
+		uint32_t hit = 0;
+		float hit_dist = 0.0f;
+		double bvh_ray = time_ms([&] { tree.raycast(origin, dir, FLT_MAX, hit, hit_dist); }, 100);
+		float best = FLT_MAX;
+		double brute_ray = time_ms([&] {
+			best = FLT_MAX;
+			for (auto& box : boxes) {
+				float dist = ray_distance(origin, dir, box);
+				if (dist >= 0.0f && dist < best) best = dist;
+			}
+		}, 5);
+		keep_alive(best);
+
+		std::println(std::cout, "  {:>8} | {:>9.2f} | near camera: {:>7} {:>9.4f} {:>9.4f} | far camera: {:>7} {:>9.4f} {:>9.4f} | ray: {:>9.5f} {:>9.4f}",
+			count, build, visible[0], bvh_query[0], brute_query[0], visible[1], bvh_query[1], brute_query[1], bvh_ray, brute_ray);
+	}
+}
@@ -0,0 +1,44 @@
+#include "test.h"
+#include "../src/assets/import.h"
+#include "../src/thread_pool.h"
+#include <cstring>
+
+namespace {
+	// Relative to the project directory, where Visual Studio runs the tests from.
+	const char* skybox_path = "res/skybox/skybox#.png";
+
+	bool same_faces(const ImagePayload& a, const ImagePayload& b) {
+		if (a.width != b.width || a.heigth != b.heigth || a.nrChannels != b.nrChannels) return false;
+		size_t bytes = (size_t)a.width * a.heigth * a.nrChannels;
+		for (int i = 0; i < 6; i++) {
+			if (std::memcmp(a.images[i], b.images[i], bytes) != 0) return false;
+		}
+		return true;
+	}
+}
+
+TEST(cubemap_missing_face_fails) {
+	ThreadPool workers;
+	CHECK(!GPUCubemapTextureImport::decode_faces("res/skybox/missing#.png", nullptr));
+	CHECK(!GPUCubemapTextureImport::decode_faces("res/skybox/missing#.png", &workers));
+}
+
+BENCH(cubemap_sequential_vs_parallel_decode) {
+	auto sequential = GPUCubemapTextureImport::decode_faces(skybox_path, nullptr);
+	CHECK(sequential.has_value());
+	if (!sequential) return;
+
+	std::println(std::cout, "  {:>7} | {:>9} | {:>7}", "threads", "decode ms", "speedup");
+	double sequential_ms = time_ms([] { keep_alive(GPUCubemapTextureImport::decode_faces(skybox_path, nullptr)); }, 5);
+	std::println(std::cout, "  {:>7} | {:>9.2f} | {:>7.2f}", 1, sequential_ms, 1.0);
+
+	// The caller decodes faces too, so a pool of N workers decodes on N + 1 threads.
+	for (uint threads : { 1u, 2u, 5u }) {
+		ThreadPool workers(threads);
+		auto parallel = GPUCubemapTextureImport::decode_faces(skybox_path, &workers);
+		CHECK(parallel.has_value() && same_faces(**sequential, **parallel));
+
+		double parallel_ms = time_ms([&] { keep_alive(GPUCubemapTextureImport::decode_faces(skybox_path, &workers)); }, 5);
+		std::println(std::cout, "  {:>7} | {:>9.2f} | {:>7.2f}", threads + 1, parallel_ms, sequential_ms / parallel_ms);
+	}
+}
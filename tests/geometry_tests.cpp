@@ -0,0 +1,199 @@
+#include "test.h"
+#include "../src/rendering/indirect_commands.h"
+#include "../src/rendering/range_allocator.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace {
+	// The builder only compares and forwards these pointers, they are never dereferenced.
+	alignas(8) char fake_objects[64];
+	template <typename T>
+	T* fake(int id) { return reinterpret_cast<T*>(fake_objects + id * 8); }
+
+	struct FakeMesh {
+		int id;
+		GPUGeometryBuffer* geometry;
+		uint first_index;
+		uint index_count;
+		uint first_vertex;
+	};
+
+	std::map<GPUMesh*, GeometryRange> make_ranges(const std::vector<FakeMesh>& meshes) {
+		std::map<GPUMesh*, GeometryRange> ranges;
+		for (auto& mesh : meshes) {
+			ranges[fake<GPUMesh>(mesh.id)] = GeometryRange{
+				.geometry = mesh.geometry,
+				.first_vertex = mesh.first_vertex,
+				.vertex_count = 100,
+				.first_index = mesh.first_index,
+				.index_count = mesh.index_count,
+			};
+		}
+		return ranges;
+	}
+
+	InstanceData make_instance(float tag) {
+		InstanceData instance{};
+		instance.model[3][0] = tag;
+		return instance;
+	}
+}
+
+TEST(indirect_builder_batches_sorted_queue) {
+	auto geometry_a = fake<GPUGeometryBuffer>(0);
+	auto geometry_b = fake<GPUGeometryBuffer>(1);
+	auto material_a = fake<GPUMaterial>(2);
+	auto material_b = fake<GPUMaterial>(3);
+	auto ranges = make_ranges({
+		{ 4, geometry_a, 0, 36, 0 },
+		{ 5, geometry_a, 36, 60, 24 },
+		{ 6, geometry_b, 0, 12, 0 },
+	});
+	auto mesh_a = fake<GPUMesh>(4), mesh_b = fake<GPUMesh>(5), mesh_c = fake<GPUMesh>(6);
+
+	std::vector<InstanceData> instances;
+	for (int i = 0; i < 8; i++) instances.push_back(make_instance((float)i));
+
+	// Material A draws meshes A (x3) and B from one buffer, then mesh C from another buffer.
+	// Material B draws mesh A (x2), then mesh C.
+	std::vector<DrawItem> items = {
+		{ 0, material_a, mesh_a, &instances[0] },
+		{ 0, material_a, mesh_a, &instances[1] },
+		{ 0, material_a, mesh_a, &instances[2] },
+		{ 0, material_a, mesh_b, &instances[3] },
+		{ 0, material_a, mesh_c, &instances[4] },
+		{ 0, material_b, mesh_a, &instances[5] },
+		{ 0, material_b, mesh_a, &instances[6] },
+		{ 0, material_b, mesh_c, &instances[7] },
+	};
+
+	IndirectCommandBuilder builder;
+	builder.build(items, [&](const GPUMesh* mesh) { return ranges.at(const_cast<GPUMesh*>(mesh)); });
+
+	auto& commands = builder.get_commands();
+	CHECK(commands.size() == 5);
+	auto expect_command = [&](size_t i, uint count, uint instance_count, uint first_index, int base_vertex, uint base_instance) {
+		CHECK(i < commands.size());
+		if (i >= commands.size()) return;
+		CHECK(commands[i].count == count);
+		CHECK(commands[i].instance_count == instance_count);
+		CHECK(commands[i].first_index == first_index);
+		CHECK(commands[i].base_vertex == base_vertex);
+		CHECK(commands[i].base_instance == base_instance);
+	};
+	expect_command(0, 36, 3, 0, 0, 0);
+	expect_command(1, 60, 1, 36, 24, 3);
+	expect_command(2, 12, 1, 0, 0, 4);
+	expect_command(3, 36, 2, 0, 0, 5);
+	expect_command(4, 12, 1, 0, 0, 7);
+
+	// A new batch starts whenever the material or the geometry buffer changes.
+	auto& batches = builder.get_batches();
+	CHECK(batches.size() == 4);
+	if (batches.size() == 4) {
+		CHECK(batches[0].material == material_a && batches[0].geometry == geometry_a && batches[0].first_command == 0 && batches[0].command_count == 2);
+		CHECK(batches[1].material == material_a && batches[1].geometry == geometry_b && batches[1].first_command == 2 && batches[1].command_count == 1);
+		CHECK(batches[2].material == material_b && batches[2].geometry == geometry_a && batches[2].first_command == 3 && batches[2].command_count == 1);
+		CHECK(batches[3].material == material_b && batches[3].geometry == geometry_b && batches[3].first_command == 4 && batches[3].command_count == 1);
+	}
+
+	// Instances are copied in queue order so base_instance indexes them directly.
+	auto& built = builder.get_instances();
+	CHECK(built.size() == items.size());
+	for (size_t i = 0; i < built.size(); i++) CHECK(built[i].model[3][0] == (float)i);
+
+	builder.build({}, [&](const GPUMesh* mesh) { return ranges.at(const_cast<GPUMesh*>(mesh)); });
+	CHECK(builder.get_commands().empty());
+	CHECK(builder.get_batches().empty());
+	CHECK(builder.get_instances().empty());
+}
+
+TEST(range_allocator_allocate_free_coalesce) {
+	RangeAllocator ranges;
+	CHECK(ranges.allocate(1) == RangeAllocator::INVALID);
+
+	ranges.grow(100);
+	CHECK(ranges.get_capacity() == 100);
+	CHECK(ranges.get_free_count() == 100);
+	CHECK(ranges.allocate(0) == RangeAllocator::INVALID);
+
+	uint a = ranges.allocate(10);
+	uint b = ranges.allocate(20);
+	uint c = ranges.allocate(30);
+	CHECK(a == 0);
+	CHECK(b == 10);
+	CHECK(c == 30);
+	CHECK(ranges.get_free_count() == 40);
+	CHECK(ranges.allocate(41) == RangeAllocator::INVALID);
+
+	// First fit: the hole left by b is reused before the tail.
+	ranges.free(b, 20);
+	CHECK(ranges.allocate(15) == 10);
+	CHECK(ranges.allocate(5) == 25);
+	CHECK(ranges.allocate(1) == 60);
+	ranges.free(60, 1);
+
+	// Freeing a, b's pieces and c merges everything back into one range.
+	ranges.free(a, 10);
+	ranges.free(25, 5);
+	ranges.free(10, 15);
+	ranges.free(c, 30);
+	CHECK(ranges.get_free_count() == 100);
+	CHECK(ranges.allocate(100) == 0);
+	ranges.free(0, 100);
+
+	ranges.free(RangeAllocator::INVALID, 10);
+	CHECK(ranges.get_free_count() == 100);
+}
+
+TEST(range_allocator_grow) {
+	RangeAllocator ranges;
+	ranges.grow(64);
+	uint a = ranges.allocate(48);
+	CHECK(a == 0);
+	CHECK(ranges.allocate(32) == RangeAllocator::INVALID);
+
+	// The grown tail merges with the free end of the old capacity.
+	ranges.grow(96);
+	CHECK(ranges.get_free_count() == 48);
+	CHECK(ranges.allocate(40) == 48);
+	ranges.grow(32);
+	CHECK(ranges.get_capacity() == 96);
+}
+
+TEST(range_allocator_random_matches_reference) {
+	std::mt19937 rng(3);
+	RangeAllocator ranges;
+	ranges.grow(4096);
+	std::vector<bool> used(4096, false);
+	std::vector<std::pair<uint, uint>> live;
+
+	for (int step = 0; step < 5000; step++) {
+		if (live.empty() || rng() % 2) {
+			uint count = 1 + rng() % 64;
+			uint offset = ranges.allocate(count);
+			if (offset == RangeAllocator::INVALID) continue;
+			CHECK(offset + count <= 4096);
+			bool overlaps = false;
+			for (uint i = offset; i < offset + count && i < 4096; i++) {
+				overlaps |= used[i];
+				used[i] = true;
+			}
+			CHECK(!overlaps);
+			live.push_back({ offset, count });
+		}
+		else {
+			size_t pick = rng() % live.size();
+			auto [offset, count] = live[pick];
+			for (uint i = offset; i < offset + count; i++) used[i] = false;
+			ranges.free(offset, count);
+			live.erase(live.begin() + pick);
+		}
+		uint used_count = (uint)std::count(used.begin(), used.end(), true);
+		CHECK(ranges.get_free_count() == 4096 - used_count);
+	}
+
+	for (auto [offset, count] : live) ranges.free(offset, count);
+	CHECK(ranges.allocate(4096) == 0);
+}
@@ -0,0 +1,30 @@
+#include "test.h"
+#include <string_view>
+
+int TestRunner::run(bool benches, const std::string& filter) {
+	auto& runner = get_instance();
+	int ran = 0;
+	for (auto& test : runner.cases) {
+		if (test.is_bench != benches) continue;
+		if (!filter.empty() && std::string_view(test.name).find(filter) == std::string_view::npos) continue;
+
+		int failures = runner.failures;
+		std::println(std::cout, "{} {}", benches ? "[BENCH]" : "[TEST]", test.name);
+		test.run();
+		if (runner.failures != failures) std::println(std::cout, "  {} check(s) failed", runner.failures - failures);
+		ran++;
+	}
+	std::println(std::cout, "{} case(s) ran, {} failed check(s)", ran, runner.failures);
+	return runner.failures;
+}
+
+/// Usage: SwarmTests [--bench] [filter]
+int main(int argc, char** argv) {
+	bool benches = false;
+	std::string filter;
+	for (int i = 1; i < argc; i++) {
+		if (std::string_view(argv[i]) == "--bench") benches = true;
+		else filter = argv[i];
+	}
+	return TestRunner::run(benches, filter) == 0 ? 0 : 1;
+}
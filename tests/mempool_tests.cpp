@@ -0,0 +1,281 @@
+#include "test.h"
+#include "../src/MemPool.h"
+#include <random>
+#include <set>
+
+namespace {
+	struct Item {
+		float data[24] = {};
+		int value = 0;
+	};
+
+	struct BigItem : Item {
+		float extra[16] = {};
+	};
+
+	struct Tracked {
+		static inline int alive = 0;
+		int value = 0;
+		Tracked() { alive++; }
+		~Tracked() { alive--; }
+	};
+
+	struct Movable {
+		static inline int alive = 0;
+		std::vector<int> values;
+		Movable() { alive++; }
+		Movable(Movable&& other) noexcept : values(std::move(other.values)) { alive++; }
+		~Movable() { alive--; }
+	};
+
+	/// The pool MemPool replaced: one heap allocation per object and a pointer array with O(n) removal.
+	template <typename T>
+	class LegacyPool {
+		std::vector<T*> items = std::vector<T*>();
+
+	public:
+		~LegacyPool() { for (auto item : items) delete item; }
+
+		T* create() {
+			T* item = new T();
+			items.push_back(item);
+			return item;
+		}
+
+		void destroy(T* item) {
+			auto it = std::remove(items.begin(), items.end(), item);
+			if (it != items.end()) {
+				delete item;
+				items.erase(it, items.end());
+			}
+		}
+
+		auto begin() { return items.begin(); }
+		auto end() { return items.end(); }
+	};
+
+	/// Creates count items. With a scatter list, every item is followed by an unrelated heap allocation the way
+	/// visuals are created between model and material loads in a real level.
+	template <typename Pool>
+	std::vector<Item*> fill(Pool& pool, int count, std::vector<std::unique_ptr<char[]>>* scatter = nullptr) {
+		std::vector<Item*> items;
+		std::mt19937 rng(count);
+		for (int i = 0; i < count; i++) {
+			items.push_back(pool.create());
+			items.back()->value = i;
+			if (scatter) scatter->push_back(std::make_unique<char[]>(32 + rng() % 256));
+		}
+		return items;
+	}
+
+	/// Destroys every other item in random order and creates as many again, like a level reload does.
+	template <typename Pool>
+	void churn(Pool& pool, std::vector<Item*>& items, uint32_t seed) {
+		std::vector<Item*> victims;
+		for (size_t i = 0; i < items.size(); i += 2) victims.push_back(items[i]);
+		std::shuffle(victims.begin(), victims.end(), std::mt19937(seed));
+		for (auto item : victims) pool.destroy(item);
+		for (size_t i = 0; i < items.size(); i += 2) items[i] = pool.create();
+	}
+
+	template <typename Pool>
+	long long sum_values(Pool& pool) {
+		long long sum = 0;
+		for (auto item : pool) sum += item->value + (int)item->data[0];
+		return sum;
+	}
+}
+
+template <> struct is_pool_relocatable<Movable> : std::true_type {};
+
+template <typename Pool>
+concept Compactable = requires(Pool& pool) { pool.compact(); };
+static_assert(Compactable<MemPool<Movable>>);
+static_assert(!Compactable<MemPool<Item>>, "Pools only compact types that opt in");
+
+TEST(mempool_create_destroy) {
+	MemPool<Tracked, 0, 4> pool;
+	std::vector<Tracked*> items;
+	for (int i = 0; i < 10; i++) items.push_back(pool.create());
+	CHECK(pool.size() == 10);
+	CHECK(pool.capacity() == 12);
+	CHECK(Tracked::alive == 10);
+
+	pool.destroy(items[3]);
+	pool.destroy(items[3]);
+	CHECK(pool.size() == 9);
+	CHECK(Tracked::alive == 9);
+
+	// Freed slots are reused before the pool grows and live addresses never move.
+	Tracked* reused = pool.create();
+	CHECK(reused == items[3]);
+	CHECK(items[9] == *std::next(pool.begin(), 9));
+
+	pool.clear();
+	CHECK(pool.size() == 0);
+	CHECK(Tracked::alive == 0);
+}
+
+TEST(mempool_iterates_live_slots_in_address_order) {
+	MemPool<Item, 0, 8> pool;
+	auto items = fill(pool, 20);
+	for (int i : { 0, 5, 7, 8, 15, 19 }) pool.destroy(items[i]);
+
+	std::vector<int> seen;
+	for (auto item : pool) seen.push_back(item->value);
+	CHECK((seen == std::vector<int>{ 1, 2, 3, 4, 6, 9, 10, 11, 12, 13, 14, 16, 17, 18 }));
+
+	// Destroying the current item while iterating is allowed.
+	for (auto item : pool) {
+		if (item->value % 2 == 0) pool.destroy(item);
+	}
+	seen.clear();
+	for (auto item : pool) seen.push_back(item->value);
+	CHECK((seen == std::vector<int>{ 1, 3, 9, 11, 13, 17 }));
+	CHECK(pool.size() == 6);
+}
+
+TEST(mempool_derived_types_and_trim) {
+	MemPool<Item, sizeof(BigItem), 4> pool;
+	BigItem* big = pool.create<BigItem>();
+	big->extra[15] = 2.0f;
+	auto items = fill(pool, 8);
+	CHECK(pool.capacity() == 12);
+
+	for (auto item : items) pool.destroy(item);
+	pool.trim();
+	CHECK(pool.capacity() == 4);
+	CHECK(pool.size() == 1);
+	CHECK(*pool.begin() == big);
+	CHECK(big->extra[15] == 2.0f);
+
+	pool.destroy(big);
+	pool.trim();
+	CHECK(pool.capacity() == 0);
+	CHECK(pool.begin() == pool.end());
+}
+
+template <typename Pool>
+void bench_pool(int count, bool scattered, double& churn_ms, double& iter_ms, long long& sum) {
+	Pool pool;
+	std::vector<std::unique_ptr<char[]>> scatter;
+	std::vector<Item*> items;
+	churn_ms = time_ms([&] { items = fill(pool, count, scattered ? &scatter : nullptr); churn(pool, items, 7); });
+	iter_ms = time_ms([&] { sum += sum_values(pool); }, 50);
+}
+
+TEST(mempool_handles) {
+	MemPool<Item, 0, 4> pool;
+	Item* a = pool.create();
+	Item* b = pool.create();
+	auto ha = pool.get_handle(a);
+	auto hb = pool.get_handle(b);
+	CHECK(!ha.is_null());
+	CHECK(ha != hb);
+	CHECK(pool.get(ha) == a);
+	CHECK(pool.get(Handle<Item>()) == nullptr);
+	CHECK(pool.get_handle(nullptr).is_null());
+
+	pool.destroy(ha);
+	CHECK(!pool.is_valid(ha));
+	CHECK(pool.get(ha) == nullptr);
+	CHECK(pool.get_handle(a).is_null());
+	CHECK(pool.get(hb) == b);
+
+	// The slot and its id are reused, the stale handle must not resolve to the new object.
+	Item* c = pool.create();
+	auto hc = pool.get_handle(c);
+	CHECK(c == a);
+	CHECK(hc.get_index() == ha.get_index());
+	CHECK(hc.get_generation() != ha.get_generation());
+	CHECK(pool.get(ha) == nullptr);
+	CHECK(pool.get(hc) == c);
+
+	// Ids outlive trimmed chunks.
+	auto items = fill(pool, 8);
+	auto last = pool.get_handle(items.back());
+	for (auto item : items) pool.destroy(item);
+	pool.trim();
+	fill(pool, 8);
+	CHECK(!pool.is_valid(last));
+	CHECK(Handle<Item>::from_raw(hb.get_raw()) == hb);
+}
+
+TEST(mempool_fill_scales_linearly) {
+	// A pool 16 times bigger must not cost much more per create(), growing used to relink the whole pool.
+	auto create_ns = [](int count) {
+		double best = 1e30;
+		for (int run = 0; run < 3; run++) {
+			MemPool<Item> pool;
+			best = std::min(best, time_ms([&] { for (int i = 0; i < count; i++) keep_alive(pool.create()); }));
+		}
+		return best * 1e6 / count;
+	};
+	double small = create_ns(25000);
+	double large = create_ns(400000);
+	std::println(std::cout, "  create(): {:.1f} ns at 25k items, {:.1f} ns at 400k items", small, large);
+	CHECK(large < small * 4.0);
+}
+
+TEST(mempool_compact_keeps_handles) {
+	{
+		MemPool<Movable, 0, 8> pool;
+		std::vector<Movable*> items;
+		for (int i = 0; i < 100; i++) {
+			items.push_back(pool.create());
+			items.back()->values = { i, i * 2 };
+		}
+		std::vector<std::pair<Handle<Movable>, int>> kept;
+		std::vector<Handle<Movable>> destroyed;
+		for (int i = 0; i < 100; i++) {
+			auto handle = pool.get_handle(items[i]);
+			if (i % 4 == 1) kept.push_back({ handle, i });
+			else destroyed.push_back(handle);
+		}
+		for (auto handle : destroyed) pool.destroy(handle);
+		CHECK(pool.size() == 25);
+		CHECK(pool.capacity() == 104);
+
+		size_t moved = pool.compact();
+		CHECK(moved > 0);
+		CHECK(pool.capacity() == 32);
+		CHECK(pool.get_occupancy() == 25.0f / 32.0f);
+		CHECK(Movable::alive == 25);
+
+		for (auto [handle, value] : kept) {
+			auto item = pool.get(handle);
+			CHECK(item != nullptr);
+			CHECK(item && item->values == std::vector<int>({ value, value * 2 }));
+			CHECK(pool.get_handle(item) == handle);
+		}
+		for (auto handle : destroyed) CHECK(!pool.is_valid(handle));
+
+		// Survivors fill the front of the pool and new objects go right after them.
+		size_t visited = 0;
+		for (auto item : pool) {
+			CHECK(!item->values.empty());
+			visited++;
+		}
+		CHECK(visited == 25);
+		auto fresh = pool.create();
+		CHECK(pool.capacity() == 32);
+		CHECK(pool.get(pool.get_handle(fresh)) == fresh);
+		CHECK(pool.compact() == 0);
+	}
+	CHECK(Movable::alive == 0);
+}
+
+BENCH(mempool_vs_legacy_pool) {
+	for (bool scattered : { false, true }) {
+		std::println(std::cout, "  {} heap", scattered ? "scattered" : "fresh");
+		for (int count : { 1000, 10000, 50000 }) {
+			double legacy_churn, pool_churn, legacy_iter, pool_iter;
+			long long legacy_sum = 0, pool_sum = 0;
+			bench_pool<LegacyPool<Item>>(count, scattered, legacy_churn, legacy_iter, legacy_sum);
+			bench_pool<MemPool<Item>>(count, scattered, pool_churn, pool_iter, pool_sum);
+			CHECK(legacy_sum == pool_sum);
+			std::println(std::cout, "  {:>6} items | fill + churn: legacy {:8.3f} ms, slab {:8.3f} ms | iterate: legacy {:7.4f} ms, slab {:7.4f} ms",
+				count, legacy_churn, pool_churn, legacy_iter, pool_iter);
+		}
+	}
+}
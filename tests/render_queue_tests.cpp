@@ -0,0 +1,62 @@
+#include "test.h"
+#include "../src/rendering/render_queue.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace {
+	struct Draw {
+		uint mesh;
+		float depth;
+	};
+
+	std::vector<Draw> sorted_draws(RenderPass pass, const std::vector<Draw>& draws) {
+		RenderQueue queue;
+		for (size_t i = 0; i < draws.size(); i++) {
+			// The instance pointer carries the index back, the queue never dereferences it.
+			auto tag = reinterpret_cast<const InstanceData*>(i + 1);
+			queue.push(DrawItem{ .key = RenderQueue::make_key(pass, 3, 7, draws[i].mesh, draws[i].depth), .instance = tag });
+		}
+		queue.sort();
+		std::vector<Draw> out;
+		for (auto& item : queue.get_items()) out.push_back(draws[reinterpret_cast<size_t>(item.instance) - 1]);
+		return out;
+	}
+
+	std::vector<Draw> random_draws() {
+		std::mt19937 rng(7);
+		std::uniform_int_distribution<uint> mesh(0, 15);
+		std::uniform_real_distribution<float> depth(0.1f, 500.0f);
+		std::vector<Draw> draws;
+		for (int i = 0; i < 1000; i++) draws.push_back(Draw{ mesh(rng), depth(rng) });
+		return draws;
+	}
+}
+
+TEST(render_queue_depth_prepass_sorts_front_to_back) {
+	auto draws = sorted_draws(RenderPass::DepthPrePass, random_draws());
+	// Keys keep the top 16 bits of the depth, draws closer than that quantization may come in any order.
+	auto quantized = [](float depth) {
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 16;
+	};
+	CHECK(std::is_sorted(draws.begin(), draws.end(), [&](const Draw& a, const Draw& b) { return quantized(a.depth) < quantized(b.depth); }));
+}
+
+TEST(render_queue_opaque_groups_meshes) {
+	auto draws = sorted_draws(RenderPass::OpaquePass, random_draws());
+	CHECK(std::is_sorted(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) { return a.mesh < b.mesh; }));
+	// Within a mesh, instances still go front to back.
+	for (size_t i = 1; i < draws.size(); i++) {
+		if (draws[i].mesh == draws[i - 1].mesh) CHECK(draws[i - 1].depth <= draws[i].depth + 0.01f * draws[i].depth);
+	}
+}
+
+TEST(render_queue_orders_passes) {
+	uint64_t shadow = RenderQueue::make_key(RenderPass::ShadowPass, 4095, 65535, 65535, 1e30f);
+	uint64_t prepass = RenderQueue::make_key(RenderPass::DepthPrePass, 0, 0, 0, 0.0f);
+	uint64_t opaque = RenderQueue::make_key(RenderPass::OpaquePass, 0, 0, 0, 0.0f);
+	CHECK(shadow < prepass);
+	CHECK(prepass < opaque);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <chrono>
+#include <format>
+#include <print>
+#include <iostream>
+
+/// @brief Tiny self registering test harness. TEST cases run by default, BENCH cases only with --bench.
+struct TestCase {
+	const char* name;
+	void (*run)();
+	bool is_bench;
+};
+
+class TestRunner {
+	std::vector<TestCase> cases;
+	int failures = 0;
+
+	TestRunner() {}
+
+public:
+	static TestRunner& get_instance() {
+		static TestRunner runner;
+		return runner;
+	}
+
+	static bool add(const char* name, void (*run)(), bool is_bench) {
+		get_instance().cases.push_back(TestCase{ name, run, is_bench });
+		return true;
+	}
+
+	static void fail(const char* file, int line, const char* expr) {
+		get_instance().failures++;
+		std::println(std::cout, "  FAILED {}:{}: {}", file, line, expr);
+	}
+
+	/// @brief Runs every registered case whose name contains filter. Returns the number of failed checks.
+	static int run(bool benches, const std::string& filter);
+};
+
+/// @brief Runs fn repeat times and returns the average milliseconds per run.
+template <typename F>
+double time_ms(F&& fn, int repeat = 1) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++) fn();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / repeat;
+}
+
+/// @brief Keeps the optimizer from discarding benchmark results.
+template <typename V>
+void keep_alive(const V& value) {
+	static volatile const void* sink;
+	sink = &value;
+}
+
+#define TEST_CASE_IMPL(name, is_bench) \
+	static void name(); \
+	static const bool name##_registered = TestRunner::add(#name, &name, is_bench); \
+	static void name()
+
+#define TEST(name) TEST_CASE_IMPL(name, false)
+#define BENCH(name) TEST_CASE_IMPL(name, true)
+
+#define CHECK(expr) do { if (!(expr)) TestRunner::fail(__FILE__, __LINE__, #expr); } while (0)